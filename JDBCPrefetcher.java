@@ -0,0 +1,163 @@
+/*-------------------------------------------------------------------------
+ *
+ *                foreign-data wrapper for JDBC
+ *
+ * Copyright (c) 2012, PostgreSQL Global Development Group
+ *
+ * This software is released under the PostgreSQL Licence
+ *
+ * IDENTIFICATION
+ *                jdbc2_fdw/JDBCPrefetcher.java
+ *
+ *-------------------------------------------------------------------------
+ */
+
+import java.util.*;
+
+/*
+ * JDBCPrefetcher
+ *      Reads batches of an open result set ahead of the C code in a
+ *      background thread, so the remote server is fetching the next rows
+ *      while PostgreSQL processes the current ones. At most maxBatches
+ *      batches, and about maxBytes of them, are kept waiting.
+ */
+public class JDBCPrefetcher implements Runnable
+{
+    private final JDBCUtils.Cursor          cursor;
+    private volatile int                    maxRows;
+    private final int[]                     typeCodes;
+    private final int                       maxBatches;
+    private final long                      maxBytes;
+    private final LinkedList<JDBCUtils.Batch> queue = new LinkedList<JDBCUtils.Batch>();
+    private final Thread                    thread;
+    private long                            queuedBytes;
+    private boolean                         done;
+    private boolean                         stopped;
+    private boolean                         reading;
+    private Throwable                       failure;
+
+    /*
+     * JDBCPrefetcher
+     *      Starts reading batches of maxRows rows from cursor, in text form
+     *      when typeCodes is null.
+     */
+    public
+    JDBCPrefetcher(JDBCUtils.Cursor cursor, int maxRows, int[] typeCodes, int maxBatches, long maxBytes)
+    {
+        this.cursor = cursor;
+        this.maxRows = maxRows;
+        this.typeCodes = (typeCodes == null) ? null : typeCodes.clone();
+        this.maxBatches = maxBatches;
+        this.maxBytes = maxBytes;
+        thread = new Thread(this, "jdbc2_fdw prefetch");
+        thread.setDaemon(true);
+        thread.start();
+    }
+
+    /*
+     * run
+     *      Body of the prefetch thread. Blocks while the queue is full; a
+     *      single batch is always accepted, even if it is over maxBytes.
+     */
+    public void
+    run()
+    {
+        try {
+            while (true) {
+                JDBCUtils.Batch batch;
+
+                synchronized (this) {
+                    if (stopped) {
+                        return;
+                    }
+                    reading = true;
+                }
+                try {
+                    batch = cursor.readBatch(maxRows, typeCodes, null);
+                } finally {
+                    synchronized (this) {
+                        reading = false;
+                    }
+                }
+                synchronized (this) {
+                    while (!stopped && !queue.isEmpty() &&
+                           (queue.size() >= maxBatches || queuedBytes + batch.bytes > maxBytes)) {
+                        wait();
+                    }
+                    if (stopped) {
+                        return;
+                    }
+                    queue.addLast(batch);
+                    queuedBytes += batch.bytes;
+                    notifyAll();
+                    if (batch.last) {
+                        return;
+                    }
+                }
+            }
+        } catch (Throwable e) {
+            synchronized (this) {
+                failure = e;
+            }
+        } finally {
+            synchronized (this) {
+                done = true;
+                notifyAll();
+            }
+        }
+    }
+
+    /*
+     * take
+     *      Returns the next batch, waiting for the prefetch thread only if
+     *      none is ready. Batches read from now on have maxRows rows, the
+     *      ones already queued keep their size. Returns null once the
+     *      result set is exhausted. Once the batches read before a failure
+     *      of the prefetch thread are taken, the failure is thrown.
+     */
+    public synchronized JDBCUtils.Batch
+    take(int maxRows) throws Exception
+    {
+        JDBCUtils.Batch batch;
+
+        this.maxRows = maxRows;
+        while (queue.isEmpty() && !done) {
+            wait();
+        }
+        if (queue.isEmpty()) {
+            if (failure != null) {
+                throw new Exception("Prefetching the next batch failed", failure);
+            }
+            return null;
+        }
+        batch = queue.removeFirst();
+        queuedBytes -= batch.bytes;
+        notifyAll();
+        return batch;
+    }
+
+    /*
+     * stop
+     *      Stops the prefetch thread and waits for it to let go of the
+     *      result set, which the caller is about to close. If the thread is
+     *      in the middle of reading a batch its statement is cancelled, so
+     *      closing a scan early doesn't wait for rows nobody wants, or
+     *      forever for a remote server that doesn't answer.
+     */
+    public void
+    stop() throws InterruptedException
+    {
+        boolean busy;
+
+        synchronized (this) {
+            stopped = true;
+            queue.clear();
+            notifyAll();
+            busy = reading;
+        }
+        if (busy) {
+            cursor.cancel();
+        }
+        thread.join();
+    }
+}
@@ -18,31 +18,78 @@
 import java.sql.*;
 import java.text.*;
 import java.io.*;
+import java.lang.reflect.InvocationTargetException;
 import java.net.URL;
 import java.net.URLClassLoader;
 import java.net.MalformedURLException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
 import java.util.*;
+import java.time.DateTimeException;
+import java.time.LocalDate;
+import java.time.LocalDateTime;
+import java.time.ZoneOffset;
 public class JDBCUtils
 {
-    private ResultSet               resultSet;
+    /*
+     * Type codes used by returnResultSetTyped, these must match the
+     * JAVA_TYPE_* definitions in jq.c
+     */
+    private static final int        TYPE_STRING = 0;
+    private static final int        TYPE_SHORT = 1;
+    private static final int        TYPE_INT = 2;
+    private static final int        TYPE_LONG = 3;
+    private static final int        TYPE_FLOAT = 4;
+    private static final int        TYPE_DOUBLE = 5;
+    private static final int        TYPE_BOOLEAN = 6;
+    private static final int        TYPE_DATE = 7;
+    private static final int        TYPE_TIMESTAMP = 8;
+    /* Only used for parameters */
+    private static final int        TYPE_NUMERIC = 9;
+    private static final int        TYPE_OTHER = 10;
+
+    /* Rows a batch has room for at first, it grows as more rows arrive */
+    private static final int        INITIAL_BATCH_ROWS = 1000;
+
+    /*
+     * JDBC doesn't promise that a Connection can be used from several
+     * threads at once, and prefetch threads read their result sets while
+     * the C code runs other statements. So every driver call on conn is
+     * made holding the lock of this object, except Statement.cancel, which
+     * is meant to interrupt a call in another thread. Nothing may wait for
+     * a prefetch thread while holding the lock, as the thread may be
+     * waiting for it too.
+     */
     private Connection              conn = null;
-    private int                     numberOfColumns;
-    private int                     numberOfRows;
-    private Statement               stmt = null;
-    private String[]                resultRow;
+    private Map<Integer, Cursor>    cursors = new HashMap<Integer, Cursor>();
+    private int                     prefetchBatches;
+    private long                    prefetchBytes;
+    private int                     numberOfBatchRows;
+    private boolean                 lastBatch;
+    private String                  batchError;
     private static JDBCDriverLoader jdbcDriverLoader;
     private StringWriter            exceptionStringWriter;
     private PrintWriter             exceptionPrintWriter;
     private int                     queryTimeoutValue;
-    private ResultSetMetaData       rSetMetadata;
+    private Map<String, Prepared>   preparedStatements = new HashMap<String, Prepared>();
+    private int                     statementCacheSize;
+    private LinkedHashMap<String, PreparedStatement> statementCache;
+    private String[]                returnedRows;
+    private int                     returnedColumns;
+    private int                     updateCount;
+    private int                     isolationLevel = -1;
+    private Map<Integer, Savepoint> savepoints = new HashMap<Integer, Savepoint>();
 
     /*
      * createConnection
      *      Initiates the connection to the foreign database after setting 
      *      up initial configuration.
-     *      Caller will pass in a six element array with the following elements:
+     *      Caller will pass in a nine element array with the following elements:
      *          0 - Driver class name, 1 - JDBC URL, 2 - Username
      *          3 - Password, 4 - Query timeout in seconds, 5 - jarfile
+     *          6 - Number of batches to prefetch, 7 - Prefetch limit in bytes
+     *          8 - Number of idle prepared statements to keep
      *      Returns:
      *          null on success
      *          otherwise a string containing a stack trace
@@ -62,9 +109,20 @@ public class JDBCUtils
         String                  fileName = options[5];
 
         queryTimeoutValue = Integer.parseInt(qTimeoutValue);
+        prefetchBatches = Integer.parseInt(options[6]);
+        prefetchBytes = Long.parseLong(options[7]);
+        statementCacheSize = Integer.parseInt(options[8]);
+        statementCache = new LinkedHashMap<String, PreparedStatement>() {
+            protected boolean removeEldestEntry(Map.Entry<String, PreparedStatement> eldest) {
+                if (size() <= statementCacheSize) {
+                    return false;
+                }
+                closeQuietly(eldest.getValue());
+                return true;
+            }
+        };
         exceptionStringWriter = new StringWriter();
         exceptionPrintWriter = new PrintWriter(exceptionStringWriter);
-        numberOfColumns = 0;
         try {
             File JarFile = new File(fileName);
             String jarfile_path = JarFile.toURI().toURL().toString();
@@ -86,104 +144,1391 @@ public class JDBCUtils
              * calling C code by returning a Java String object
              * that has the exception's stack trace.
              * If all goes well,a null String is returned. */
-            e.printStackTrace(exceptionPrintWriter);
-            return (new String(exceptionStringWriter.toString()));
+            return stackTrace(e);
         }
         return null;
     }
 
     /*
      * createStatement
-     *      Create a statement object based on the query
+     *      Run the query and open its result set as cursor cursorId. A
+     *      positive fetchSize is passed on to the driver as the number of
+     *      rows to get per round trip, otherwise the driver default is used.
+     *      With a statement cache the query is run as a prepared statement
+     *      that closeStatement keeps for the next time the same query comes.
      *      Returns:
      *          null on success
      *          otherwise a string containing a stack trace
      */
-    public String
-    createStatement(String query) throws IOException
+    public synchronized String
+    createStatement(int cursorId, String query, int fetchSize) throws IOException
     {
+        Statement stmt = null;
+        String stmtQuery = null;
         try {
+            Cursor cursor;
+            ResultSet resultSet;
+
             if(conn == null){
                 throw new Exception("Must create connection before creating a statment");
             }
-            if(stmt != null){
-                throw new Exception("Must close a prior statement before creating a new one");
+            if(cursors.containsKey(cursorId)){
+                throw new Exception("Cursor " + cursorId + " is already open");
             }
-            stmt = conn.createStatement(ResultSet.TYPE_FORWARD_ONLY, ResultSet.CONCUR_READ_ONLY);
-            if (queryTimeoutValue != 0) {
-                stmt.setQueryTimeout(queryTimeoutValue);
+            if (statementCacheSize > 0) {
+                stmt = acquireStatement(query);
+                stmtQuery = query;
+            } else {
+                stmt = conn.createStatement(ResultSet.TYPE_FORWARD_ONLY, ResultSet.CONCUR_READ_ONLY);
+                if (queryTimeoutValue != 0) {
+                    stmt.setQueryTimeout(queryTimeoutValue);
+                }
+            }
+            if (fetchSize > 0) {
+                stmt.setFetchSize(fetchSize);
+            }
+            if (stmtQuery != null) {
+                resultSet = ((PreparedStatement) stmt).executeQuery();
+            } else {
+                resultSet = stmt.executeQuery(query);
             }
-            resultSet = stmt.executeQuery(query);
-            rSetMetadata = resultSet.getMetaData();
-            numberOfColumns = rSetMetadata.getColumnCount();
-            resultRow = new String[numberOfColumns];
+            cursor = openCursor(cursorId, resultSet, fetchSize);
+            cursor.stmt = stmt;
+            cursor.stmtQuery = stmtQuery;
         } catch (Exception e) {
             /* If an exception occurs,it is returned back to the
              * calling C code by returning a Java String object
              * that has the exception's stack trace.
              * If all goes well,a null String is returned. */
-            e.printStackTrace(exceptionPrintWriter);
-            return (new String(exceptionStringWriter.toString()));
+            /* Don't leak the statement of a failed query */
+            if (stmt != null) {
+                closeQuietly(stmt);
+            }
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * Prepared
+     *      A prepared statement with the type codes of its parameters.
+     */
+    static class Prepared
+    {
+        String              query;
+        PreparedStatement   statement;
+        int[]               typeCodes;
+    }
+
+    /*
+     * acquireStatement
+     *      Returns a prepared statement for query, taken out of the
+     *      statement cache if the query was prepared before. A statement is
+     *      only in the cache while nobody uses it, so two scans running the
+     *      same query never share one.
+     */
+    private PreparedStatement
+    acquireStatement(String query) throws SQLException
+    {
+        PreparedStatement ps = statementCache.remove(query);
+
+        if (ps == null) {
+            ps = conn.prepareStatement(query, ResultSet.TYPE_FORWARD_ONLY, ResultSet.CONCUR_READ_ONLY);
+            if (queryTimeoutValue != 0) {
+                ps.setQueryTimeout(queryTimeoutValue);
+            }
+        }
+        return ps;
+    }
+
+    /*
+     * releaseStatement
+     *      Put a statement that is no longer used back into the cache, as
+     *      its most recently used entry. The least recently used one is
+     *      closed once the cache holds more than statementCacheSize. The
+     *      row limit and fetch size of its last use are dropped, so the
+     *      next user of the query, say ANALYZE after a scan with a LIMIT,
+     *      gets all of its rows.
+     */
+    private void
+    releaseStatement(String query, PreparedStatement ps) throws SQLException
+    {
+        if (statementCacheSize <= 0 || statementCache.containsKey(query)) {
+            ps.close();
+            return;
+        }
+        ps.clearParameters();
+        ps.setMaxRows(0);
+        ps.setFetchSize(0);
+        statementCache.put(query, ps);
+    }
+
+    private static void
+    closeQuietly(Statement statement)
+    {
+        try {
+            statement.close();
+        } catch (SQLException e) {
+            /* Nothing to do, the statement is being discarded anyway */
+        }
+    }
+
+    /*
+     * prepareStatement
+     *      Prepare query, with ? placeholders for its parameters, under the
+     *      given name. typeCodes gives the type of each parameter, which
+     *      decides the setter used to bind it. Like in PostgreSQL, the
+     *      unnamed ("") statement replaces any previous one.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    prepareStatement(String name, String query, int[] typeCodes) throws IOException
+    {
+        try {
+            Prepared prepared = new Prepared();
+
+            if(conn == null){
+                throw new Exception("Must create connection before preparing a statment");
+            }
+            if(preparedStatements.containsKey(name)){
+                if(!name.isEmpty()){
+                    throw new Exception("Prepared statement \"" + name + "\" already exists");
+                }
+                Prepared old = preparedStatements.remove(name);
+                releaseStatement(old.query, old.statement);
+            }
+            prepared.query = query;
+            prepared.statement = acquireStatement(query);
+            prepared.typeCodes = typeCodes;
+            preparedStatements.put(name, prepared);
+        } catch (Exception e) {
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * executePrepared
+     *      Bind values, in the text form of the PostgreSQL output functions
+     *      with null for SQL NULL, to the parameters of a prepared statement
+     *      and execute it. With a cursorId of 0 or more the result set is
+     *      opened as that cursor, to be read in batches like after
+     *      createStatement.
+     *      A maxRows over 0 caps the rows of the cursor, letting the driver
+     *      stop the remote query early.
+     *      Otherwise any rows returned are read right away into returnedRows,
+     *      flattened like in returnResultSetBatch, and the row count of a
+     *      command is left in updateCount.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    executePrepared(String name, String[] values, int cursorId, int fetchSize, int maxRows) throws IOException
+    {
+        try {
+            Prepared prepared = preparedStatements.get(name);
+            PreparedStatement ps;
+            int i;
+
+            if(prepared == null){
+                throw new Exception("Prepared statement \"" + name + "\" does not exist");
+            }
+            if(cursorId >= 0 && cursors.containsKey(cursorId)){
+                throw new Exception("Cursor " + cursorId + " is already open");
+            }
+            ps = prepared.statement;
+            for (i = 0; i < values.length; i++) {
+                bindParameter(ps, i + 1, prepared.typeCodes[i], values[i]);
+            }
+            returnedRows = null;
+            returnedColumns = 0;
+            updateCount = -1;
+            // The statement is reused, so the limit of its last use must go
+            ps.setMaxRows((cursorId >= 0 && maxRows > 0) ? maxRows : 0);
+            if (cursorId >= 0) {
+                if (fetchSize > 0) {
+                    ps.setFetchSize(fetchSize);
+                }
+                openCursor(cursorId, ps.executeQuery(), fetchSize);
+            } else if (ps.execute()) {
+                ResultSet rows = ps.getResultSet();
+                ArrayList<String> cells = new ArrayList<String>();
+
+                returnedColumns = rows.getMetaData().getColumnCount();
+                while (rows.next()) {
+                    for (i = 0; i < returnedColumns; i++) {
+                        cells.add(rows.getString(i+1));
+                    }
+                }
+                rows.close();
+                returnedRows = cells.toArray(new String[cells.size()]);
+            } else {
+                updateCount = ps.getUpdateCount();
+            }
+        } catch (Exception e) {
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * bindParameter
+     *      Bind the text value of one parameter with the setter for its type
+     *      code. TYPE_OTHER values are sent untyped, so the remote server
+     *      infers their type. Dates, timestamps and numerics that Java cannot
+     *      represent, like infinity or NaN, are sent untyped as well.
+     *      Timestamps are bound as a LocalDateTime, which doesn't pass
+     *      through the JVM time zone, where a driver can take one.
+     */
+    private static void
+    bindParameter(PreparedStatement ps, int index, int typeCode, String value) throws SQLException
+    {
+        if (value == null) {
+            ps.setNull(index, sqlTypeOf(typeCode));
+            return;
+        }
+        switch (typeCode) {
+            case TYPE_SHORT:
+                ps.setShort(index, Short.parseShort(value));
+                break;
+            case TYPE_INT:
+                ps.setInt(index, Integer.parseInt(value));
+                break;
+            case TYPE_LONG:
+                ps.setLong(index, Long.parseLong(value));
+                break;
+            case TYPE_FLOAT:
+                ps.setFloat(index, Float.parseFloat(value));
+                break;
+            case TYPE_DOUBLE:
+                ps.setDouble(index, Double.parseDouble(value));
+                break;
+            case TYPE_BOOLEAN:
+                ps.setBoolean(index, value.equals("t"));
+                break;
+            case TYPE_DATE:
+            case TYPE_TIMESTAMP:
+            case TYPE_NUMERIC:
+                try {
+                    if (typeCode == TYPE_DATE) {
+                        ps.setDate(index, java.sql.Date.valueOf(value));
+                    } else if (typeCode == TYPE_TIMESTAMP) {
+                        bindTimestamp(ps, index, value);
+                    } else {
+                        ps.setBigDecimal(index, new java.math.BigDecimal(value));
+                    }
+                } catch (IllegalArgumentException | DateTimeException e) {
+                    ps.setObject(index, value, Types.OTHER);
+                }
+                break;
+            case TYPE_STRING:
+                ps.setString(index, value);
+                break;
+            default:
+                ps.setObject(index, value, Types.OTHER);
+                break;
+        }
+    }
+
+    /*
+     * bindTimestamp
+     *      Bind a timestamp in PostgreSQL's ISO text form as a LocalDateTime,
+     *      falling back to a Timestamp for drivers older than JDBC 4.2.
+     *      Infinity throws a DateTimeException, to be sent untyped.
+     */
+    private static void
+    bindTimestamp(PreparedStatement ps, int index, String value) throws SQLException
+    {
+        LocalDateTime local = parseTimestamp(value);
+
+        if (local.equals(LocalDateTime.MIN) || local.equals(LocalDateTime.MAX)) {
+            throw new DateTimeException("Timestamp " + value + " has no JDBC value");
+        }
+        try {
+            ps.setObject(index, local);
+        } catch (SQLException e) {
+            ps.setTimestamp(index, Timestamp.valueOf(local));
+        }
+    }
+
+    /*
+     * parseTimestamp
+     *      Parse a timestamp without time zone in ISO text form, like
+     *      "2015-03-29 02:30:00.5", with infinity as LocalDateTime.MAX and
+     *      -infinity as LocalDateTime.MIN, the values the PostgreSQL driver
+     *      uses for them too.
+     */
+    private static LocalDateTime
+    parseTimestamp(String value)
+    {
+        if (value.equals("infinity")) {
+            return LocalDateTime.MAX;
+        }
+        if (value.equals("-infinity")) {
+            return LocalDateTime.MIN;
+        }
+        return LocalDateTime.parse(value.trim().replace(' ', 'T'));
+    }
+
+    /*
+     * epochMicros
+     *      Returns a LocalDateTime as microseconds since 1970-01-01, with
+     *      the infinities as Long.MIN_VALUE and Long.MAX_VALUE, which are
+     *      PostgreSQL's DT_NOBEGIN and DT_NOEND.
+     */
+    private static long
+    epochMicros(LocalDateTime local)
+    {
+        if (local.equals(LocalDateTime.MIN)) {
+            return Long.MIN_VALUE;
+        }
+        if (local.equals(LocalDateTime.MAX)) {
+            return Long.MAX_VALUE;
+        }
+        return local.toEpochSecond(ZoneOffset.UTC) * 1000000L + local.getNano() / 1000;
+    }
+
+    /*
+     * epochDays
+     *      Returns a LocalDate as days since 1970-01-01, with the infinities
+     *      as Integer.MIN_VALUE and Integer.MAX_VALUE, which are PostgreSQL's
+     *      DATEVAL_NOBEGIN and DATEVAL_NOEND. A date beyond the range of an
+     *      int is an error.
+     */
+    private static int
+    epochDays(LocalDate date) throws SQLException
+    {
+        long days;
+
+        if (date.equals(LocalDate.MIN)) {
+            return Integer.MIN_VALUE;
+        }
+        if (date.equals(LocalDate.MAX)) {
+            return Integer.MAX_VALUE;
+        }
+        days = date.toEpochDay();
+        if (days <= Integer.MIN_VALUE || days >= Integer.MAX_VALUE) {
+            throw new SQLException("Date " + date + " is out of range");
+        }
+        return (int) days;
+    }
+
+    private static int
+    sqlTypeOf(int typeCode)
+    {
+        switch (typeCode) {
+            case TYPE_SHORT:        return Types.SMALLINT;
+            case TYPE_INT:          return Types.INTEGER;
+            case TYPE_LONG:         return Types.BIGINT;
+            case TYPE_FLOAT:        return Types.REAL;
+            case TYPE_DOUBLE:       return Types.DOUBLE;
+            case TYPE_BOOLEAN:      return Types.BOOLEAN;
+            case TYPE_DATE:         return Types.DATE;
+            case TYPE_TIMESTAMP:    return Types.TIMESTAMP;
+            case TYPE_NUMERIC:      return Types.NUMERIC;
+            case TYPE_STRING:       return Types.VARCHAR;
+            default:                return Types.OTHER;
+        }
+    }
+
+    /*
+     * addBatch
+     *      Bind values, like executePrepared, to the parameters of a prepared
+     *      statement and add them to its batch, to be sent by executeBatch.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    addBatch(String name, String[] values) throws IOException
+    {
+        try {
+            Prepared prepared = preparedStatements.get(name);
+            int i;
+
+            if(prepared == null){
+                throw new Exception("Prepared statement \"" + name + "\" does not exist");
+            }
+            for (i = 0; i < values.length; i++) {
+                bindParameter(prepared.statement, i + 1, prepared.typeCodes[i], values[i]);
+            }
+            prepared.statement.addBatch();
+        } catch (Exception e) {
+            return stackTrace(e);
         }
         return null;
     }
 
     /*
-     * returnResultSet
-     *      Returns the result set that is returned from the foreign database
-     *      after execution of the query to C code. One row is returned at a time
-     *      as a String array. After last row null is returned.
+     * executeBatch
+     *      Execute the batch of a prepared statement in one round trip, and
+     *      leave the total number of rows affected in updateCount, or -1
+     *      if the driver can't tell the count of some command. A command the driver reports as failed, rather
+     *      than throwing a BatchUpdateException, fails the whole batch.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
      */
-    public String[] 
-    returnResultSet()
+    public synchronized String
+    executeBatch(String name) throws IOException
     {
-        int i = 0;
         try {
-            /* Row-by-row processing is done in jdbc_fdw.One row
-             * at a time is returned to the C code. */
-            if (resultSet.next()) {
-                for (i = 0; i < numberOfColumns; i++) {
-                    resultRow[i] = resultSet.getString(i+1); // Convert all columns to String
+            Prepared prepared = preparedStatements.get(name);
+            int[] counts;
+            int i;
+
+            if(prepared == null){
+                throw new Exception("Prepared statement \"" + name + "\" does not exist");
+            }
+            returnedRows = null;
+            returnedColumns = 0;
+            updateCount = 0;
+            counts = prepared.statement.executeBatch();
+            for (i = 0; i < counts.length; i++) {
+                if (counts[i] == Statement.EXECUTE_FAILED) {
+                    throw new SQLException("Command " + (i + 1) + " of a batch of " + counts.length + " failed");
+                }
+                if (counts[i] == Statement.SUCCESS_NO_INFO || updateCount < 0) {
+                    updateCount = -1;
+                } else {
+                    updateCount += counts[i];
                 }
-                ++numberOfRows;                         
-                /* The current row in resultSet is returned
-                 * to the C code in a Java String array that
-                 * has the value of the fields of the current
-                 * row as it values. */
-                return (resultRow);
             }
         } catch (Exception e) {
-            e.printStackTrace(); // Best we can do, cannot return exception to caller!
+            return stackTrace(e);
         }
-        /* All of resultSet's rows have been returned to the C code. */
         return null;
     }
 
+    /*
+     * copyIn
+     *      Run a COPY ... FROM STDIN command with the given data, in COPY
+     *      text format, through the CopyManager of the PostgreSQL driver, and
+     *      leave the number of rows copied in updateCount. The driver comes
+     *      from its own class loader, so it is only reached by reflection.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    copyIn(String query, byte[] data) throws IOException
+    {
+        try {
+            Class<?> pgConnectionClass;
+            Class<?> copyManagerClass;
+            Object copyManager;
+
+            try {
+                pgConnectionClass = Class.forName("org.postgresql.PGConnection", true, jdbcDriverLoader);
+                copyManagerClass = Class.forName("org.postgresql.copy.CopyManager", true, jdbcDriverLoader);
+            } catch (ClassNotFoundException e) {
+                throw new Exception("COPY needs the PostgreSQL JDBC driver", e);
+            }
+            if (!conn.isWrapperFor(pgConnectionClass)) {
+                throw new Exception("COPY needs the PostgreSQL JDBC driver");
+            }
+            returnedRows = null;
+            returnedColumns = 0;
+            copyManager = pgConnectionClass.getMethod("getCopyAPI").invoke(conn.unwrap(pgConnectionClass));
+            updateCount = (int) ((Long) copyManagerClass.getMethod("copyIn", String.class, InputStream.class)
+                            .invoke(copyManager, query, new ByteArrayInputStream(data))).longValue();
+        } catch (InvocationTargetException e) {
+            return stackTrace(e.getCause());
+        } catch (Exception e) {
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * deallocate
+     *      Release the prepared statement of the given name. It is kept in
+     *      the statement cache, in case the same query is prepared again.
+     *      A batch that was never executed is dropped.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    deallocate(String name)
+    {
+        try {
+            Prepared prepared = preparedStatements.remove(name);
+            if (prepared != null) {
+                prepared.statement.clearBatch();
+                releaseStatement(prepared.query, prepared.statement);
+            }
+        } catch (Exception e) {
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * openCursor
+     *      Register the result set of a statement as cursor cursorId.
+     */
+    private Cursor
+    openCursor(int cursorId, ResultSet resultSet, int fetchSize) throws SQLException
+    {
+        Cursor cursor = new Cursor(resultSet, fetchSize);
+
+        cursors.put(cursorId, cursor);
+        return cursor;
+    }
+
+    /*
+     * cursorColumns
+     *      Returns the number of columns of cursor cursorId, 0 if there is
+     *      no such cursor.
+     */
+    public int
+    cursorColumns(int cursorId)
+    {
+        Cursor cursor = cursors.get(cursorId);
+
+        return (cursor == null) ? 0 : cursor.numberOfColumns;
+    }
+
+    /*
+     * Batch
+     *      Rows read from the result set by one call of readBatch. data is a
+     *      String array of numberOfColumns cells per row in text form, or
+     *      the columnar array described at returnResultSetTyped. bytes is a
+     *      rough estimate of the heap used, for the prefetch limit, and last
+     *      is set when the result set has no rows left after this batch.
+     */
+    static class Batch
+    {
+        Object  data;
+        int     capacity;
+        int     rows;
+        long    bytes;
+        boolean last;
+    }
+
+    /*
+     * returnResultSetBatch
+     *      Returns up to maxRows rows of cursor cursorId in one call, so the
+     *      C code crosses the JNI boundary once per batch instead of once
+     *      per row. The rows are flattened into a single String array of
+     *      numberOfColumns elements per row. lastBatch tells whether the
+     *      result set is exhausted, after the last row null is returned.
+     */
+    public String[]
+    returnResultSetBatch(int cursorId, int maxRows)
+    {
+        Cursor cursor = cursors.get(cursorId);
+        Batch batch = nextBatch(cursor, maxRows, null);
+
+        if (batch == null || batch.rows == 0) {
+            /* All of resultSet's rows have been returned to the C code. */
+            return null;
+        }
+        if (batch.rows < batch.capacity) {
+            return Arrays.copyOf((String[]) batch.data, batch.rows * cursor.numberOfColumns);
+        }
+        return (String[]) batch.data;
+    }
+
+    /*
+     * returnResultSetTyped
+     *      Returns up to maxRows rows of cursor cursorId in columnar form,
+     *      reading each column with the getter for its type code instead of
+     *      converting it to a String. Element 2*i of the returned array holds
+     *      the values of column i as a primitive array (a String array for
+     *      TYPE_STRING) and element 2*i+1 a boolean array of null flags.
+     *      Dates are returned as days and timestamps as microseconds since
+     *      1970-01-01, see epochDays and epochMicros. The number of rows in the batch is left in
+     *      numberOfBatchRows, after the last row null is returned.
+     */
+    public Object[]
+    returnResultSetTyped(int cursorId, int maxRows, int[] typeCodes)
+    {
+        return typedBatch(cursors.get(cursorId), maxRows, typeCodes);
+    }
+
+    private Object[]
+    typedBatch(Cursor cursor, int maxRows, int[] typeCodes)
+    {
+        Batch batch = nextBatch(cursor, maxRows, typeCodes);
+
+        numberOfBatchRows = (batch == null) ? 0 : batch.rows;
+        if (numberOfBatchRows == 0) {
+            /* All of resultSet's rows have been returned to the C code. */
+            return null;
+        }
+        return (Object[]) batch.data;
+    }
+
+    /*
+     * returnResultSetBuffer
+     *      Returns up to maxRows rows of cursor cursorId serialized into a
+     *      direct ByteBuffer, see Cursor.writeBuffer. After the last row
+     *      null is returned.
+     */
+    public ByteBuffer
+    returnResultSetBuffer(int cursorId, int maxRows, int[] typeCodes)
+    {
+        Cursor cursor = cursors.get(cursorId);
+        Object[] batch = typedBatch(cursor, maxRows, typeCodes);
+
+        if (batch == null) {
+            return null;
+        }
+        return cursor.writeBuffer(batch, numberOfBatchRows, typeCodes);
+    }
+
+    /*
+     * nextBatch
+     *      Returns the next batch of cursor, null if there is no such
+     *      cursor or reading failed. Sets lastBatch when no rows are
+     *      left after the returned batch. The stack trace of a failure is
+     *      left in batchError, where the C code picks it up, as the batch
+     *      getters cannot return it. Errors are caught as well, nothing may
+     *      be thrown back into JNI.
+     */
+    private Batch
+    nextBatch(Cursor cursor, int maxRows, int[] typeCodes)
+    {
+        Batch batch;
+
+        lastBatch = true;
+        batchError = null;
+        if (cursor == null) {
+            return null;
+        }
+        try {
+            batch = cursor.nextBatch(maxRows, typeCodes);
+        } catch (Throwable e) {
+            batchError = stackTrace(e);
+            return null;
+        }
+        lastBatch = (batch == null || batch.last);
+        return batch;
+    }
+
+    private static int
+    align8(int size)
+    {
+        return (size + 7) & ~7;
+    }
+
+    /*
+     * grownCapacity
+     *      Returns the new number of rows of a full batch, doubled but no
+     *      more than maxRows.
+     */
+    private static int
+    grownCapacity(int capacity, int maxRows)
+    {
+        return (int) Math.min(Math.max(2L * capacity, 1), maxRows);
+    }
+
+    /*
+     * copyOfArray
+     *      Returns a copy of a primitive or String array with room for
+     *      length elements.
+     */
+    private static Object
+    copyOfArray(Object array, int length)
+    {
+        Object copy = java.lang.reflect.Array.newInstance(array.getClass().getComponentType(), length);
+
+        System.arraycopy(array, 0, copy, 0, Math.min(java.lang.reflect.Array.getLength(array), length));
+        return copy;
+    }
+
+    /*
+     * newTypedColumn
+     *      Allocates the array holding one column of a typed batch.
+     */
+    private static Object
+    newTypedColumn(int typeCode, int maxRows)
+    {
+        switch (typeCode) {
+            case TYPE_SHORT:
+                return new short[maxRows];
+            case TYPE_INT:
+            case TYPE_DATE:
+                return new int[maxRows];
+            case TYPE_LONG:
+            case TYPE_TIMESTAMP:
+                return new long[maxRows];
+            case TYPE_FLOAT:
+                return new float[maxRows];
+            case TYPE_DOUBLE:
+                return new double[maxRows];
+            case TYPE_BOOLEAN:
+                return new boolean[maxRows];
+            default:
+                return new String[maxRows];
+        }
+    }
+
+    /*
+     * Cursor
+     *      An open result set and the state of reading it in batches. The
+     *      C code opens one for each foreign scan, identified by its cursor
+     *      number, so several scans can run over the same connection at
+     *      once. stmt is only set when the cursor owns the statement, a
+     *      result set of a named prepared statement leaves it open.
+     */
+    class Cursor
+    {
+        Statement           stmt;
+        String              stmtQuery;
+        ResultSet           resultSet;
+        int                 numberOfColumns;
+        int                 resultSetFetchSize;
+        Batch               currentBatch;
+        JDBCPrefetcher      prefetcher;
+        ByteBuffer          batchBuffer;
+        byte[][]            batchStrings;
+        int[][]             batchOffsets;
+        boolean             textTimestamps;
+        boolean             textDates;
+
+        Cursor(ResultSet resultSet, int fetchSize) throws SQLException
+        {
+            this.resultSet = resultSet;
+            numberOfColumns = resultSet.getMetaData().getColumnCount();
+            resultSetFetchSize = fetchSize;
+        }
+
+        /*
+         * nextBatch
+         *      Returns the next batch of the result set, in text form when
+         *      typeCodes is null. Without prefetching the batch is read right
+         *      away into arrays reused from the previous call, otherwise it is
+         *      taken from the prefetch thread, which is started on first use.
+         *      A prefetched batch may have been read with an earlier maxRows.
+         */
+        Batch
+        nextBatch(int maxRows, int[] typeCodes) throws Exception
+        {
+            if (prefetchBatches <= 0) {
+                return currentBatch = readBatch(maxRows, typeCodes, currentBatch);
+            }
+            if (prefetcher == null) {
+                prefetcher = new JDBCPrefetcher(this, maxRows, typeCodes, prefetchBatches, prefetchBytes);
+            }
+            return prefetcher.take(maxRows);
+        }
+
+        /*
+         * readBatch
+         *      Reads up to maxRows rows of the result set. The arrays of reuse
+         *      are filled again if it has the same shape, otherwise new ones are
+         *      allocated. They start out small and grow as rows arrive, so a
+         *      large maxRows costs nothing unless the rows are really there.
+         *      Called by the prefetch thread when there is one, so the rows
+         *      are read holding the connection lock.
+         */
+        Batch
+        readBatch(int maxRows, int[] typeCodes, Batch reuse) throws SQLException
+        {
+            synchronized (JDBCUtils.this) {
+                return fillBatch(maxRows, typeCodes, reuse);
+            }
+        }
+
+        private Batch
+        fillBatch(int maxRows, int[] typeCodes, Batch reuse) throws SQLException
+        {
+            Batch batch = (reuse != null) ? reuse : new Batch();
+            int i;
+
+            if (maxRows != resultSetFetchSize) {
+                /* Keep the driver's round trips in line with the batch size */
+                try {
+                    resultSet.setFetchSize(maxRows);
+                } catch (SQLException e) {
+                    /* Only a hint, some drivers refuse to change it */
+                }
+                resultSetFetchSize = maxRows;
+            }
+            batch.rows = 0;
+            batch.bytes = 0;
+            if (typeCodes == null) {
+                String[] cells;
+                int cell = 0;
+
+                if (!(batch.data instanceof String[])) {
+                    batch.capacity = Math.min(maxRows, INITIAL_BATCH_ROWS);
+                    batch.data = new String[cellCount(batch.capacity)];
+                }
+                cells = (String[]) batch.data;
+                while (batch.rows < maxRows && resultSet.next()) {
+                    if (batch.rows == batch.capacity) {
+                        batch.capacity = grownCapacity(batch.capacity, maxRows);
+                        batch.data = cells = Arrays.copyOf(cells, cellCount(batch.capacity));
+                    }
+                    for (i = 0; i < numberOfColumns; i++, cell++) {
+                        cells[cell] = resultSet.getString(i+1); // Convert all columns to String
+                        batch.bytes += (cells[cell] == null) ? 8 : 40 + 2 * cells[cell].length();
+                    }
+                    ++batch.rows;
+                }
+            } else {
+                Object[] columns;
+
+                if (!(batch.data instanceof Object[])) {
+                    batch.capacity = Math.min(maxRows, INITIAL_BATCH_ROWS);
+                    batch.data = new Object[2 * numberOfColumns];
+                    for (i = 0; i < numberOfColumns; i++) {
+                        ((Object[]) batch.data)[2*i] = newTypedColumn(typeCodes[i], batch.capacity);
+                        ((Object[]) batch.data)[2*i+1] = new boolean[batch.capacity];
+                    }
+                }
+                columns = (Object[]) batch.data;
+                while (batch.rows < maxRows && resultSet.next()) {
+                    if (batch.rows == batch.capacity) {
+                        batch.capacity = grownCapacity(batch.capacity, maxRows);
+                        for (i = 0; i < 2 * numberOfColumns; i++) {
+                            columns[i] = copyOfArray(columns[i], batch.capacity);
+                        }
+                    }
+                    for (i = 0; i < numberOfColumns; i++) {
+                        ((boolean[]) columns[2*i+1])[batch.rows] =
+                            readTypedColumn(i + 1, typeCodes[i], columns[2*i], batch.rows);
+                        if (typeCodes[i] == TYPE_STRING) {
+                            String value = ((String[]) columns[2*i])[batch.rows];
+                            batch.bytes += (value == null) ? 8 : 40 + 2 * value.length();
+                        } else {
+                            batch.bytes += 9;
+                        }
+                    }
+                    ++batch.rows;
+                }
+            }
+            batch.last = (batch.rows < maxRows);
+            return batch;
+        }
+
+        /*
+         * cellCount
+         *      Returns the size of a text batch array for the given number
+         *      of rows, failing rather than letting the product overflow.
+         */
+        private int
+        cellCount(int rows) throws SQLException
+        {
+            long cells = (long) rows * numberOfColumns;
+
+            if (cells > Integer.MAX_VALUE - 8) {
+                throw new SQLException("A batch of " + rows + " rows of " + numberOfColumns +
+                                       " columns is too large");
+            }
+            return (int) cells;
+        }
+
+        /*
+         * writeBuffer
+         *      Returns the rows of a typed batch serialized into a direct
+         *      ByteBuffer in native byte order, which the C code reads in
+         *      place. The buffer is reused from batch to batch and only
+         *      replaced when a batch does not fit. The layout, with every
+         *      section aligned to 8 bytes, is:
+         *          header: int32 number of rows, int32 number of columns and an
+         *                  int32 offset of each column section
+         *          column: a validity bitmap with bit (row % 8) of byte (row / 8)
+         *                  set for non null values, followed by either one 8-byte
+         *                  slot per row (int64, or float64 for TYPE_FLOAT and
+         *                  TYPE_DOUBLE) or, for TYPE_STRING, rows + 1 int32
+         *                  offsets and the UTF-8 bytes of the values
+         *      Called with the columns of a batch read by nextBatch.
+         */
+        ByteBuffer
+        writeBuffer(Object[] batch, int rows, int[] typeCodes)
+        {
+            int size;
+            int i;
+            int row;
+
+            if (batchStrings == null || batchStrings.length != numberOfColumns) {
+                batchStrings = new byte[numberOfColumns][];
+                batchOffsets = new int[numberOfColumns][];
+            }
+
+            /* Encode the strings first, the buffer size depends on them */
+            size = align8(4 * (2 + numberOfColumns));
+            for (i = 0; i < numberOfColumns; i++) {
+                size += align8((rows + 7) / 8);
+                if (typeCodes[i] == TYPE_STRING) {
+                    encodeStrings(i, (String[]) batch[2*i], rows);
+                    size += align8(4 * (rows + 1) + batchOffsets[i][rows]);
+                } else {
+                    size += 8 * rows;
+                }
+            }
+            if (batchBuffer == null || batchBuffer.capacity() < size) {
+                int capacity = (batchBuffer == null) ? size : Math.max(size, 2 * batchBuffer.capacity());
+                batchBuffer = ByteBuffer.allocateDirect(capacity).order(ByteOrder.nativeOrder());
+            }
+
+            batchBuffer.clear();
+            batchBuffer.putInt(rows);
+            batchBuffer.putInt(numberOfColumns);
+            batchBuffer.position(align8(4 * (2 + numberOfColumns)));
+            for (i = 0; i < numberOfColumns; i++) {
+                boolean[] isnull = (boolean[]) batch[2*i+1];
+                int start;
+
+                batchBuffer.putInt(4 * (2 + i), batchBuffer.position());
+                start = batchBuffer.position();
+                for (row = 0; row < rows; row += 8) {
+                    int bits = 0;
+                    int bit;
+                    for (bit = 0; bit < 8 && row + bit < rows; bit++) {
+                        if (!isnull[row + bit]) {
+                            bits |= (1 << bit);
+                        }
+                    }
+                    batchBuffer.put((byte) bits);
+                }
+                batchBuffer.position(start + align8((rows + 7) / 8));
+                writeBufferColumn(i, typeCodes[i], batch[2*i], rows);
+                batchBuffer.position(align8(batchBuffer.position()));
+            }
+            return batchBuffer;
+        }
+
+        /*
+         * writeBufferColumn
+         *      Writes the values of one column of a batch at the current
+         *      position of batchBuffer, see writeBuffer.
+         */
+        private void
+        writeBufferColumn(int columnNumber, int typeCode, Object column, int rows)
+        {
+            int row;
+
+            switch (typeCode) {
+                case TYPE_SHORT:
+                    for (row = 0; row < rows; row++)
+                        batchBuffer.putLong(((short[]) column)[row]);
+                    break;
+                case TYPE_INT:
+                case TYPE_DATE:
+                    for (row = 0; row < rows; row++)
+                        batchBuffer.putLong(((int[]) column)[row]);
+                    break;
+                case TYPE_LONG:
+                case TYPE_TIMESTAMP:
+                    for (row = 0; row < rows; row++)
+                        batchBuffer.putLong(((long[]) column)[row]);
+                    break;
+                case TYPE_FLOAT:
+                    for (row = 0; row < rows; row++)
+                        batchBuffer.putDouble(((float[]) column)[row]);
+                    break;
+                case TYPE_DOUBLE:
+                    for (row = 0; row < rows; row++)
+                        batchBuffer.putDouble(((double[]) column)[row]);
+                    break;
+                case TYPE_BOOLEAN:
+                    for (row = 0; row < rows; row++)
+                        batchBuffer.putLong(((boolean[]) column)[row] ? 1 : 0);
+                    break;
+                default:
+                    for (row = 0; row <= rows; row++)
+                        batchBuffer.putInt(batchOffsets[columnNumber][row]);
+                    batchBuffer.put(batchStrings[columnNumber], 0, batchOffsets[columnNumber][rows]);
+                    break;
+            }
+        }
+
+        /*
+         * encodeStrings
+         *      Converts one String column of a batch to UTF-8, concatenated in
+         *      batchStrings with the start of each value in batchOffsets.
+         */
+        private void
+        encodeStrings(int columnNumber, String[] values, int rows)
+        {
+            byte[][] encoded = new byte[rows][];
+            int[] offsets = new int[rows + 1];
+            byte[] data;
+            int row;
+
+            for (row = 0; row < rows; row++) {
+                encoded[row] = (values[row] == null) ? null : values[row].getBytes(StandardCharsets.UTF_8);
+                offsets[row + 1] = offsets[row] + ((encoded[row] == null) ? 0 : encoded[row].length);
+            }
+            data = new byte[offsets[rows]];
+            for (row = 0; row < rows; row++) {
+                if (encoded[row] != null) {
+                    System.arraycopy(encoded[row], 0, data, offsets[row], encoded[row].length);
+                }
+            }
+            batchStrings[columnNumber] = data;
+            batchOffsets[columnNumber] = offsets;
+        }
+
+        /*
+         * readTypedColumn
+         *      Reads column columnIndex of the current row into slot row of
+         *      column. Returns true if the value was SQL NULL.
+         */
+        private boolean
+        readTypedColumn(int columnIndex, int typeCode, Object column, int row) throws SQLException
+        {
+            switch (typeCode) {
+                case TYPE_SHORT:
+                    ((short[]) column)[row] = resultSet.getShort(columnIndex);
+                    break;
+                case TYPE_INT:
+                    ((int[]) column)[row] = resultSet.getInt(columnIndex);
+                    break;
+                case TYPE_LONG:
+                    ((long[]) column)[row] = resultSet.getLong(columnIndex);
+                    break;
+                case TYPE_FLOAT:
+                    ((float[]) column)[row] = resultSet.getFloat(columnIndex);
+                    break;
+                case TYPE_DOUBLE:
+                    ((double[]) column)[row] = resultSet.getDouble(columnIndex);
+                    break;
+                case TYPE_BOOLEAN:
+                    ((boolean[]) column)[row] = resultSet.getBoolean(columnIndex);
+                    break;
+                case TYPE_DATE: {
+                    LocalDate date = readDate(columnIndex);
+                    if (date == null) {
+                        return true;
+                    }
+                    ((int[]) column)[row] = epochDays(date);
+                    return false;
+                }
+                case TYPE_TIMESTAMP: {
+                    LocalDateTime local = readTimestamp(columnIndex);
+                    if (local == null) {
+                        return true;
+                    }
+                    ((long[]) column)[row] = epochMicros(local);
+                    return false;
+                }
+                default:
+                    ((String[]) column)[row] = resultSet.getString(columnIndex);
+                    break;
+            }
+            return resultSet.wasNull();
+        }
+
+        /*
+         * readTimestamp
+         *      Reads a timestamp column of the current row as a LocalDateTime,
+         *      so it never passes through the JVM time zone, where a time in
+         *      a daylight saving gap would move. A driver that can't return
+         *      one, being older than JDBC 4.2, is read in text form instead.
+         */
+        private LocalDateTime
+        readTimestamp(int columnIndex) throws SQLException
+        {
+            String text;
+
+            if (!textTimestamps) {
+                try {
+                    return resultSet.getObject(columnIndex, LocalDateTime.class);
+                } catch (SQLException | AbstractMethodError e) {
+                    textTimestamps = true;
+                }
+            }
+            text = resultSet.getString(columnIndex);
+            return (text == null) ? null : parseTimestamp(text);
+        }
+
+        /*
+         * readDate
+         *      Reads a date column of the current row as a LocalDate, like
+         *      readTimestamp. The infinities come as LocalDate.MAX and
+         *      LocalDate.MIN, rather than the sentinel dates a java.sql.Date
+         *      holds for them. A driver older than JDBC 4.2 is read through
+         *      getDate, after checking the text form for infinity.
+         */
+        private LocalDate
+        readDate(int columnIndex) throws SQLException
+        {
+            java.sql.Date date;
+            String text;
+
+            if (!textDates) {
+                try {
+                    return resultSet.getObject(columnIndex, LocalDate.class);
+                } catch (SQLException | AbstractMethodError e) {
+                    textDates = true;
+                }
+            }
+            text = resultSet.getString(columnIndex);
+            if (text == null) {
+                return null;
+            }
+            if (text.equals("infinity")) {
+                return LocalDate.MAX;
+            }
+            if (text.equals("-infinity")) {
+                return LocalDate.MIN;
+            }
+            date = resultSet.getDate(columnIndex);
+            return (date == null) ? null : date.toLocalDate();
+        }
+
+        /*
+         * cancel
+         *      Cancels the statement of the result set, as far as the driver
+         *      can, while another thread is reading from it.
+         */
+        void
+        cancel()
+        {
+            try {
+                Statement statement = (stmt != null) ? stmt : resultSet.getStatement();
+                if (statement != null) {
+                    statement.cancel();
+                }
+            } catch (SQLException e) {
+                /* Only a hint, the reading thread is waited for anyway */
+            }
+        }
+
+        /*
+         * close
+         *      Stops the prefetch thread and closes the result set, and the
+         *      statement if the cursor owns it. The thread is stopped before
+         *      taking the connection lock, which it may be waiting for.
+         */
+        void
+        close() throws Exception
+        {
+            if (prefetcher != null) {
+                prefetcher.stop();
+                prefetcher = null;
+            }
+            synchronized (JDBCUtils.this) {
+                if (resultSet != null) {
+                    resultSet.close();
+                    resultSet = null;
+                }
+                if (stmt != null) {
+                    if (stmtQuery != null) {
+                        releaseStatement(stmtQuery, (PreparedStatement) stmt);
+                    } else {
+                        stmt.close();
+                    }
+                    stmt = null;
+                }
+            }
+        }
+    }
+
+    /*
+     * stackTrace
+     *      Returns the stack trace of e as a String, for the C code to
+     *      report. The writer is shared, so it is emptied first, otherwise
+     *      every error would repeat the ones before it.
+     */
+    private String
+    stackTrace(Throwable e)
+    {
+        exceptionStringWriter.getBuffer().setLength(0);
+        e.printStackTrace(exceptionPrintWriter);
+        exceptionPrintWriter.flush();
+        return exceptionStringWriter.toString();
+    }
+
     /*
      * closeStatement
-     *      Releases the resources used by statement. Keeps the connection
-     *      open for another statement to be executed.             
+     *      Closes cursor cursorId, keeping the connection and any other
+     *      cursors open.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
      */
-    public String 
-    closeStatement()
+    public String
+    closeStatement(int cursorId)
+    {
+        try {
+            Cursor cursor = cursors.remove(cursorId);
+            if (cursor != null) {
+                cursor.close();
+            }
+        } catch (Exception e) {
+            /* If an exception occurs,it is returned back to the
+             * calling C code by returning a Java String object
+             * that has the exception's stack trace.
+             * If all goes well,a null String is returned. */
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * closeAllStatements
+     *      Closes every open cursor.
+     */
+    private String
+    closeAllStatements()
+    {
+        String result = null;
+
+        for (Integer cursorId : new ArrayList<Integer>(cursors.keySet())) {
+            String error = closeStatement(cursorId);
+            if (result == null) {
+                result = error;
+            }
+        }
+        return result;
+    }
+
+    /*
+     * beginTransaction
+     *      Turns auto-commit off, so that the statements up to the next
+     *      endTransaction run in one remote transaction. Besides giving all
+     *      scans of a query one snapshot, this lets drivers such as the
+     *      PostgreSQL one read a result set fetchSize rows at a time rather
+     *      than all at once. The isolation level is SERIALIZABLE if
+     *      serializable is true and REPEATABLE READ otherwise, or
+     *      SERIALIZABLE when the remote database has no REPEATABLE READ. A
+     *      database supporting neither keeps its default level.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    beginTransaction(boolean serializable)
+    {
+        try {
+            DatabaseMetaData dbMetadata;
+            int level;
+
+            if(conn == null){
+                throw new Exception("Must create connection before beginning a transaction");
+            }
+            dbMetadata = conn.getMetaData();
+            if (!dbMetadata.supportsTransactions()) {
+                return null;
+            }
+            level = serializable ? Connection.TRANSACTION_SERIALIZABLE : Connection.TRANSACTION_REPEATABLE_READ;
+            if (!dbMetadata.supportsTransactionIsolationLevel(level)) {
+                level = Connection.TRANSACTION_SERIALIZABLE;
+            }
+            /* The level stays set between transactions, so only change it when needed */
+            if (level != isolationLevel && dbMetadata.supportsTransactionIsolationLevel(level)) {
+                conn.setTransactionIsolation(level);
+                isolationLevel = level;
+            }
+            conn.setAutoCommit(false);
+        } catch (Exception e) {
+            /* If an exception occurs,it is returned back to the
+             * calling C code by returning a Java String object
+             * that has the exception's stack trace.
+             * If all goes well,a null String is returned. */
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * endTransaction
+     *      Commits the remote transaction if commit is true and rolls it
+     *      back otherwise, then turns auto-commit back on. A rollback first
+     *      closes the cursors left open by the aborted queries.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public String
+    endTransaction(boolean commit)
     {
         try {
-            if(resultSet != null){
-                resultSet.close();
-                resultSet = null;
+            if (!commit) {
+                /* Stops the prefetch threads, so must not hold the lock */
+                closeAllStatements();
             }
-            if(stmt != null){
-                stmt.close();
-                stmt = null;
+            synchronized (this) {
+                if(conn == null || conn.getAutoCommit()){
+                    return null;
+                }
+                savepoints.clear();
+                if (commit) {
+                    conn.commit();
+                } else {
+                    conn.rollback();
+                }
+                conn.setAutoCommit(true);
             }
-            resultRow = null;
         } catch (Exception e) {
             /* If an exception occurs,it is returned back to the
              * calling C code by returning a Java String object
              * that has the exception's stack trace.
              * If all goes well,a null String is returned. */
-            e.printStackTrace(exceptionPrintWriter);
-            return (new String(exceptionStringWriter.toString()));
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * setSavepoint
+     *      Sets the savepoint of subtransaction level, which endSavepoint
+     *      releases or rolls back to.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    setSavepoint(int level)
+    {
+        try {
+            if(conn == null || conn.getAutoCommit()){
+                throw new Exception("Cannot set a savepoint outside of a transaction");
+            }
+            savepoints.put(level, conn.setSavepoint("s" + level));
+        } catch (Exception e) {
+            /* If an exception occurs,it is returned back to the
+             * calling C code by returning a Java String object
+             * that has the exception's stack trace.
+             * If all goes well,a null String is returned. */
+            return stackTrace(e);
+        }
+        return null;
+    }
+
+    /*
+     * endSavepoint
+     *      Releases the savepoint of subtransaction level, after rolling
+     *      back to it unless commit is true. Drivers that cannot release a
+     *      savepoint keep it until the transaction ends.
+     *      Returns:
+     *          null on success
+     *          otherwise a string containing a stack trace
+     */
+    public synchronized String
+    endSavepoint(int level, boolean commit)
+    {
+        try {
+            Savepoint savepoint = savepoints.remove(level);
+
+            if(savepoint == null){
+                throw new Exception("Savepoint s" + level + " is not set");
+            }
+            if (!commit) {
+                conn.rollback(savepoint);
+            }
+            try {
+                conn.releaseSavepoint(savepoint);
+            } catch (SQLFeatureNotSupportedException e) {
+                /* Oracle has no RELEASE SAVEPOINT */
+            }
+        } catch (Exception e) {
+            /* If an exception occurs,it is returned back to the
+             * calling C code by returning a Java String object
+             * that has the exception's stack trace.
+             * If all goes well,a null String is returned. */
+            return stackTrace(e);
         }
         return null;
     }
@@ -195,19 +1540,30 @@ public class JDBCUtils
     public String 
     closeConnection()
     {
-        closeStatement(); // For good measure
+        closeAllStatements(); // For good measure
         try {
-            if(conn != null){
-                conn.close();
-                conn = null;
+            synchronized (this) {
+                for (Prepared prepared : preparedStatements.values()) {
+                    prepared.statement.close();
+                }
+                preparedStatements.clear();
+                if (statementCache != null) {
+                    for (PreparedStatement ps : statementCache.values()) {
+                        ps.close();
+                    }
+                    statementCache.clear();
+                }
+                if(conn != null){
+                    conn.close();
+                    conn = null;
+                }
             }
         } catch (Exception e) {
             /* If an exception occurs,it is returned back to the
              * calling C code by returning a Java String object
              * that has the exception's stack trace.
              * If all goes well,a null String is returned. */
-            e.printStackTrace(exceptionPrintWriter);
-            return (new String(exceptionStringWriter.toString()));
+            return stackTrace(e);
         }
         return null;
     }
@@ -223,15 +1579,6 @@ public class JDBCUtils
     public String 
     cancel()
     {
-        return closeStatement();
-    }
-
-    /*
-     * getNumberOfColumns: A simple getter for the field numberOfColumns
-     */
-    public int 
-    getNumberOfColumns()
-    {
-        return numberOfColumns;
+        return closeAllStatements();
     }
 }
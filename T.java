@@ -12,8 +12,13 @@ public class T
         "datawarehouse", // username
         "S2mpleS2mple", // password
         "15", // querytimeout (seconds)
-        "/usr/local/jars/postgresql-9.4-1201.jdbc41.jar" // jarfile
+        "/usr/local/jars/postgresql-9.4-1201.jdbc41.jar", // jarfile
+        "0", // prefetch_batches
+        "67108864", // prefetch_bytes
+        "100" // statement_cache_size
     };
+    private static final int cursor = 1;
+    private static final int fetchSize = 100;
     private JDBCUtils jdbcUtils;
 
     // Public constructor
@@ -26,23 +31,26 @@ public class T
         return jdbcUtils.createConnection(a);
     }
 
-    // Create statement
+    // Create statement, its result set is read as cursor 1
     private String createStatement(String query) throws IOException{
-        return jdbcUtils.createStatement(query);
+        return jdbcUtils.createStatement(cursor, query, fetchSize);
     }
 
     private void iterate(){
+        int columns = jdbcUtils.cursorColumns(cursor);
         String res[];
-        while((res = jdbcUtils.returnResultSet()) != null){
+        while((res = jdbcUtils.returnResultSetBatch(cursor, fetchSize)) != null){
             for(int i=0; i < res.length; i++){
                 System.out.print(res[i] + '\t');
+                if((i + 1) % columns == 0){
+                    System.out.println();
+                }
             }
-            System.out.println();
         }
     }
 
     private String closeStatement(){
-        return jdbcUtils.closeStatement();
+        return jdbcUtils.closeStatement(cursor);
     }
 
     private String closeConnection(){
@@ -50,7 +58,7 @@ public class T
     }
 
     private void printNumberOfColumns(){
-        System.out.println("Number of columns: " + jdbcUtils.getNumberOfColumns());
+        System.out.println("Number of columns: " + jdbcUtils.cursorColumns(cursor));
     }
 
     private void report(String s, String operation){
@@ -74,6 +82,7 @@ public class T
         t.report(t.createStatement(query2), "createStatement");
         t.printNumberOfColumns();
         t.iterate();
+        t.report(t.closeStatement(), "closeStatement");
         t.report(t.closeConnection(), "closeConnection");
         t.report(t.createStatement(query2), "createStatement");
         System.exit(0);
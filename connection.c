@@ -67,7 +67,7 @@ static bool xact_got_connection = false;
 /* prototypes of private functions */
 static Jconn *connect_jdbc_server(ForeignServer *server, UserMapping *user);
 static void check_conn_params(const char **keywords, const char **values);
-static void do_sql_command(Jconn *conn, const char *sql);
+static void do_xact_command(Jconn *conn, Jresult *res, const char *sql);
 static void begin_remote_xact(ConnCacheEntry *entry);
 static void pgfdw_xact_callback(XactEvent event, void *arg);
 static void pgfdw_subxact_callback(SubXactEvent event,
@@ -299,13 +299,12 @@ check_conn_params(const char **keywords, const char **values)
 
 
 /*
- * Convenience subroutine to issue a non-data-returning SQL command to remote
+ * Convenience subroutine to check the result of a transaction control call,
+ * sql is the SQL command it stands for
  */
 static void
-do_sql_command(Jconn *conn, const char *sql)
+do_xact_command(Jconn *conn, Jresult *res, const char *sql)
 {
-    Jresult   *res;
-    res = JQexec(conn, sql);
     if (JQresultStatus(res) != PGRES_COMMAND_OK)
         pgfdw_report_error(ERROR, res, conn, true, sql);
     JQclear(res);
@@ -320,14 +319,16 @@ do_sql_command(Jconn *conn, const char *sql)
  * those scans.  A disadvantage is that we can't provide sane emulation of
  * READ COMMITTED behavior --- it would be nice if we had some other way to
  * control which remote queries share a snapshot.
+ *
+ * The transaction is run by turning auto-commit off on the JDBC connection,
+ * which is also what makes drivers like the PostgreSQL one read a result set
+ * fetch_size rows at a time instead of all at once.
  */
 static void
 begin_remote_xact(ConnCacheEntry *entry)
 {
     int         curlevel = GetCurrentTransactionNestLevel();
 
-//TODO: Replace this code with JDBC Connection call
-return;
     /* Start main transaction if we haven't yet */
     if (entry->xact_depth <= 0)
     {
@@ -340,7 +341,10 @@ return;
             sql = "START TRANSACTION ISOLATION LEVEL SERIALIZABLE";
         else
             sql = "START TRANSACTION ISOLATION LEVEL REPEATABLE READ";
-        do_sql_command(entry->conn, sql);
+        do_xact_command(entry->conn,
+                        JQbeginTransaction(entry->conn,
+                                           IsolationIsSerializable()),
+                        sql);
         entry->xact_depth = 1;
     }
 
@@ -354,7 +358,8 @@ return;
         char        sql[64];
 
         snprintf(sql, sizeof(sql), "SAVEPOINT s%d", entry->xact_depth + 1);
-        do_sql_command(entry->conn, sql);
+        do_xact_command(entry->conn,
+                        JQsavepoint(entry->conn, entry->xact_depth + 1), sql);
         entry->xact_depth++;
     }
 }
@@ -503,7 +508,9 @@ pgfdw_xact_callback(XactEvent event, void *arg)
             {
                 case XACT_EVENT_PRE_COMMIT:
                     /* Commit all remote transactions during pre-commit */
-                    do_sql_command(entry->conn, "COMMIT TRANSACTION");
+                    do_xact_command(entry->conn,
+                                    JQendTransaction(entry->conn, true),
+                                    "COMMIT TRANSACTION");
 
                     /*
                      * If there were any errors in subtransactions, and we
@@ -552,7 +559,7 @@ pgfdw_xact_callback(XactEvent event, void *arg)
                     /* Assume we might have lost track of prepared statements */
                     entry->have_error = true;
                     /* If we're aborting, abort all remote transactions too */
-                    res = JQexec(entry->conn, "ABORT TRANSACTION");
+                    res = JQendTransaction(entry->conn, false);
                     /* Note: can't throw ERROR, it would be infinite loop */
                     if (JQresultStatus(res) != PGRES_COMMAND_OK)
                         pgfdw_report_error(WARNING, res, entry->conn, true,
@@ -646,7 +653,8 @@ pgfdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
         {
             /* Commit all remote subtransactions during pre-commit */
             snprintf(sql, sizeof(sql), "RELEASE SAVEPOINT s%d", curlevel);
-            do_sql_command(entry->conn, sql);
+            do_xact_command(entry->conn,
+                            JQendSavepoint(entry->conn, curlevel, true), sql);
         }
         else
         {
@@ -656,7 +664,7 @@ pgfdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
             snprintf(sql, sizeof(sql),
                      "ROLLBACK TO SAVEPOINT s%d; RELEASE SAVEPOINT s%d",
                      curlevel, curlevel);
-            res = JQexec(entry->conn, sql);
+            res = JQendSavepoint(entry->conn, curlevel, false);
             if (JQresultStatus(res) != PGRES_COMMAND_OK)
                 pgfdw_report_error(WARNING, res, entry->conn, true, sql);
             else
@@ -32,10 +32,13 @@
  */
 #include "postgres.h"
 
+#include <ctype.h>
+
 #include "jdbc2_fdw.h"
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/skey.h"
 #include "access/sysattr.h"
 #include "access/transam.h"
 #include "catalog/pg_collation.h"
@@ -44,10 +47,13 @@
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
+#include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/var.h"
+#include "parser/parse_relation.h"
 #include "parser/parsetree.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
@@ -60,6 +66,9 @@ typedef struct foreign_glob_cxt
 {
 	PlannerInfo *root;			/* global planner state */
 	RelOptInfo *foreignrel;		/* the foreign relation we are planning for */
+	const JdbcDialect *dialect; /* SQL dialect of its server */
+	bool		compare_strings;	/* send comparisons of collatable types */
+	struct foreign_loc_cxt *case_arg_cxt;	/* CASE arg, in its WHENs */
 } foreign_glob_cxt;
 
 /*
@@ -88,8 +97,54 @@ typedef struct deparse_expr_cxt
 	RelOptInfo *foreignrel;		/* the foreign relation we are planning for */
 	StringInfo	buf;			/* output buffer to append to */
 	List	  **params_list;	/* exprs that will become remote Params */
+	const JdbcDialect *dialect; /* SQL dialect of the remote server */
+	bool		bind_literals;	/* send Consts as parameters, too */
 } deparse_expr_cxt;
 
+/*
+ * Operators that mean the same in all SQL dialects, and their standard
+ * spelling.  Some only do for numbers, or for character strings.
+ */
+typedef struct PortableOperator
+{
+	const char *oprname;		/* PostgreSQL's name of the operator */
+	const char *sqlname;		/* standard SQL spelling */
+	bool		numeric_only;	/* only for numeric results */
+	bool		string_only;	/* only for a character string operand */
+} PortableOperator;
+
+static const PortableOperator portable_operators[] = {
+	{"=", "=", false, false},
+	{"<>", "<>", false, false},
+	{"<", "<", false, false},
+	{"<=", "<=", false, false},
+	{">", ">", false, false},
+	{">=", ">=", false, false},
+	{"+", "+", true, false},
+	{"-", "-", true, false},
+	{"*", "*", true, false},
+	{"~~", "LIKE", false, true},
+	{"!~~", "NOT LIKE", false, true},
+	{NULL}
+};
+
+/*
+ * A constant array compared by = ANY or <> ALL with at least this many
+ * elements is sent to PostgreSQL as one parameter rather than as a literal.
+ * Other servers get IN lists of at most IN_LIST_CHUNK_SIZE elements each,
+ * the most Oracle accepts.
+ */
+#define ARRAY_PARAM_MIN_ELEMENTS	100
+#define IN_LIST_CHUNK_SIZE			1000
+
+/*
+ * Functions, all in pg_catalog, that every SQL dialect has under the same
+ * name with the same meaning.
+ */
+static const char *const portable_functions[] = {
+	"abs", "lower", "upper", NULL
+};
+
 /*
  * Functions to determine whether an expression can be evaluated safely on
  * remote server.
@@ -98,6 +153,16 @@ static bool foreign_expr_walker(Node *node,
 					foreign_glob_cxt *glob_cxt,
 					foreign_loc_cxt *outer_cxt);
 static bool is_builtin(Oid procid);
+static const char *find_remote_template(Oid classid, Oid objid,
+					 RelOptInfo *foreignrel);
+static bool strings_compare_alike(RelOptInfo *foreignrel);
+static bool is_portable_type(Oid type, const JdbcDialect *dialect);
+static bool is_portable_function(FuncExpr *fe);
+static const PortableOperator *find_portable_operator(Oid opno);
+static bool is_portable_in_list(ScalarArrayOpExpr *oe,
+					 foreign_glob_cxt *glob_cxt,
+					 foreign_loc_cxt *inner_cxt);
+static Expr *find_em_expr_for_rel(EquivalenceClass *ec, RelOptInfo *rel);
 
 /*
  * Functions to construct string representation of a node tree.
@@ -107,19 +172,27 @@ static void deparseTargetList(StringInfo buf,
 				  Index rtindex,
 				  Relation rel,
 				  Bitmapset *attrs_used,
-				  List **retrieved_attrs);
+				  List **retrieved_attrs,
+				  const JdbcDialect *dialect);
 static void deparseReturningList(StringInfo buf, PlannerInfo *root,
 					 Index rtindex, Relation rel,
 					 bool trig_after_row,
 					 List *returningList,
-					 List **retrieved_attrs);
+					 List **retrieved_attrs,
+					 const JdbcDialect *dialect);
 static void deparseColumnRef(StringInfo buf, int varno, int varattno,
-				 PlannerInfo *root);
-static void deparseRelation(StringInfo buf, Relation rel);
-static void deparseStringLiteral(StringInfo buf, const char *val);
+				 PlannerInfo *root, const JdbcDialect *dialect);
+static void deparseRowIdentity(StringInfo buf, Index rtindex,
+				   List *keyAttrs, PlannerInfo *root,
+				   const JdbcDialect *dialect);
+static void deparseRelation(StringInfo buf, Relation rel,
+				const JdbcDialect *dialect);
+static void deparseStringLiteral(StringInfo buf, const char *val,
+					 const JdbcDialect *dialect);
 static void deparseExpr(Expr *expr, deparse_expr_cxt *context);
 static void deparseVar(Var *node, deparse_expr_cxt *context);
 static void deparseConst(Const *node, deparse_expr_cxt *context);
+static bool is_bindable_const(Const *node);
 static void deparseParam(Param *node, deparse_expr_cxt *context);
 static void deparseArrayRef(ArrayRef *node, deparse_expr_cxt *context);
 static void deparseFuncExpr(FuncExpr *node, deparse_expr_cxt *context);
@@ -132,7 +205,21 @@ static void deparseRelabelType(RelabelType *node, deparse_expr_cxt *context);
 static void deparseBoolExpr(BoolExpr *node, deparse_expr_cxt *context);
 static void deparseNullTest(NullTest *node, deparse_expr_cxt *context);
 static void deparseArrayExpr(ArrayExpr *node, deparse_expr_cxt *context);
-static void printRemoteParam(int paramindex, Oid paramtype, int32 paramtypmod,
+static void deparseCaseExpr(CaseExpr *node, deparse_expr_cxt *context);
+static void deparseCoalesceExpr(CoalesceExpr *node,
+					deparse_expr_cxt *context);
+static void deparseNullIfExpr(NullIfExpr *node, deparse_expr_cxt *context);
+static void deparseMinMaxExpr(MinMaxExpr *node, deparse_expr_cxt *context);
+static void deparseRowCompareExpr(RowCompareExpr *node,
+					  deparse_expr_cxt *context);
+static void deparseBooleanTest(BooleanTest *node, deparse_expr_cxt *context);
+static void deparseExprList(List *exprs, deparse_expr_cxt *context);
+static void deparseInList(ScalarArrayOpExpr *node,
+			  deparse_expr_cxt *context);
+static List *in_list_elements(Expr *node);
+static void deparseTemplate(const char *template, List *args,
+				deparse_expr_cxt *context);
+static void printRemoteParam(Oid paramtype, int32 paramtypmod,
 				 deparse_expr_cxt *context);
 static void printRemotePlaceholder(Oid paramtype, int32 paramtypmod,
 					   deparse_expr_cxt *context);
@@ -184,6 +271,9 @@ is_foreign_expr(PlannerInfo *root,
 	 */
 	glob_cxt.root = root;
 	glob_cxt.foreignrel = baserel;
+	glob_cxt.dialect = ((PgFdwRelationInfo *) baserel->fdw_private)->dialect;
+	glob_cxt.compare_strings = strings_compare_alike(baserel);
+	glob_cxt.case_arg_cxt = NULL;
 	loc_cxt.collation = InvalidOid;
 	loc_cxt.state = FDW_COLLATE_NONE;
 	if (!foreign_expr_walker((Node *) expr, &glob_cxt, &loc_cxt))
@@ -218,6 +308,11 @@ is_foreign_expr(PlannerInfo *root,
  * from Vars of the foreign table.  Because of the latter, the logic is
  * pretty close to assign_collations_walker() in parse_collate.c, though we
  * can assume here that the given expression is valid.
+ *
+ * A server that isn't PostgreSQL only gets what is portable SQL: no
+ * PostgreSQL-specific types, operators, functions, casts or arrays.  Nor
+ * does it get comparisons of character strings, unless it is known to
+ * compare them like we do, see strings_compare_alike.
  */
 static bool
 foreign_expr_walker(Node *node,
@@ -243,6 +338,11 @@ foreign_expr_walker(Node *node,
 			{
 				Var		   *var = (Var *) node;
 
+				/* A boolean value is no use where there are no booleans */
+				if (!glob_cxt->dialect->has_boolean &&
+					var->vartype == BOOLOID)
+					return false;
+
 				/*
 				 * If the Var is from the foreign table, we consider its
 				 * collation (if any) safe to use.  If it is from another
@@ -295,6 +395,11 @@ foreign_expr_walker(Node *node,
 					c->constcollid != DEFAULT_COLLATION_OID)
 					return false;
 
+				/* Other servers only get literals of the standard types */
+				if (!glob_cxt->dialect->postgres &&
+					!is_portable_type(c->consttype, glob_cxt->dialect))
+					return false;
+
 				/* Otherwise, we can consider that it doesn't set collation */
 				collation = InvalidOid;
 				state = FDW_COLLATE_NONE;
@@ -311,6 +416,10 @@ foreign_expr_walker(Node *node,
 					p->paramcollid != DEFAULT_COLLATION_OID)
 					return false;
 
+				if (!glob_cxt->dialect->has_boolean &&
+					p->paramtype == BOOLOID)
+					return false;
+
 				collation = InvalidOid;
 				state = FDW_COLLATE_NONE;
 			}
@@ -319,6 +428,10 @@ foreign_expr_walker(Node *node,
 			{
 				ArrayRef   *ar = (ArrayRef *) node;;
 
+				/* Arrays are PostgreSQL's own */
+				if (!glob_cxt->dialect->postgres)
+					return false;
+
 				/* Assignment should not be in restrictions. */
 				if (ar->refassgnexpr != NULL)
 					return false;
@@ -357,11 +470,23 @@ foreign_expr_walker(Node *node,
 				FuncExpr   *fe = (FuncExpr *) node;
 
 				/*
-				 * If function used by the expression is not built-in, it
-				 * can't be sent to remote because it might have incompatible
-				 * semantics on remote side.
+				 * A function mapped to a remote template is sent as that.
+				 * Otherwise, if function used by the expression is not
+				 * built-in, it can't be sent to remote because it might have
+				 * incompatible semantics on remote side.
+				 *
+				 * Other servers don't know PostgreSQL's functions or type
+				 * names, so only a few well-known functions and implicit
+				 * casts, which print as their argument, are sent there.
 				 */
-				if (!is_builtin(fe->funcid))
+				if (fe->funcformat == COERCE_EXPLICIT_CALL &&
+					find_remote_template(ProcedureRelationId, fe->funcid,
+										 glob_cxt->foreignrel) != NULL)
+					 /* OK, mapped */ ;
+				else if (!is_builtin(fe->funcid))
+					return false;
+				else if (!glob_cxt->dialect->postgres &&
+						 !is_portable_function(fe))
 					return false;
 
 				/*
@@ -403,11 +528,29 @@ foreign_expr_walker(Node *node,
 				OpExpr	   *oe = (OpExpr *) node;
 
 				/*
-				 * Similarly, only built-in operators can be sent to remote.
-				 * (If the operator is, surely its underlying function is
-				 * too.)
+				 * Similarly, only mapped or built-in operators can be sent
+				 * to remote.  (If the operator is, surely its underlying
+				 * function is too.)  Other servers understand only the
+				 * standard operators.
 				 */
-				if (!is_builtin(oe->opno))
+				if (IsA(node, DistinctExpr))
+				{
+					if (!is_builtin(oe->opno) ||
+						!glob_cxt->dialect->has_distinct_from)
+						return false;
+					if (oe->inputcollid != InvalidOid &&
+						!glob_cxt->compare_strings)
+						return false;
+				}
+				else if (find_remote_template(OperatorRelationId, oe->opno,
+											  glob_cxt->foreignrel) != NULL)
+					 /* OK, mapped */ ;
+				else if (!is_builtin(oe->opno))
+					return false;
+				else if (!glob_cxt->dialect->postgres &&
+						 (find_portable_operator(oe->opno) == NULL ||
+						  (oe->inputcollid != InvalidOid &&
+						   !glob_cxt->compare_strings)))
 					return false;
 
 				/*
@@ -449,10 +592,16 @@ foreign_expr_walker(Node *node,
 					return false;
 
 				/*
-				 * Recurse to input subexpressions.
+				 * Recurse to input subexpressions.  Other servers only get
+				 * the ones that can be written as an IN list.
 				 */
-				if (!foreign_expr_walker((Node *) oe->args,
-										 glob_cxt, &inner_cxt))
+				if (!glob_cxt->dialect->postgres)
+				{
+					if (!is_portable_in_list(oe, glob_cxt, &inner_cxt))
+						return false;
+				}
+				else if (!foreign_expr_walker((Node *) oe->args,
+											  glob_cxt, &inner_cxt))
 					return false;
 
 				/*
@@ -531,6 +680,10 @@ foreign_expr_walker(Node *node,
 			{
 				ArrayExpr  *a = (ArrayExpr *) node;
 
+				/* Arrays are PostgreSQL's own */
+				if (!glob_cxt->dialect->postgres)
+					return false;
+
 				/*
 				 * Recurse to input subexpressions.
 				 */
@@ -552,6 +705,288 @@ foreign_expr_walker(Node *node,
 					state = FDW_COLLATE_UNSAFE;
 			}
 			break;
+		case T_CaseExpr:
+			{
+				CaseExpr   *ce = (CaseExpr *) node;
+				foreign_loc_cxt arg_cxt;
+				foreign_loc_cxt *save_case_arg_cxt;
+				ListCell   *lc;
+
+				/*
+				 * Recurse to the CASE arg, if any.  Its collation is saved
+				 * aside for the CaseTestExprs within the WHEN clauses.
+				 */
+				arg_cxt.collation = InvalidOid;
+				arg_cxt.state = FDW_COLLATE_NONE;
+				if (!foreign_expr_walker((Node *) ce->arg,
+										 glob_cxt, &arg_cxt))
+					return false;
+
+				foreach(lc, ce->args)
+				{
+					CaseWhen   *cw = (CaseWhen *) lfirst(lc);
+					foreign_loc_cxt when_cxt;
+					bool		ok;
+
+					/*
+					 * With a CASE arg, the parser makes each WHEN clause a
+					 * "CaseTestExpr = value" comparison, maybe with an
+					 * implicit coercion of the CaseTestExpr; deparseCaseExpr
+					 * can't handle anything else.
+					 */
+					if (ce->arg != NULL)
+					{
+						OpExpr	   *oe = (OpExpr *) cw->expr;
+
+						if (!IsA(oe, OpExpr) ||
+							list_length(oe->args) != 2 ||
+							!IsA(strip_implicit_coercions(linitial(oe->args)),
+								 CaseTestExpr))
+							return false;
+					}
+
+					/*
+					 * Recurse to the WHEN clause, which is boolean and so
+					 * doesn't affect our collation.
+					 */
+					when_cxt.collation = InvalidOid;
+					when_cxt.state = FDW_COLLATE_NONE;
+					save_case_arg_cxt = glob_cxt->case_arg_cxt;
+					glob_cxt->case_arg_cxt = &arg_cxt;
+					ok = foreign_expr_walker((Node *) cw->expr,
+											 glob_cxt, &when_cxt);
+					glob_cxt->case_arg_cxt = save_case_arg_cxt;
+					if (!ok)
+						return false;
+
+					/*
+					 * Recurse to the THEN result.
+					 */
+					if (!foreign_expr_walker((Node *) cw->result,
+											 glob_cxt, &inner_cxt))
+						return false;
+				}
+
+				/*
+				 * Recurse to the ELSE result.
+				 */
+				if (!foreign_expr_walker((Node *) ce->defresult,
+										 glob_cxt, &inner_cxt))
+					return false;
+
+				/*
+				 * CASE must not introduce a collation not derived from an
+				 * input foreign Var.
+				 */
+				collation = ce->casecollid;
+				if (collation == InvalidOid)
+					state = FDW_COLLATE_NONE;
+				else if (inner_cxt.state == FDW_COLLATE_SAFE &&
+						 collation == inner_cxt.collation)
+					state = FDW_COLLATE_SAFE;
+				else
+					state = FDW_COLLATE_UNSAFE;
+			}
+			break;
+		case T_CaseTestExpr:
+			{
+				CaseTestExpr *c = (CaseTestExpr *) node;
+
+				/* It's only expected in the WHEN clauses of a CASE arg */
+				if (glob_cxt->case_arg_cxt == NULL)
+					return false;
+
+				/*
+				 * Its collation, if any, must be derived from foreign Vars in
+				 * the CASE arg.
+				 */
+				collation = c->collation;
+				if (collation == InvalidOid)
+					state = FDW_COLLATE_NONE;
+				else if (glob_cxt->case_arg_cxt->state == FDW_COLLATE_SAFE &&
+						 collation == glob_cxt->case_arg_cxt->collation)
+					state = FDW_COLLATE_SAFE;
+				else
+					state = FDW_COLLATE_UNSAFE;
+			}
+			break;
+		case T_CoalesceExpr:
+			{
+				CoalesceExpr *c = (CoalesceExpr *) node;
+
+				/*
+				 * Recurse to input subexpressions.
+				 */
+				if (!foreign_expr_walker((Node *) c->args,
+										 glob_cxt, &inner_cxt))
+					return false;
+
+				/*
+				 * COALESCE must not introduce a collation not derived from an
+				 * input foreign Var.
+				 */
+				collation = c->coalescecollid;
+				if (collation == InvalidOid)
+					state = FDW_COLLATE_NONE;
+				else if (inner_cxt.state == FDW_COLLATE_SAFE &&
+						 collation == inner_cxt.collation)
+					state = FDW_COLLATE_SAFE;
+				else
+					state = FDW_COLLATE_UNSAFE;
+			}
+			break;
+		case T_NullIfExpr:		/* struct-equivalent to OpExpr */
+			{
+				NullIfExpr *ni = (NullIfExpr *) node;
+
+				/*
+				 * The equality operator has to be built-in, and standard for
+				 * other servers.
+				 */
+				if (!is_builtin(ni->opno))
+					return false;
+				if (!glob_cxt->dialect->postgres &&
+					(find_portable_operator(ni->opno) == NULL ||
+					 (ni->inputcollid != InvalidOid &&
+					  !glob_cxt->compare_strings)))
+					return false;
+
+				/*
+				 * Recurse to input subexpressions.
+				 */
+				if (!foreign_expr_walker((Node *) ni->args,
+										 glob_cxt, &inner_cxt))
+					return false;
+
+				/*
+				 * If the comparison's input collation is not derived from a
+				 * foreign Var, it can't be sent to remote.
+				 */
+				if (ni->inputcollid == InvalidOid)
+					 /* OK, inputs are all noncollatable */ ;
+				else if (inner_cxt.state != FDW_COLLATE_SAFE ||
+						 ni->inputcollid != inner_cxt.collation)
+					return false;
+
+				/* Result-collation handling is same as for functions */
+				collation = ni->opcollid;
+				if (collation == InvalidOid)
+					state = FDW_COLLATE_NONE;
+				else if (inner_cxt.state == FDW_COLLATE_SAFE &&
+						 collation == inner_cxt.collation)
+					state = FDW_COLLATE_SAFE;
+				else
+					state = FDW_COLLATE_UNSAFE;
+			}
+			break;
+		case T_MinMaxExpr:
+			{
+				MinMaxExpr *mm = (MinMaxExpr *) node;
+
+				/*
+				 * GREATEST and LEAST aren't standard, and where they exist
+				 * elsewhere a NULL argument makes the result NULL.
+				 */
+				if (!glob_cxt->dialect->postgres)
+					return false;
+
+				/*
+				 * Recurse to input subexpressions.
+				 */
+				if (!foreign_expr_walker((Node *) mm->args,
+										 glob_cxt, &inner_cxt))
+					return false;
+
+				/*
+				 * If the comparison's input collation is not derived from a
+				 * foreign Var, it can't be sent to remote.
+				 */
+				if (mm->inputcollid == InvalidOid)
+					 /* OK, inputs are all noncollatable */ ;
+				else if (inner_cxt.state != FDW_COLLATE_SAFE ||
+						 mm->inputcollid != inner_cxt.collation)
+					return false;
+
+				/* Result-collation handling is same as for functions */
+				collation = mm->minmaxcollid;
+				if (collation == InvalidOid)
+					state = FDW_COLLATE_NONE;
+				else if (inner_cxt.state == FDW_COLLATE_SAFE &&
+						 collation == inner_cxt.collation)
+					state = FDW_COLLATE_SAFE;
+				else
+					state = FDW_COLLATE_UNSAFE;
+			}
+			break;
+		case T_RowCompareExpr:
+			{
+				RowCompareExpr *rc = (RowCompareExpr *) node;
+				ListCell   *lop;
+				ListCell   *lcoll;
+				ListCell   *larg;
+				ListCell   *rarg;
+
+				/* Row comparisons other than = aren't widely supported */
+				if (!glob_cxt->dialect->postgres)
+					return false;
+
+				/*
+				 * Each pair of columns is compared by its own operator and
+				 * collation, which are checked like an OpExpr's.
+				 */
+				foreach(lop, rc->opnos)
+				{
+					if (!is_builtin(lfirst_oid(lop)))
+						return false;
+				}
+				lcoll = list_head(rc->inputcollids);
+				forboth(larg, rc->largs, rarg, rc->rargs)
+				{
+					foreign_loc_cxt pair_cxt;
+					Oid			inputcollid;
+
+					pair_cxt.collation = InvalidOid;
+					pair_cxt.state = FDW_COLLATE_NONE;
+					if (!foreign_expr_walker((Node *) lfirst(larg),
+											 glob_cxt, &pair_cxt) ||
+						!foreign_expr_walker((Node *) lfirst(rarg),
+											 glob_cxt, &pair_cxt))
+						return false;
+
+					inputcollid = lfirst_oid(lcoll);
+					if (inputcollid == InvalidOid)
+						 /* OK, inputs are all noncollatable */ ;
+					else if (pair_cxt.state != FDW_COLLATE_SAFE ||
+							 inputcollid != pair_cxt.collation)
+						return false;
+					lcoll = lnext(lcoll);
+				}
+
+				/* Output is always boolean and so noncollatable. */
+				collation = InvalidOid;
+				state = FDW_COLLATE_NONE;
+			}
+			break;
+		case T_BooleanTest:
+			{
+				BooleanTest *bt = (BooleanTest *) node;
+
+				/* IS TRUE and friends need a boolean type */
+				if (!glob_cxt->dialect->has_boolean)
+					return false;
+
+				/*
+				 * Recurse to input subexpressions.
+				 */
+				if (!foreign_expr_walker((Node *) bt->arg,
+										 glob_cxt, &inner_cxt))
+					return false;
+
+				/* Output is always boolean and so noncollatable. */
+				collation = InvalidOid;
+				state = FDW_COLLATE_NONE;
+			}
+			break;
 		case T_List:
 			{
 				List	   *l = (List *) node;
@@ -667,6 +1102,276 @@ is_builtin(Oid oid)
 	return (oid < FirstBootstrapObjectId);
 }
 
+/*
+ * Return the remote template that the given function or operator is mapped
+ * to for the server of foreignrel, or NULL.
+ */
+static const char *
+find_remote_template(Oid classid, Oid objid, RelOptInfo *foreignrel)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) foreignrel->fdw_private;
+
+	return GetRemoteTemplate(classid, objid, fpinfo->server, fpinfo->dialect);
+}
+
+/*
+ * Return true if the server of foreignrel compares and sorts character
+ * strings the way we do.  Other databases often don't: SQL Server and
+ * MySQL ignore case by default, some ignore trailing blanks, and their
+ * sort orders differ, so a remote = or ORDER BY would give other rows or
+ * another order than the local one.  Only PostgreSQL is trusted, or a
+ * server or table whose collation_compatible option says so.
+ */
+static bool
+strings_compare_alike(RelOptInfo *foreignrel)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) foreignrel->fdw_private;
+
+	return fpinfo->dialect->postgres || fpinfo->collation_compatible;
+}
+
+/*
+ * Return true if values of the given type can be written as a literal that
+ * every SQL dialect reads as the same value.
+ */
+static bool
+is_portable_type(Oid type, const JdbcDialect *dialect)
+{
+	switch (type)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+		case DATEOID:
+		case TIMESTAMPOID:
+			return true;
+		case BOOLOID:
+			return dialect->has_boolean;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Return true if the given function call means the same in every SQL
+ * dialect, see portable_functions.  An implicit cast does too, since it is
+ * printed as just its argument.
+ */
+static bool
+is_portable_function(FuncExpr *fe)
+{
+	HeapTuple	proctup;
+	Form_pg_proc procform;
+	const char *const *name;
+	bool		result = false;
+
+	if (fe->funcformat == COERCE_IMPLICIT_CAST)
+		return true;
+	if (fe->funcformat != COERCE_EXPLICIT_CALL || fe->funcvariadic)
+		return false;
+
+	proctup = SearchSysCache1(PROCOID, ObjectIdGetDatum(fe->funcid));
+	if (!HeapTupleIsValid(proctup))
+		elog(ERROR, "cache lookup failed for function %u", fe->funcid);
+	procform = (Form_pg_proc) GETSTRUCT(proctup);
+
+	if (procform->pronamespace == PG_CATALOG_NAMESPACE)
+	{
+		for (name = portable_functions; *name; name++)
+		{
+			if (strcmp(NameStr(procform->proname), *name) == 0)
+			{
+				result = true;
+				break;
+			}
+		}
+	}
+
+	ReleaseSysCache(proctup);
+	return result;
+}
+
+/*
+ * Return the portable_operators entry of the given operator, or NULL if it
+ * has none, or isn't used on the types that entry is limited to.
+ */
+static const PortableOperator *
+find_portable_operator(Oid opno)
+{
+	HeapTuple	tuple;
+	Form_pg_operator form;
+	const PortableOperator *op;
+	const PortableOperator *result = NULL;
+
+	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(opno));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for operator %u", opno);
+	form = (Form_pg_operator) GETSTRUCT(tuple);
+
+	for (op = portable_operators; op->oprname; op++)
+	{
+		if (form->oprnamespace != PG_CATALOG_NAMESPACE ||
+			strcmp(NameStr(form->oprname), op->oprname) != 0)
+			continue;
+
+		if (op->numeric_only &&
+			form->oprresult != INT2OID && form->oprresult != INT4OID &&
+			form->oprresult != INT8OID && form->oprresult != FLOAT4OID &&
+			form->oprresult != FLOAT8OID && form->oprresult != NUMERICOID)
+			break;
+		if (op->string_only &&
+			form->oprleft != TEXTOID && form->oprleft != BPCHAROID)
+			break;
+
+		result = op;
+		break;
+	}
+
+	ReleaseSysCache(tuple);
+	return result;
+}
+
+/*
+ * Check whether a ScalarArrayOpExpr can be written as "x IN (...)" or
+ * "x NOT IN (...)" for a server that isn't PostgreSQL: it has to be
+ * = ANY or <> ALL of a nonempty array that is written out in the query.
+ * The operands are checked as foreign_expr_walker would, with their
+ * collation information going into *inner_cxt.
+ */
+static bool
+is_portable_in_list(ScalarArrayOpExpr *oe,
+					foreign_glob_cxt *glob_cxt,
+					foreign_loc_cxt *inner_cxt)
+{
+	const PortableOperator *op = find_portable_operator(oe->opno);
+	Node	   *array = (Node *) lsecond(oe->args);
+
+	if (op == NULL || strcmp(op->sqlname, oe->useOr ? "=" : "<>") != 0)
+		return false;
+	if (oe->inputcollid != InvalidOid && !glob_cxt->compare_strings)
+		return false;
+
+	if (!foreign_expr_walker((Node *) linitial(oe->args),
+							 glob_cxt, inner_cxt))
+		return false;
+
+	if (IsA(array, ArrayExpr))
+	{
+		ArrayExpr  *a = (ArrayExpr *) array;
+
+		return a->elements != NIL &&
+			foreign_expr_walker((Node *) a->elements, glob_cxt, inner_cxt);
+	}
+	else if (IsA(array, Const))
+	{
+		Const	   *c = (Const *) array;
+		ArrayType  *arr;
+
+		if (c->constisnull ||
+			(c->constcollid != InvalidOid &&
+			 c->constcollid != DEFAULT_COLLATION_OID) ||
+			!is_portable_type(get_element_type(c->consttype),
+							  glob_cxt->dialect))
+			return false;
+
+		arr = DatumGetArrayTypeP(c->constvalue);
+		return ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr)) > 0;
+	}
+
+	return false;
+}
+
+/*
+ * Find an equivalence class member expression, all of whose Vars come from
+ * the indicated relation.  Constants, which have no Vars, don't count.
+ */
+static Expr *
+find_em_expr_for_rel(EquivalenceClass *ec, RelOptInfo *rel)
+{
+	ListCell   *lc_em;
+
+	foreach(lc_em, ec->ec_members)
+	{
+		EquivalenceMember *em = lfirst(lc_em);
+
+		/*
+		 * If there is more than one equivalence member whose Vars are taken
+		 * entirely from this relation, we'll be content to choose any one of
+		 * those.
+		 */
+		if (!bms_is_empty(em->em_relids) &&
+			bms_is_subset(em->em_relids, rel->relids))
+			return em->em_expr;
+	}
+
+	/* We didn't find any suitable equivalence class expression */
+	return NULL;
+}
+
+/*
+ * Returns true if the remote server can sort the rows of baserel by pathkey
+ * the way we would: the sort expression must be safe to send, and so must
+ * the operator family, whose ordering is only known to match for built-in
+ * ones, and the collation.  The NULLs have to come out where we want them,
+ * too.
+ */
+bool
+is_foreign_pathkey(PlannerInfo *root,
+				   RelOptInfo *baserel,
+				   PathKey *pathkey)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
+	EquivalenceClass *pathkey_ec = pathkey->pk_eclass;
+	bool		nulls_low;
+	Expr	   *em_expr;
+
+	/* NULLs sort low if they come first in ascending order */
+	nulls_low = (pathkey->pk_nulls_first ==
+				 (pathkey->pk_strategy == BTLessStrategyNumber));
+	switch (fpinfo->dialect->nulls_order)
+	{
+		case JDBC_NULLS_CLAUSE:
+			break;
+		case JDBC_NULLS_LOW:
+			if (!nulls_low)
+				return false;
+			break;
+		case JDBC_NULLS_HIGH:
+			if (nulls_low)
+				return false;
+			break;
+		case JDBC_NULLS_UNKNOWN:
+			return false;
+	}
+
+	/*
+	 * is_foreign_expr would detect volatile expressions as well, but checking
+	 * ec_has_volatile here saves some cycles.
+	 */
+	if (pathkey_ec->ec_has_volatile)
+		return false;
+
+	if (!is_builtin(pathkey->pk_opfamily))
+		return false;
+
+	/* Character strings may sort another way on the remote server */
+	if (pathkey_ec->ec_collation != InvalidOid &&
+		!strings_compare_alike(baserel))
+		return false;
+
+	em_expr = find_em_expr_for_rel(pathkey_ec, baserel);
+	if (em_expr == NULL)
+		return false;
+
+	return is_foreign_expr(root, baserel, em_expr);
+}
+
 
 /*
  * Construct a simple SELECT statement that retrieves desired columns
@@ -683,6 +1388,7 @@ deparseSelectSql(StringInfo buf,
 				 Bitmapset *attrs_used,
 				 List **retrieved_attrs)
 {
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
 	RangeTblEntry *rte = planner_rt_fetch(baserel->relid, root);
 	Relation	rel;
 
@@ -697,13 +1403,13 @@ deparseSelectSql(StringInfo buf,
 	 */
 	appendStringInfoString(buf, "SELECT ");
 	deparseTargetList(buf, root, baserel->relid, rel, attrs_used,
-					  retrieved_attrs);
+					  retrieved_attrs, fpinfo->dialect);
 
 	/*
 	 * Construct FROM clause
 	 */
 	appendStringInfoString(buf, " FROM ");
-	deparseRelation(buf, rel);
+	deparseRelation(buf, rel, fpinfo->dialect);
 
 	heap_close(rel, NoLock);
 }
@@ -721,7 +1427,8 @@ deparseTargetList(StringInfo buf,
 				  Index rtindex,
 				  Relation rel,
 				  Bitmapset *attrs_used,
-				  List **retrieved_attrs)
+				  List **retrieved_attrs,
+				  const JdbcDialect *dialect)
 {
 	TupleDesc	tupdesc = RelationGetDescr(rel);
 	bool		have_wholerow;
@@ -751,7 +1458,7 @@ deparseTargetList(StringInfo buf,
 				appendStringInfoString(buf, ", ");
 			first = false;
 
-			deparseColumnRef(buf, rtindex, i, root);
+			deparseColumnRef(buf, rtindex, i, root, dialect);
 
 			*retrieved_attrs = lappend_int(*retrieved_attrs, i);
 		}
@@ -788,7 +1495,8 @@ deparseTargetList(StringInfo buf,
  *
  * If params is not NULL, it receives a list of Params and other-relation Vars
  * used in the clauses; these values must be transmitted to the remote server
- * as parameter values.
+ * as parameter values.  With the bind_literals option, so do the constants
+ * that can be bound, see is_bindable_const.
  *
  * If params is NULL, we're generating the query for EXPLAIN purposes,
  * so Params and other-relation Vars should be replaced by dummy values.
@@ -813,6 +1521,9 @@ appendWhereClause(StringInfo buf,
 	context.foreignrel = baserel;
 	context.buf = buf;
 	context.params_list = params;
+	context.dialect = ((PgFdwRelationInfo *) baserel->fdw_private)->dialect;
+	context.bind_literals =
+		((PgFdwRelationInfo *) baserel->fdw_private)->bind_literals;
 
 	/* Make sure any constants in the exprs are printed portably */
 	nestlevel = set_transmission_modes();
@@ -837,6 +1548,90 @@ appendWhereClause(StringInfo buf,
 	reset_transmission_modes(nestlevel);
 }
 
+/*
+ * Deparse ORDER BY clause according to the given pathkeys, all of which
+ * must have passed is_foreign_pathkey.  NULLS FIRST/LAST is always spelled
+ * out if the remote server understands it, since its default placement of
+ * NULLs may differ from ours.
+ */
+void
+appendOrderByClause(StringInfo buf,
+					PlannerInfo *root,
+					RelOptInfo *baserel,
+					List *pathkeys)
+{
+	ListCell   *lc;
+	deparse_expr_cxt context;
+	int			nestlevel;
+	const char *delim = " ";
+
+	/* Set up context struct for recursion */
+	context.root = root;
+	context.foreignrel = baserel;
+	context.buf = buf;
+	context.params_list = NULL;
+	context.dialect = ((PgFdwRelationInfo *) baserel->fdw_private)->dialect;
+	context.bind_literals = false;
+
+	/* Make sure any constants in the exprs are printed portably */
+	nestlevel = set_transmission_modes();
+
+	appendStringInfoString(buf, " ORDER BY");
+	foreach(lc, pathkeys)
+	{
+		PathKey    *pathkey = (PathKey *) lfirst(lc);
+		Expr	   *em_expr;
+
+		em_expr = find_em_expr_for_rel(pathkey->pk_eclass, baserel);
+		Assert(em_expr != NULL);
+
+		appendStringInfoString(buf, delim);
+		deparseExpr(em_expr, &context);
+		if (pathkey->pk_strategy == BTLessStrategyNumber)
+			appendStringInfoString(buf, " ASC");
+		else
+			appendStringInfoString(buf, " DESC");
+
+		if (context.dialect->nulls_order == JDBC_NULLS_CLAUSE)
+		{
+			if (pathkey->pk_nulls_first)
+				appendStringInfoString(buf, " NULLS FIRST");
+			else
+				appendStringInfoString(buf, " NULLS LAST");
+		}
+
+		delim = ", ";
+	}
+
+	reset_transmission_modes(nestlevel);
+}
+
+/*
+ * Deparse a clause that stops the remote query after max_rows rows, if the
+ * remote server has one; otherwise Statement.setMaxRows does it.
+ * Nothing is added if max_rows is 0.
+ */
+void
+appendLimitClause(StringInfo buf, RelOptInfo *baserel, int max_rows)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
+
+	if (max_rows <= 0)
+		return;
+
+	switch (fpinfo->dialect->limit_style)
+	{
+		case JDBC_LIMIT_NONE:
+			break;
+		case JDBC_LIMIT_LIMIT:
+			appendStringInfo(buf, " LIMIT %d", max_rows);
+			break;
+		case JDBC_LIMIT_FETCH_FIRST:
+			appendStringInfo(buf, " FETCH FIRST %d ROWS ONLY", max_rows);
+			break;
+	}
+}
+
 /*
  * deparse remote INSERT statement
  *
@@ -850,12 +1645,12 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				 List *targetAttrs, List *returningList,
 				 List **retrieved_attrs)
 {
-	AttrNumber	pindex;
+	const JdbcDialect *dialect = GetRelationDialect(rel);
 	bool		first;
 	ListCell   *lc;
 
 	appendStringInfoString(buf, "INSERT INTO ");
-	deparseRelation(buf, rel);
+	deparseRelation(buf, rel, dialect);
 
 	if (targetAttrs)
 	{
@@ -870,12 +1665,11 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				appendStringInfoString(buf, ", ");
 			first = false;
 
-			deparseColumnRef(buf, rtindex, attnum, root);
+			deparseColumnRef(buf, rtindex, attnum, root, dialect);
 		}
 
 		appendStringInfoString(buf, ") VALUES (");
 
-		pindex = 1;
 		first = true;
 		foreach(lc, targetAttrs)
 		{
@@ -883,8 +1677,7 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				appendStringInfoString(buf, ", ");
 			first = false;
 
-			appendStringInfo(buf, "$%d", pindex);
-			pindex++;
+			appendStringInfoChar(buf, '?');
 		}
 
 		appendStringInfoChar(buf, ')');
@@ -894,7 +1687,7 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 
 	deparseReturningList(buf, root, rtindex, rel,
 					   rel->trigdesc && rel->trigdesc->trig_insert_after_row,
-						 returningList, retrieved_attrs);
+						 returningList, retrieved_attrs, dialect);
 }
 
 /*
@@ -902,23 +1695,24 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
  *
  * The statement text is appended to buf, and we also create an integer List
  * of the columns being retrieved by RETURNING (if any), which is returned
- * to *retrieved_attrs.
+ * to *retrieved_attrs.  The row is identified by keyAttrs, or by its ctid
+ * if that's NIL.
  */
 void
 deparseUpdateSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
-				 List *targetAttrs, List *returningList,
+				 List *targetAttrs, List *keyAttrs,
+				 List *returningList,
 				 List **retrieved_attrs)
 {
-	AttrNumber	pindex;
+	const JdbcDialect *dialect = GetRelationDialect(rel);
 	bool		first;
 	ListCell   *lc;
 
 	appendStringInfoString(buf, "UPDATE ");
-	deparseRelation(buf, rel);
+	deparseRelation(buf, rel, dialect);
 	appendStringInfoString(buf, " SET ");
 
-	pindex = 2;					/* ctid is always the first param */
 	first = true;
 	foreach(lc, targetAttrs)
 	{
@@ -928,37 +1722,207 @@ deparseUpdateSql(StringInfo buf, PlannerInfo *root,
 			appendStringInfoString(buf, ", ");
 		first = false;
 
-		deparseColumnRef(buf, rtindex, attnum, root);
-		appendStringInfo(buf, " = $%d", pindex);
-		pindex++;
+		deparseColumnRef(buf, rtindex, attnum, root, dialect);
+		appendStringInfoString(buf, " = ?");
 	}
-	appendStringInfoString(buf, " WHERE ctid = $1");
+	deparseRowIdentity(buf, rtindex, keyAttrs, root, dialect);
 
 	deparseReturningList(buf, root, rtindex, rel,
 					   rel->trigdesc && rel->trigdesc->trig_update_after_row,
-						 returningList, retrieved_attrs);
+						 returningList, retrieved_attrs, dialect);
+}
+
+/*
+ * deparse remote DELETE statement
+ *
+ * The statement text is appended to buf, and we also create an integer List
+ * of the columns being retrieved by RETURNING (if any), which is returned
+ * to *retrieved_attrs.  The row is identified by keyAttrs, or by its ctid
+ * if that's NIL.
+ */
+void
+deparseDeleteSql(StringInfo buf, PlannerInfo *root,
+				 Index rtindex, Relation rel,
+				 List *keyAttrs, List *returningList,
+				 List **retrieved_attrs)
+{
+	const JdbcDialect *dialect = GetRelationDialect(rel);
+
+	appendStringInfoString(buf, "DELETE FROM ");
+	deparseRelation(buf, rel, dialect);
+	deparseRowIdentity(buf, rtindex, keyAttrs, root, dialect);
+
+	deparseReturningList(buf, root, rtindex, rel,
+					   rel->trigdesc && rel->trigdesc->trig_delete_after_row,
+						 returningList, retrieved_attrs, dialect);
+}
+
+/*
+ * Append the WHERE clause that picks the row to update or delete.  JDBC
+ * parameters are positional, so the ctid or key columns are always the
+ * last ones.
+ */
+static void
+deparseRowIdentity(StringInfo buf, Index rtindex, List *keyAttrs,
+				   PlannerInfo *root, const JdbcDialect *dialect)
+{
+	bool		first = true;
+	ListCell   *lc;
+
+	if (keyAttrs == NIL)
+	{
+		appendStringInfoString(buf, " WHERE ctid = ?");
+		return;
+	}
+
+	foreach(lc, keyAttrs)
+	{
+		appendStringInfoString(buf, first ? " WHERE " : " AND ");
+		first = false;
+
+		deparseColumnRef(buf, rtindex, lfirst_int(lc), root, dialect);
+		appendStringInfoString(buf, " = ?");
+	}
+}
+
+/*
+ * deparse remote UPDATE statement that updates all the rows by itself
+ *
+ * The new values of the targetAttrs are taken from the subplan's targetlist,
+ * and the rows to update are those satisfying remote_conds; all of them must
+ * be safe to send.  The expressions to be sent as parameters are returned
+ * to *params_list.
+ */
+void
+deparseDirectUpdateSql(StringInfo buf, PlannerInfo *root,
+					   Index rtindex, Relation rel,
+					   RelOptInfo *baserel,
+					   List *targetlist, List *targetAttrs,
+					   List *remote_conds, List **params_list)
+{
+	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
+	deparse_expr_cxt context;
+	List	   *where_params = NIL;
+	int			nestlevel;
+	bool		first;
+	ListCell   *lc;
+
+	*params_list = NIL;
+
+	/* Set up context struct for recursion */
+	context.root = root;
+	context.foreignrel = baserel;
+	context.buf = buf;
+	context.params_list = params_list;
+	context.dialect = fpinfo->dialect;
+	context.bind_literals = fpinfo->bind_literals;
+
+	appendStringInfoString(buf, "UPDATE ");
+	deparseRelation(buf, rel, fpinfo->dialect);
+	appendStringInfoString(buf, " SET ");
+
+	/* Make sure any constants in the exprs are printed portably */
+	nestlevel = set_transmission_modes();
+
+	first = true;
+	foreach(lc, targetAttrs)
+	{
+		int			attnum = lfirst_int(lc);
+		TargetEntry *tle = get_tle_by_resno(targetlist, attnum);
+
+		if (!tle)
+			elog(ERROR, "attribute number %d not found in UPDATE targetlist",
+				 attnum);
+
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+
+		deparseColumnRef(buf, rtindex, attnum, root, fpinfo->dialect);
+		appendStringInfoString(buf, " = ");
+		deparseExpr(tle->expr, &context);
+	}
+
+	reset_transmission_modes(nestlevel);
+
+	if (remote_conds)
+	{
+		appendWhereClause(buf, root, baserel, remote_conds, true,
+						  &where_params);
+		*params_list = list_concat(*params_list, where_params);
+	}
 }
 
-/*
- * deparse remote DELETE statement
- *
- * The statement text is appended to buf, and we also create an integer List
- * of the columns being retrieved by RETURNING (if any), which is returned
- * to *retrieved_attrs.
- */
-void
-deparseDeleteSql(StringInfo buf, PlannerInfo *root,
-				 Index rtindex, Relation rel,
-				 List *returningList,
-				 List **retrieved_attrs)
-{
-	appendStringInfoString(buf, "DELETE FROM ");
-	deparseRelation(buf, rel);
-	appendStringInfoString(buf, " WHERE ctid = $1");
+/*
+ * deparse remote DELETE statement that deletes all the rows by itself
+ *
+ * The rows to delete are those satisfying remote_conds, all of which must
+ * be safe to send.  The expressions to be sent as parameters are returned
+ * to *params_list.
+ */
+void
+deparseDirectDeleteSql(StringInfo buf, PlannerInfo *root,
+					   Relation rel, RelOptInfo *baserel,
+					   List *remote_conds, List **params_list)
+{
+	*params_list = NIL;
+
+	appendStringInfoString(buf, "DELETE FROM ");
+	deparseRelation(buf, rel, GetRelationDialect(rel));
+
+	if (remote_conds)
+		appendWhereClause(buf, root, baserel, remote_conds, true,
+						  params_list);
+}
+
+/*
+ * deparse remote COPY statement for a batched INSERT
+ *
+ * The rows are sent as COPY data in text format, in the order of targetAttrs.
+ */
+void
+deparseCopySql(StringInfo buf, Relation rel, List *targetAttrs)
+{
+	const JdbcDialect *dialect = GetRelationDialect(rel);
+	Oid			relid = RelationGetRelid(rel);
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	bool		first = true;
+	ListCell   *lc;
+
+	appendStringInfoString(buf, "COPY ");
+	deparseRelation(buf, rel, dialect);
+	appendStringInfoString(buf, " (");
+
+	foreach(lc, targetAttrs)
+	{
+		int			attnum = lfirst_int(lc);
+		char	   *colname;
+		List	   *options;
+		ListCell   *lc2;
+
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+
+		/* Use attribute name or column_name option. */
+		colname = NameStr(tupdesc->attrs[attnum - 1]->attname);
+		options = GetForeignColumnOptions(relid, attnum);
+
+		foreach(lc2, options)
+		{
+			DefElem    *def = (DefElem *) lfirst(lc2);
+
+			if (strcmp(def->defname, "column_name") == 0)
+			{
+				colname = defGetString(def);
+				break;
+			}
+		}
+
+		appendStringInfoString(buf, dialect_quote_identifier(dialect, colname));
+	}
 
-	deparseReturningList(buf, root, rtindex, rel,
-					   rel->trigdesc && rel->trigdesc->trig_delete_after_row,
-						 returningList, retrieved_attrs);
+	appendStringInfoString(buf, ") FROM STDIN");
 }
 
 /*
@@ -969,7 +1933,8 @@ deparseReturningList(StringInfo buf, PlannerInfo *root,
 					 Index rtindex, Relation rel,
 					 bool trig_after_row,
 					 List *returningList,
-					 List **retrieved_attrs)
+					 List **retrieved_attrs,
+					 const JdbcDialect *dialect)
 {
 	Bitmapset  *attrs_used = NULL;
 
@@ -994,7 +1959,7 @@ deparseReturningList(StringInfo buf, PlannerInfo *root,
 	{
 		appendStringInfoString(buf, " RETURNING ");
 		deparseTargetList(buf, root, rtindex, rel, attrs_used,
-						  retrieved_attrs);
+						  retrieved_attrs, dialect);
 	}
 	else
 		*retrieved_attrs = NIL;
@@ -1006,19 +1971,23 @@ deparseReturningList(StringInfo buf, PlannerInfo *root,
  * Note: we use local definition of block size, not remote definition.
  * This is perhaps debatable.
  *
- * Note: pg_relation_size() exists in 8.1 and later.
+ * Note: pg_relation_size() exists in 8.1 and later.  Other databases have
+ * nothing like it, so this is only for a PostgreSQL server.
  */
 void
 deparseAnalyzeSizeSql(StringInfo buf, Relation rel)
 {
+	const JdbcDialect *dialect = GetRelationDialect(rel);
 	StringInfoData relname;
 
+	Assert(dialect->postgres);
+
 	/* We'll need the remote relation name as a literal. */
 	initStringInfo(&relname);
-	deparseRelation(&relname, rel);
+	deparseRelation(&relname, rel, dialect);
 
 	appendStringInfoString(buf, "SELECT pg_catalog.pg_relation_size(");
-	deparseStringLiteral(buf, relname.data);
+	deparseStringLiteral(buf, relname.data, dialect);
 	appendStringInfo(buf, "::pg_catalog.regclass) / %d", BLCKSZ);
 }
 
@@ -1031,6 +2000,7 @@ deparseAnalyzeSizeSql(StringInfo buf, Relation rel)
 void
 deparseAnalyzeSql(StringInfo buf, Relation rel, List **retrieved_attrs)
 {
+	const JdbcDialect *dialect = GetRelationDialect(rel);
 	Oid			relid = RelationGetRelid(rel);
 	TupleDesc	tupdesc = RelationGetDescr(rel);
 	int			i;
@@ -1067,7 +2037,7 @@ deparseAnalyzeSql(StringInfo buf, Relation rel, List **retrieved_attrs)
 			}
 		}
 
-		appendStringInfoString(buf, quote_identifier(colname));
+		appendStringInfoString(buf, dialect_quote_identifier(dialect, colname));
 
 		*retrieved_attrs = lappend_int(*retrieved_attrs, i + 1);
 	}
@@ -1080,7 +2050,7 @@ deparseAnalyzeSql(StringInfo buf, Relation rel, List **retrieved_attrs)
 	 * Construct FROM clause
 	 */
 	appendStringInfoString(buf, " FROM ");
-	deparseRelation(buf, rel);
+	deparseRelation(buf, rel, dialect);
 }
 
 /*
@@ -1088,7 +2058,8 @@ deparseAnalyzeSql(StringInfo buf, Relation rel, List **retrieved_attrs)
  * If it has a column_name FDW option, use that instead of attribute name.
  */
 static void
-deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root)
+deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root,
+				 const JdbcDialect *dialect)
 {
 	RangeTblEntry *rte;
 	char	   *colname = NULL;
@@ -1124,20 +2095,23 @@ deparseColumnRef(StringInfo buf, int varno, int varattno, PlannerInfo *root)
 	if (colname == NULL)
 		colname = get_relid_attribute_name(rte->relid, varattno);
 
-	appendStringInfoString(buf, quote_identifier(colname));
+	appendStringInfoString(buf, dialect_quote_identifier(dialect, colname));
 }
 
 /*
  * Append remote name of specified foreign table to buf.
  * Use value of table_name FDW option (if any) instead of relation's name.
  * Similarly, schema_name FDW option overrides schema name.
+ * A foreign table with the query FDW option reads the rows of that query
+ * instead, as a derived table named after the foreign table.
  */
 static void
-deparseRelation(StringInfo buf, Relation rel)
+deparseRelation(StringInfo buf, Relation rel, const JdbcDialect *dialect)
 {
 	ForeignTable *table;
 	const char *nspname = NULL;
 	const char *relname = NULL;
+	const char *query = NULL;
 	ListCell   *lc;
 
 	/* obtain additional catalog information. */
@@ -1154,6 +2128,16 @@ deparseRelation(StringInfo buf, Relation rel)
 			nspname = defGetString(def);
 		else if (strcmp(def->defname, "table_name") == 0)
 			relname = defGetString(def);
+		else if (strcmp(def->defname, "query") == 0)
+			query = defGetString(def);
+	}
+
+	if (query != NULL)
+	{
+		appendStringInfo(buf, "(%s) %s", query,
+						 dialect_quote_identifier(dialect,
+											RelationGetRelationName(rel)));
+		return;
 	}
 
 	/*
@@ -1168,9 +2152,10 @@ deparseRelation(StringInfo buf, Relation rel)
 	}
 
 	if(strlen(nspname) == 0){ // schema_name '', will omit the schema from the object name
-		appendStringInfo(buf, "%s", quote_identifier(relname));
+		appendStringInfo(buf, "%s", dialect_quote_identifier(dialect, relname));
 	} else {
-		appendStringInfo(buf, "%s.%s", quote_identifier(nspname), quote_identifier(relname));
+		appendStringInfo(buf, "%s.%s", dialect_quote_identifier(dialect, nspname),
+						 dialect_quote_identifier(dialect, relname));
 	}
 }
 
@@ -1178,24 +2163,30 @@ deparseRelation(StringInfo buf, Relation rel)
  * Append a SQL string literal representing "val" to buf.
  */
 static void
-deparseStringLiteral(StringInfo buf, const char *val)
+deparseStringLiteral(StringInfo buf, const char *val,
+					 const JdbcDialect *dialect)
 {
 	const char *valptr;
+	bool		escape_backslash = dialect->backslash_escapes;
 
 	/*
-	 * Rather than making assumptions about the remote server's value of
+	 * Rather than making assumptions about a PostgreSQL server's value of
 	 * standard_conforming_strings, always use E'foo' syntax if there are any
 	 * backslashes.  This will fail on remote servers before 8.1, but those
-	 * are long out of support.
+	 * are long out of support.  Other servers take a backslash literally,
+	 * unless the dialect says it doesn't.
 	 */
-	if (strchr(val, '\\') != NULL)
+	if (dialect->postgres && strchr(val, '\\') != NULL)
+	{
 		appendStringInfoChar(buf, ESCAPE_STRING_SYNTAX);
+		escape_backslash = true;
+	}
 	appendStringInfoChar(buf, '\'');
 	for (valptr = val; *valptr; valptr++)
 	{
 		char		ch = *valptr;
 
-		if (SQL_STR_DOUBLE(ch, true))
+		if (SQL_STR_DOUBLE(ch, escape_backslash))
 			appendStringInfoChar(buf, ch);
 		appendStringInfoChar(buf, ch);
 	}
@@ -1256,6 +2247,24 @@ deparseExpr(Expr *node, deparse_expr_cxt *context)
 		case T_ArrayExpr:
 			deparseArrayExpr((ArrayExpr *) node, context);
 			break;
+		case T_CaseExpr:
+			deparseCaseExpr((CaseExpr *) node, context);
+			break;
+		case T_CoalesceExpr:
+			deparseCoalesceExpr((CoalesceExpr *) node, context);
+			break;
+		case T_NullIfExpr:
+			deparseNullIfExpr((NullIfExpr *) node, context);
+			break;
+		case T_MinMaxExpr:
+			deparseMinMaxExpr((MinMaxExpr *) node, context);
+			break;
+		case T_RowCompareExpr:
+			deparseRowCompareExpr((RowCompareExpr *) node, context);
+			break;
+		case T_BooleanTest:
+			deparseBooleanTest((BooleanTest *) node, context);
+			break;
 		default:
 			elog(ERROR, "unsupported expression type for deparse: %d",
 				 (int) nodeTag(node));
@@ -1280,31 +2289,16 @@ deparseVar(Var *node, deparse_expr_cxt *context)
 		node->varlevelsup == 0)
 	{
 		/* Var belongs to foreign table */
-		deparseColumnRef(buf, node->varno, node->varattno, context->root);
+		deparseColumnRef(buf, node->varno, node->varattno, context->root,
+						 context->dialect);
 	}
 	else
 	{
 		/* Treat like a Param */
 		if (context->params_list)
 		{
-			int			pindex = 0;
-			ListCell   *lc;
-
-			/* find its index in params_list */
-			foreach(lc, *context->params_list)
-			{
-				pindex++;
-				if (equal(node, (Node *) lfirst(lc)))
-					break;
-			}
-			if (lc == NULL)
-			{
-				/* not in list, so add it */
-				pindex++;
-				*context->params_list = lappend(*context->params_list, node);
-			}
-
-			printRemoteParam(pindex, node->vartype, node->vartypmod, context);
+			*context->params_list = lappend(*context->params_list, node);
+			printRemoteParam(node->vartype, node->vartypmod, context);
 		}
 		else
 		{
@@ -1313,10 +2307,45 @@ deparseVar(Var *node, deparse_expr_cxt *context)
 	}
 }
 
+/*
+ * Return true if a constant can be sent as a parameter instead.  That is
+ * only done for types which JDBC binds with a setter of their own (see
+ * JavaParamTypeCode in jq.c), and means the same as the literal would on
+ * any server.  bpchar isn't, since it would be bound as varchar, which
+ * compares trailing blanks differently.  NULLs stay literal, so that an
+ * untyped NULL doesn't leave the remote server guessing.
+ */
+static bool
+is_bindable_const(Const *node)
+{
+	if (node->constisnull)
+		return false;
+
+	switch (node->consttype)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+		case BOOLOID:
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TEXTOID:
+		case VARCHAROID:
+			return true;
+		default:
+			return false;
+	}
+}
+
 /*
  * Deparse given constant value into context->buf.
  *
  * This function has to be kept in sync with ruleutils.c's get_const_expr.
+ * For a server that isn't PostgreSQL, it's only given the types accepted by
+ * is_portable_type, and writes them as standard SQL literals.
  */
 static void
 deparseConst(Const *node, deparse_expr_cxt *context)
@@ -1328,12 +2357,25 @@ deparseConst(Const *node, deparse_expr_cxt *context)
 	bool		isfloat = false;
 	bool		needlabel;
 
+	/*
+	 * With bind_literals, send the constant as a parameter, so that queries
+	 * which only differ in their constants share one remote statement.
+	 */
+	if (context->bind_literals && context->params_list &&
+		is_bindable_const(node))
+	{
+		*context->params_list = lappend(*context->params_list, node);
+		printRemoteParam(node->consttype, node->consttypmod, context);
+		return;
+	}
+
 	if (node->constisnull)
 	{
 		appendStringInfoString(buf, "NULL");
-		appendStringInfo(buf, "::%s",
-						 format_type_with_typemod(node->consttype,
-												  node->consttypmod));
+		if (context->dialect->postgres)
+			appendStringInfo(buf, "::%s",
+							 format_type_with_typemod(node->consttype,
+													  node->consttypmod));
 		return;
 	}
 
@@ -1378,8 +2420,28 @@ deparseConst(Const *node, deparse_expr_cxt *context)
 			else
 				appendStringInfoString(buf, "false");
 			break;
+		case DATEOID:
+		case TIMESTAMPOID:
+			/* set_transmission_modes made these ISO, as SQL wants them */
+			if (context->dialect->postgres)
+				deparseStringLiteral(buf, extval, context->dialect);
+			else if (context->dialect->datetime_literals)
+			{
+				appendStringInfoString(buf, node->consttype == DATEOID ?
+									   "DATE " : "TIMESTAMP ");
+				deparseStringLiteral(buf, extval, context->dialect);
+			}
+			else
+			{
+				/* SQL Server's spelling */
+				appendStringInfoString(buf, "CAST(");
+				deparseStringLiteral(buf, extval, context->dialect);
+				appendStringInfoString(buf, node->consttype == DATEOID ?
+									   " AS date)" : " AS datetime2)");
+			}
+			break;
 		default:
-			deparseStringLiteral(buf, extval);
+			deparseStringLiteral(buf, extval, context->dialect);
 			break;
 	}
 
@@ -1416,33 +2478,17 @@ deparseConst(Const *node, deparse_expr_cxt *context)
  * Deparse given Param node.
  *
  * If we're generating the query "for real", add the Param to
- * context->params_list if it's not already present, and then use its index
- * in that list as the remote parameter number.  During EXPLAIN, there's
- * no need to identify a parameter number.
+ * context->params_list.  JDBC parameter markers are positional, so a Param
+ * used twice is also sent twice.  During EXPLAIN, there's no need to
+ * identify a parameter.
  */
 static void
 deparseParam(Param *node, deparse_expr_cxt *context)
 {
 	if (context->params_list)
 	{
-		int			pindex = 0;
-		ListCell   *lc;
-
-		/* find its index in params_list */
-		foreach(lc, *context->params_list)
-		{
-			pindex++;
-			if (equal(node, (Node *) lfirst(lc)))
-				break;
-		}
-		if (lc == NULL)
-		{
-			/* not in list, so add it */
-			pindex++;
-			*context->params_list = lappend(*context->params_list, node);
-		}
-
-		printRemoteParam(pindex, node->paramtype, node->paramtypmod, context);
+		*context->params_list = lappend(*context->params_list, node);
+		printRemoteParam(node->paramtype, node->paramtypmod, context);
 	}
 	else
 	{
@@ -1505,6 +2551,7 @@ deparseFuncExpr(FuncExpr *node, deparse_expr_cxt *context)
 	StringInfo	buf = context->buf;
 	HeapTuple	proctup;
 	Form_pg_proc procform;
+	const char *template;
 	const char *proname;
 	bool		use_variadic;
 	bool		first;
@@ -1538,6 +2585,17 @@ deparseFuncExpr(FuncExpr *node, deparse_expr_cxt *context)
 		return;
 	}
 
+	/*
+	 * Mapped function: display as its remote template.
+	 */
+	template = find_remote_template(ProcedureRelationId, node->funcid,
+									context->foreignrel);
+	if (template != NULL)
+	{
+		deparseTemplate(template, node->args, context);
+		return;
+	}
+
 	/*
 	 * Normal function: display as proname(args).
 	 */
@@ -1587,9 +2645,20 @@ deparseOpExpr(OpExpr *node, deparse_expr_cxt *context)
 	StringInfo	buf = context->buf;
 	HeapTuple	tuple;
 	Form_pg_operator form;
+	const PortableOperator *portable = NULL;
+	const char *template;
 	char		oprkind;
 	ListCell   *arg;
 
+	/* A mapped operator is displayed as its remote template. */
+	template = find_remote_template(OperatorRelationId, node->opno,
+									context->foreignrel);
+	if (template != NULL)
+	{
+		deparseTemplate(template, node->args, context);
+		return;
+	}
+
 	/* Retrieve information about the operator from system catalog. */
 	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(node->opno));
 	if (!HeapTupleIsValid(tuple))
@@ -1614,7 +2683,14 @@ deparseOpExpr(OpExpr *node, deparse_expr_cxt *context)
 	}
 
 	/* Deparse operator name. */
-	deparseOperatorName(buf, form);
+	if (context->dialect->postgres)
+		deparseOperatorName(buf, form);
+	else
+	{
+		portable = find_portable_operator(node->opno);
+		Assert(portable != NULL);
+		appendStringInfoString(buf, portable->sqlname);
+	}
 
 	/* Deparse right operand. */
 	if (oprkind == 'l' || oprkind == 'b')
@@ -1624,6 +2700,13 @@ deparseOpExpr(OpExpr *node, deparse_expr_cxt *context)
 		deparseExpr(lfirst(arg), context);
 	}
 
+	/* Our LIKE escapes with a backslash, standard SQL's with nothing */
+	if (portable && portable->string_only)
+	{
+		appendStringInfoString(buf, " ESCAPE ");
+		deparseStringLiteral(buf, "\\", context->dialect);
+	}
+
 	appendStringInfoChar(buf, ')');
 
 	ReleaseSysCache(tuple);
@@ -1687,15 +2770,22 @@ deparseScalarArrayOpExpr(ScalarArrayOpExpr *node, deparse_expr_cxt *context)
 	Expr	   *arg1;
 	Expr	   *arg2;
 
+	/* Sanity check. */
+	Assert(list_length(node->args) == 2);
+
+	/* Other servers get an IN list, see is_portable_in_list */
+	if (!context->dialect->postgres)
+	{
+		deparseInList(node, context);
+		return;
+	}
+
 	/* Retrieve information about the operator from system catalog. */
 	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(node->opno));
 	if (!HeapTupleIsValid(tuple))
 		elog(ERROR, "cache lookup failed for operator %u", node->opno);
 	form = (Form_pg_operator) GETSTRUCT(tuple);
 
-	/* Sanity check. */
-	Assert(list_length(node->args) == 2);
-
 	/* Always parenthesize the expression. */
 	appendStringInfoChar(buf, '(');
 
@@ -1708,8 +2798,29 @@ deparseScalarArrayOpExpr(ScalarArrayOpExpr *node, deparse_expr_cxt *context)
 	deparseOperatorName(buf, form);
 	appendStringInfo(buf, " %s (", node->useOr ? "ANY" : "ALL");
 
-	/* Deparse right operand. */
+	/*
+	 * Deparse right operand.  A large constant array is sent as a single
+	 * parameter, which spares building, shipping and parsing a literal of
+	 * thousands of elements, and lets the statement be reused for another
+	 * array.  It's bound in its text form without a type, and so read as
+	 * the array type that ANY or ALL calls for.
+	 */
 	arg2 = lsecond(node->args);
+	if (context->params_list && IsA(arg2, Const) &&
+		!((Const *) arg2)->constisnull)
+	{
+		Const	   *c = (Const *) arg2;
+		ArrayType  *arr = DatumGetArrayTypeP(c->constvalue);
+
+		if (context->bind_literals ||
+			ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr)) >=
+			ARRAY_PARAM_MIN_ELEMENTS)
+		{
+			*context->params_list = lappend(*context->params_list, c);
+			printRemoteParam(c->consttype, c->consttypmod, context);
+			arg2 = NULL;
+		}
+	}
 	deparseExpr(arg2, context);
 
 	appendStringInfoChar(buf, ')');
@@ -1727,7 +2838,8 @@ static void
 deparseRelabelType(RelabelType *node, deparse_expr_cxt *context)
 {
 	deparseExpr(node->arg, context);
-	if (node->relabelformat != COERCE_IMPLICIT_CAST)
+	if (node->relabelformat != COERCE_IMPLICIT_CAST &&
+		context->dialect->postgres)
 		appendStringInfo(context->buf, "::%s",
 						 format_type_with_typemod(node->resulttype,
 												  node->resulttypmod));
@@ -1816,22 +2928,287 @@ deparseArrayExpr(ArrayExpr *node, deparse_expr_cxt *context)
 						 format_type_with_typemod(node->array_typeid, -1));
 }
 
+/*
+ * Deparse a CASE expression.
+ */
+static void
+deparseCaseExpr(CaseExpr *node, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	ListCell   *lc;
+
+	appendStringInfoString(buf, "(CASE");
+	if (node->arg != NULL)
+	{
+		appendStringInfoChar(buf, ' ');
+		deparseExpr(node->arg, context);
+	}
+
+	foreach(lc, node->args)
+	{
+		CaseWhen   *cw = (CaseWhen *) lfirst(lc);
+
+		appendStringInfoString(buf, " WHEN ");
+		if (node->arg != NULL)
+		{
+			/* "CaseTestExpr = value", see foreign_expr_walker; print value */
+			deparseExpr(lsecond(((OpExpr *) cw->expr)->args), context);
+		}
+		else
+			deparseExpr(cw->expr, context);
+		appendStringInfoString(buf, " THEN ");
+		deparseExpr(cw->result, context);
+	}
+
+	if (node->defresult != NULL)
+	{
+		appendStringInfoString(buf, " ELSE ");
+		deparseExpr(node->defresult, context);
+	}
+	appendStringInfoString(buf, " END)");
+}
+
+/*
+ * Deparse COALESCE(...).
+ */
+static void
+deparseCoalesceExpr(CoalesceExpr *node, deparse_expr_cxt *context)
+{
+	appendStringInfoString(context->buf, "COALESCE(");
+	deparseExprList(node->args, context);
+	appendStringInfoChar(context->buf, ')');
+}
+
+/*
+ * Deparse NULLIF(a, b).
+ */
+static void
+deparseNullIfExpr(NullIfExpr *node, deparse_expr_cxt *context)
+{
+	Assert(list_length(node->args) == 2);
+
+	appendStringInfoString(context->buf, "NULLIF(");
+	deparseExprList(node->args, context);
+	appendStringInfoChar(context->buf, ')');
+}
+
+/*
+ * Deparse GREATEST(...) or LEAST(...).
+ */
+static void
+deparseMinMaxExpr(MinMaxExpr *node, deparse_expr_cxt *context)
+{
+	appendStringInfoString(context->buf,
+						   node->op == IS_GREATEST ? "GREATEST(" : "LEAST(");
+	deparseExprList(node->args, context);
+	appendStringInfoChar(context->buf, ')');
+}
+
+/*
+ * Deparse a row comparison.  All its operators have the same name, so the
+ * first one is printed.
+ */
+static void
+deparseRowCompareExpr(RowCompareExpr *node, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	Oid			opno = linitial_oid(node->opnos);
+	HeapTuple	tuple;
+
+	tuple = SearchSysCache1(OPEROID, ObjectIdGetDatum(opno));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for operator %u", opno);
+
+	appendStringInfoString(buf, "(ROW(");
+	deparseExprList(node->largs, context);
+	appendStringInfoString(buf, ") ");
+	deparseOperatorName(buf, (Form_pg_operator) GETSTRUCT(tuple));
+	appendStringInfoString(buf, " ROW(");
+	deparseExprList(node->rargs, context);
+	appendStringInfoString(buf, "))");
+
+	ReleaseSysCache(tuple);
+}
+
+/*
+ * Deparse IS [NOT] TRUE, FALSE or UNKNOWN.
+ */
+static void
+deparseBooleanTest(BooleanTest *node, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	const char *test = NULL;	/* keep compiler quiet */
+
+	switch (node->booltesttype)
+	{
+		case IS_TRUE:
+			test = " IS TRUE)";
+			break;
+		case IS_NOT_TRUE:
+			test = " IS NOT TRUE)";
+			break;
+		case IS_FALSE:
+			test = " IS FALSE)";
+			break;
+		case IS_NOT_FALSE:
+			test = " IS NOT FALSE)";
+			break;
+		case IS_UNKNOWN:
+			test = " IS UNKNOWN)";
+			break;
+		case IS_NOT_UNKNOWN:
+			test = " IS NOT UNKNOWN)";
+			break;
+	}
+
+	appendStringInfoChar(buf, '(');
+	deparseExpr(node->arg, context);
+	appendStringInfoString(buf, test);
+}
+
+/*
+ * Deparse a list of expressions, separated by commas.
+ */
+static void
+deparseExprList(List *exprs, deparse_expr_cxt *context)
+{
+	bool		first = true;
+	ListCell   *lc;
+
+	foreach(lc, exprs)
+	{
+		if (!first)
+			appendStringInfoString(context->buf, ", ");
+		deparseExpr((Expr *) lfirst(lc), context);
+		first = false;
+	}
+}
+
+/*
+ * Deparse = ANY or <> ALL as an IN or NOT IN list.  A long list is split
+ * into several, joined by OR or AND, of at most IN_LIST_CHUNK_SIZE elements
+ * each.  The constants of a split list aren't bound even with bind_literals,
+ * as some drivers take only a few thousand parameters, and a statement per
+ * list length wouldn't be reused anyway.
+ */
+static void
+deparseInList(ScalarArrayOpExpr *node, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	Expr	   *arg1 = linitial(node->args);
+	List	   *elements = in_list_elements(lsecond(node->args));
+	bool		chunked = list_length(elements) > IN_LIST_CHUNK_SIZE;
+	bool		save_bind_literals = context->bind_literals;
+	int			n = 0;
+	ListCell   *lc;
+
+	if (chunked)
+		context->bind_literals = false;
+
+	appendStringInfoChar(buf, '(');
+	foreach(lc, elements)
+	{
+		if (n % IN_LIST_CHUNK_SIZE == 0)
+		{
+			if (n > 0)
+				appendStringInfo(buf, ")) %s ", node->useOr ? "OR" : "AND");
+			if (chunked)
+				appendStringInfoChar(buf, '(');
+			deparseExpr(arg1, context);
+			appendStringInfoString(buf, node->useOr ? " IN (" : " NOT IN (");
+		}
+		else
+			appendStringInfoString(buf, ", ");
+		deparseExpr((Expr *) lfirst(lc), context);
+		n++;
+	}
+	appendStringInfoString(buf, chunked ? ")))" : "))");
+
+	context->bind_literals = save_bind_literals;
+}
+
+/*
+ * Return the elements of the array of an IN list, which is either an
+ * ARRAY[...] construct or a constant, as a list of expressions.
+ */
+static List *
+in_list_elements(Expr *node)
+{
+	Const	   *c = (Const *) node;
+	Oid			elemtype;
+	int16		elmlen;
+	bool		elmbyval;
+	char		elmalign;
+	Datum	   *values;
+	bool	   *nulls;
+	int			nvalues;
+	int			i;
+	List	   *elements = NIL;
+
+	if (IsA(node, ArrayExpr))
+		return ((ArrayExpr *) node)->elements;
+
+	Assert(IsA(node, Const) && !c->constisnull);
+
+	elemtype = get_element_type(c->consttype);
+	get_typlenbyvalalign(elemtype, &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(DatumGetArrayTypeP(c->constvalue),
+					  elemtype, elmlen, elmbyval, elmalign,
+					  &values, &nulls, &nvalues);
+	for (i = 0; i < nvalues; i++)
+		elements = lappend(elements,
+						   makeConst(elemtype, -1, c->constcollid, elmlen,
+									 values[i], nulls[i], elmbyval));
+
+	return elements;
+}
+
+/*
+ * Deparse the remote template of a mapped function or operator, with $n
+ * replaced by its nth argument.  The whole is parenthesized, like an
+ * operator expression.
+ */
+static void
+deparseTemplate(const char *template, List *args, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	const char *ptr;
+
+	appendStringInfoChar(buf, '(');
+	for (ptr = template; *ptr; ptr++)
+	{
+		int			argno = 0;
+
+		if (*ptr != '$' || !isdigit((unsigned char) ptr[1]))
+		{
+			appendStringInfoChar(buf, *ptr);
+			continue;
+		}
+
+		while (isdigit((unsigned char) ptr[1]))
+			argno = argno * 10 + (*++ptr - '0');
+		if (argno < 1 || argno > list_length(args))
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+					 errmsg("remote template \"%s\" refers to missing argument $%d",
+							template, argno)));
+		deparseExpr((Expr *) list_nth(args, argno - 1), context);
+	}
+	appendStringInfoChar(buf, ')');
+}
+
 /*
  * Print the representation of a parameter to be sent to the remote side.
  *
- * Note: we always label the Param's type explicitly rather than relying on
- * transmitting a numeric type OID in PQexecParams().  This allows us to
- * avoid assuming that types have the same OIDs on the remote side as they
- * do locally --- they need only have the same names.
+ * This is a plain JDBC "?" marker.  The type of the value is conveyed by the
+ * setter that binds it (see JQprepare), so no cast is needed and the query
+ * also works on servers that don't understand PostgreSQL type names.
  */
 static void
-printRemoteParam(int paramindex, Oid paramtype, int32 paramtypmod,
+printRemoteParam(Oid paramtype, int32 paramtypmod,
 				 deparse_expr_cxt *context)
 {
-	StringInfo	buf = context->buf;
-	char	   *ptypename = format_type_with_typemod(paramtype, paramtypmod);
-
-	appendStringInfo(buf, "$%d::%s", paramindex, ptypename);
+	appendStringInfoChar(context->buf, '?');
 }
 
 /*
@@ -0,0 +1,173 @@
+/*-------------------------------------------------------------------------
+ *
+ * dialect.c
+ *		  SQL dialects of the remote servers for jdbc2_fdw
+ *
+ * deparse.c writes PostgreSQL's own SQL for a PostgreSQL server.  For any
+ * other database it sticks to standard SQL, and consults the server's
+ * dialect for the few things even that can't agree on: identifier quotes,
+ * literals, LIMIT and the placement of NULLs in ORDER BY.
+ *
+ * The dialect comes from the server's dialect option, or failing that from
+ * the subprotocol of its JDBC url.  A server without a url is PostgreSQL,
+ * as it always has been; an unknown url gets the cautious generic dialect.
+ *
+ * Portions Copyright (c) 2012-2014, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/jdbc2_fdw/dialect.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "jdbc2_fdw.h"
+
+#include "commands/defrem.h"
+#include "utils/builtins.h"
+
+
+/*
+ * The known dialects.  The first one is the default.
+ */
+static const JdbcDialect dialects[] = {
+	/*
+	 * name, postgres, quotes, has_boolean, has_distinct_from,
+	 * backslash_escapes, datetime_literals, limit_style, nulls_order
+	 */
+	{"postgresql", true, '"', '"', true, true, false, true,
+	JDBC_LIMIT_LIMIT, JDBC_NULLS_CLAUSE},
+	{"oracle", false, '"', '"', false, false, false, true,
+	JDBC_LIMIT_FETCH_FIRST, JDBC_NULLS_CLAUSE},
+	{"sqlserver", false, '[', ']', false, false, false, false,
+	JDBC_LIMIT_NONE, JDBC_NULLS_LOW},
+	{"mysql", false, '`', '`', true, false, true, true,
+	JDBC_LIMIT_LIMIT, JDBC_NULLS_LOW},
+	{"db2", false, '"', '"', false, true, false, true,
+	JDBC_LIMIT_FETCH_FIRST, JDBC_NULLS_HIGH},
+	{"generic", false, '"', '"', false, false, false, true,
+	JDBC_LIMIT_NONE, JDBC_NULLS_UNKNOWN},
+	{NULL}
+};
+
+/*
+ * JDBC url prefixes of the drivers whose database has a dialect above.
+ */
+static const struct
+{
+	const char *prefix;
+	const char *dialect;
+}	url_dialects[] = {
+	{"jdbc:postgresql:", "postgresql"},
+	{"jdbc:oracle:", "oracle"},
+	{"jdbc:sqlserver:", "sqlserver"},
+	{"jdbc:jtds:sqlserver:", "sqlserver"},
+	{"jdbc:mysql:", "mysql"},
+	{"jdbc:mariadb:", "mysql"},
+	{"jdbc:db2:", "db2"},
+	{NULL, NULL}
+};
+
+
+/*
+ * Convert the value of the dialect option into a JdbcDialect.
+ */
+const JdbcDialect *
+get_dialect(const char *value)
+{
+	const JdbcDialect *dialect;
+	StringInfoData buf;
+
+	for (dialect = dialects; dialect->name; dialect++)
+	{
+		if (strcmp(value, dialect->name) == 0)
+			return dialect;
+	}
+
+	initStringInfo(&buf);
+	for (dialect = dialects; dialect->name; dialect++)
+		appendStringInfo(&buf, "%s\"%s\"",
+						 (buf.len == 0) ? "" :
+						 (dialect[1].name == NULL) ? " and " : ", ",
+						 dialect->name);
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid value for option \"dialect\": \"%s\"", value),
+			 errhint("Valid values are %s.", buf.data)));
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * Return the dialect of the given server.
+ */
+const JdbcDialect *
+GetServerDialect(ForeignServer *server)
+{
+	const char *url = NULL;
+	ListCell   *lc;
+	int			i;
+
+	foreach(lc, server->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "dialect") == 0)
+			return get_dialect(defGetString(def));
+		else if (strcmp(def->defname, "url") == 0)
+			url = defGetString(def);
+	}
+
+	if (url == NULL)
+		return &dialects[0];
+
+	for (i = 0; url_dialects[i].prefix; i++)
+	{
+		if (pg_strncasecmp(url, url_dialects[i].prefix,
+						   strlen(url_dialects[i].prefix)) == 0)
+			return get_dialect(url_dialects[i].dialect);
+	}
+
+	return get_dialect("generic");
+}
+
+/*
+ * Return the dialect of the server of the given foreign table.
+ */
+const JdbcDialect *
+GetRelationDialect(Relation rel)
+{
+	ForeignTable *table = GetForeignTable(RelationGetRelid(rel));
+
+	return GetServerDialect(GetForeignServer(table->serverid));
+}
+
+/*
+ * Quote an identifier if it needs quoting.  That is decided the way
+ * PostgreSQL decides it, which also leaves ordinary lower-case names
+ * unquoted, so that a server which folds unquoted names to upper case
+ * finds its upper-case tables and columns.
+ */
+const char *
+dialect_quote_identifier(const JdbcDialect *dialect, const char *ident)
+{
+	const char *quoted = quote_identifier(ident);
+	StringInfoData buf;
+	const char *ptr;
+
+	if (quoted == ident ||
+		(dialect->quote_open == '"' && dialect->quote_close == '"'))
+		return quoted;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, dialect->quote_open);
+	for (ptr = ident; *ptr; ptr++)
+	{
+		if (*ptr == dialect->quote_close)
+			appendStringInfoChar(&buf, *ptr);
+		appendStringInfoChar(&buf, *ptr);
+	}
+	appendStringInfoChar(&buf, dialect->quote_close);
+
+	return buf.data;
+}
@@ -0,0 +1,142 @@
+/* contrib/jdbc2_fdw/jdbc2_fdw--1.0--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION jdbc2_fdw UPDATE TO '1.1'" to load this file. \quit
+
+-- Remote mapping of local functions and operators, see mapping.c.  Each
+-- row maps a function or an operator to the remote SQL template, with $1,
+-- $2, ... for its arguments, used for one server, for the servers of one
+-- dialect, or for all servers.  Functions and operators are kept as their
+-- schema-qualified signature rather than as OIDs, which dump and upgrade
+-- don't preserve.
+CREATE TABLE jdbc2_fdw_mapping (
+    func        text,
+    op          text,
+    server      name,
+    dialect     text,
+    template    text NOT NULL,
+    CHECK ((func IS NULL) <> (op IS NULL)),
+    CHECK (server IS NULL OR dialect IS NULL)
+);
+CREATE UNIQUE INDEX jdbc2_fdw_mapping_key ON jdbc2_fdw_mapping
+    ((COALESCE(func, op)), (COALESCE(server, '')),
+     (COALESCE(dialect, '')));
+GRANT SELECT ON jdbc2_fdw_mapping TO PUBLIC;
+SELECT pg_catalog.pg_extension_config_dump('jdbc2_fdw_mapping', '');
+
+-- makes all backends reread the table
+CREATE FUNCTION jdbc2_fdw_mapping_invalidate()
+RETURNS trigger
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+CREATE TRIGGER jdbc2_fdw_mapping_invalidate
+    AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON jdbc2_fdw_mapping
+    FOR EACH STATEMENT EXECUTE PROCEDURE jdbc2_fdw_mapping_invalidate();
+
+CREATE FUNCTION jdbc2_fdw_check_mapping(template text, nargs integer,
+                                        server name, dialect text)
+RETURNS void
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    argno integer;
+BEGIN
+    IF server IS NOT NULL AND dialect IS NOT NULL THEN
+        RAISE EXCEPTION 'a mapping is either for a server or for a dialect';
+    END IF;
+    IF server IS NOT NULL AND NOT EXISTS
+        (SELECT 1 FROM pg_catalog.pg_foreign_server s WHERE s.srvname = server)
+    THEN
+        RAISE EXCEPTION 'server "%" does not exist', server;
+    END IF;
+    IF dialect IS NOT NULL THEN
+        PERFORM @extschema@.jdbc2_fdw_validator(ARRAY['dialect=' || dialect],
+            'pg_catalog.pg_foreign_server'::pg_catalog.regclass);
+    END IF;
+    FOR argno IN
+        SELECT m[1]::integer
+          FROM pg_catalog.regexp_matches(template, '\$(\d+)', 'g') AS m
+    LOOP
+        IF argno < 1 OR argno > nargs THEN
+            RAISE EXCEPTION 'template "%" refers to missing argument $%',
+                template, argno;
+        END IF;
+    END LOOP;
+END;
+$$;
+
+-- These run with only pg_catalog in the search_path, so that func and op
+-- are stored schema-qualified.
+CREATE FUNCTION jdbc2_fdw_map_function(func regprocedure, template text,
+                                       server name DEFAULT NULL,
+                                       dialect text DEFAULT NULL)
+RETURNS void
+LANGUAGE plpgsql
+SET search_path = pg_catalog
+AS $$
+BEGIN
+    PERFORM @extschema@.jdbc2_fdw_check_mapping($2,
+        (SELECT p.pronargs FROM pg_catalog.pg_proc p WHERE p.oid = $1),
+        $3, $4);
+    DELETE FROM @extschema@.jdbc2_fdw_mapping m
+     WHERE m.func = $1::text
+       AND m.server IS NOT DISTINCT FROM $3
+       AND m.dialect IS NOT DISTINCT FROM $4;
+    INSERT INTO @extschema@.jdbc2_fdw_mapping (func, server, dialect, template)
+        VALUES ($1::text, $3, $4, $2);
+END;
+$$;
+
+CREATE FUNCTION jdbc2_fdw_map_operator(op regoperator, template text,
+                                       server name DEFAULT NULL,
+                                       dialect text DEFAULT NULL)
+RETURNS void
+LANGUAGE plpgsql
+SET search_path = pg_catalog
+AS $$
+BEGIN
+    PERFORM @extschema@.jdbc2_fdw_check_mapping($2,
+        (SELECT CASE o.oprkind WHEN 'b' THEN 2 ELSE 1 END
+           FROM pg_catalog.pg_operator o WHERE o.oid = $1),
+        $3, $4);
+    DELETE FROM @extschema@.jdbc2_fdw_mapping m
+     WHERE m.op = $1::text
+       AND m.server IS NOT DISTINCT FROM $3
+       AND m.dialect IS NOT DISTINCT FROM $4;
+    INSERT INTO @extschema@.jdbc2_fdw_mapping (op, server, dialect, template)
+        VALUES ($1::text, $3, $4, $2);
+END;
+$$;
+
+CREATE FUNCTION jdbc2_fdw_unmap_function(func regprocedure,
+                                         server name DEFAULT NULL,
+                                         dialect text DEFAULT NULL)
+RETURNS boolean
+LANGUAGE plpgsql
+SET search_path = pg_catalog
+AS $$
+BEGIN
+    DELETE FROM @extschema@.jdbc2_fdw_mapping m
+     WHERE m.func = $1::text
+       AND m.server IS NOT DISTINCT FROM $2
+       AND m.dialect IS NOT DISTINCT FROM $3;
+    RETURN FOUND;
+END;
+$$;
+
+CREATE FUNCTION jdbc2_fdw_unmap_operator(op regoperator,
+                                         server name DEFAULT NULL,
+                                         dialect text DEFAULT NULL)
+RETURNS boolean
+LANGUAGE plpgsql
+SET search_path = pg_catalog
+AS $$
+BEGIN
+    DELETE FROM @extschema@.jdbc2_fdw_mapping m
+     WHERE m.op = $1::text
+       AND m.server IS NOT DISTINCT FROM $2
+       AND m.dialect IS NOT DISTINCT FROM $3;
+    RETURN FOUND;
+END;
+$$;
@@ -31,11 +31,13 @@
 #include "optimizer/prep.h"
 #include "optimizer/restrictinfo.h"
 #include "optimizer/var.h"
+#include "parser/parse_relation.h"
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/tuplestore.h"
 #include "utils/elog.h"
 
 
@@ -57,38 +59,16 @@ PG_MODULE_MAGIC;
 #define DEFAULT_FDW_TUPLE_COST      0.01
 
 /*
- * FDW-specific planner information kept in RelOptInfo.fdw_private for a
- * foreign table.  This information is collected by jdbcGetForeignRelSize.
+ * Default factor by which the cost of a sorted remote scan exceeds the cost
+ * of an unsorted one, when there is no remote estimate to tell.
  */
-typedef struct PgFdwRelationInfo
-{
-    /* baserestrictinfo clauses, broken down into safe and unsafe subsets. */
-    List       *remote_conds;
-    List       *local_conds;
-
-    /* Bitmap of attr numbers we need to fetch from the remote server. */
-    Bitmapset  *attrs_used;
-
-    /* Cost and selectivity of local_conds. */
-    QualCost    local_conds_cost;
-    Selectivity local_conds_sel;
-
-    /* Estimated size and cost for a scan with baserestrictinfo quals. */
-    double      rows;
-    int         width;
-    Cost        startup_cost;
-    Cost        total_cost;
+#define DEFAULT_FDW_SORT_MULTIPLIER 1.2
 
-    /* Options extracted from catalogs. */
-    bool        use_remote_estimate;
-    Cost        fdw_startup_cost;
-    Cost        fdw_tuple_cost;
+/* Default number of rows transferred from JDBCUtils in one batch. */
+#define DEFAULT_FDW_FETCH_SIZE      1000
 
-    /* Cached catalog information. */
-    ForeignTable *table;
-    ForeignServer *server;
-    UserMapping *user;          /* only set in use_remote_estimate mode */
-} PgFdwRelationInfo;
+/* Bytes of COPY data collected before they are sent to the remote server */
+#define COPY_BUFFER_SIZE            (1024 * 1024)
 
 /*
  * Indexes of FDW-private information stored in fdw_private lists.
@@ -98,6 +78,12 @@ typedef struct PgFdwRelationInfo
  *
  * 1) SELECT statement text to be sent to the remote server
  * 2) Integer list of attribute numbers retrieved by the SELECT
+ * 3) Number of rows to fetch from the remote server in one batch
+ * 4) Transfer mode used for the batches
+ * 5) Byte budget of a batch, when the batch size adapts to the row width
+ * 6) Number of rows after which the scan can stop, or 0 for all of them
+ * 7) Boolean flag showing if the statement is an UPDATE or DELETE that the
+ *    scan runs in place of the ModifyTable node above it
  *
  * These items are indexed with the enum FdwScanPrivateIndex, so an item
  * can be fetched with list_nth().  For example, to get the SELECT statement:
@@ -108,7 +94,17 @@ enum FdwScanPrivateIndex
     /* SQL statement to execute remotely (as a String node) */
     FdwScanPrivateSelectSql,
     /* Integer list of attribute numbers retrieved by the SELECT */
-    FdwScanPrivateRetrievedAttrs
+    FdwScanPrivateRetrievedAttrs,
+    /* Batch size (as an integer Value node) */
+    FdwScanPrivateFetchSize,
+    /* JtransferMode of the batches (as an integer Value node) */
+    FdwScanPrivateTransferMode,
+    /* Byte budget per batch, or 0 (as an integer Value node) */
+    FdwScanPrivateFetchBytes,
+    /* Row limit of the scan, or 0 (as an integer Value node) */
+    FdwScanPrivateMaxRows,
+    /* direct-modify flag (as an integer Value node) */
+    FdwScanPrivateDirectModify
 };
 
 /*
@@ -120,6 +116,9 @@ enum FdwScanPrivateIndex
  *    (NIL for a DELETE)
  * 3) Boolean flag showing if the remote query has a RETURNING clause
  * 4) Integer list of attribute numbers retrieved by RETURNING, if any
+ * 5) Boolean flag showing if the ForeignScan below runs the whole statement
+ * 6) Integer list of the key attribute numbers identifying the remote row
+ *    of an UPDATE/DELETE (NIL to use the ctid)
  */
 enum FdwModifyPrivateIndex
 {
@@ -130,7 +129,11 @@ enum FdwModifyPrivateIndex
     /* has-returning flag (as an integer Value node) */
     FdwModifyPrivateHasReturning,
     /* Integer list of attribute numbers retrieved by RETURNING */
-    FdwModifyPrivateRetrievedAttrs
+    FdwModifyPrivateRetrievedAttrs,
+    /* direct-modify flag (as an integer Value node) */
+    FdwModifyPrivateDirectModify,
+    /* Integer list of key attribute numbers for UPDATE/DELETE */
+    FdwModifyPrivateKeyAttnums
 };
 
 /*
@@ -149,19 +152,36 @@ typedef struct PgFdwScanState
     Jconn     *conn;           /* connection for the scan */
     unsigned int cursor_number; /* quasi-unique ID for my cursor */
     bool         cursor_exists; /* have we created the cursor? */
+    jdbcFdwExecutionState cursor;   /* execution state of the cursor */
+    char        *p_name;        /* name of prepared query, if created */
     int          numParams;     /* number of parameters passed to query */
+    Oid         *param_types;   /* local types of the parameters */
     FmgrInfo   *param_flinfo;   /* output conversion functions for them */
     List       *param_exprs;    /* executable expressions for param values */
     const char **param_values;  /* textual values of query parameters */
 
     /* for storing result tuples */
-    HeapTuple  *tuples;         /* array of currently-retrieved tuples */
-    int         num_tuples;     /* # of tuples in array */
+    Jresult    *batch;          /* currently-retrieved batch of rows */
+    int         num_tuples;     /* # of rows in batch */
     int         next_tuple;     /* index of next one to return */
+    bool        retrieves_ctid; /* need heap tuples to carry the ctid */
+    bool        direct_modify;  /* query is an UPDATE/DELETE, run just once */
 
     /* batch-level state, for optimizing rewinds and avoiding useless fetch */
     int     fetch_ct_2;     /* Min(# of fetches done, 2) */
     bool        eof_reached;    /* true if last fetch reached EOF */
+    int         fetch_size;     /* number of rows to fetch in one batch */
+    int         fetch_bytes;    /* if > 0, resize batches to this many bytes */
+    int         max_rows;       /* if > 0, no more rows are needed */
+    int         rows_fetched;   /* rows fetched since the cursor was opened */
+    JtransferMode transfer_mode;    /* how batches cross the JNI boundary */
+    Oid        *retrieved_types;    /* local type of each result column */
+
+    /* rescan cache, replaying a whole pass instead of querying again */
+    Tuplestorestate *rescan_store;  /* spooled rows, NULL until needed */
+    bool        rescan_spool;   /* spooling the rows of this pass? */
+    bool        rescan_ready;   /* rescan_store holds a complete pass */
+    bool        replaying;      /* returning rows from rescan_store */
 
     /* working memory contexts */
     MemoryContext batch_cxt;    /* context holding current batch of tuples */
@@ -181,16 +201,26 @@ typedef struct PgFdwModifyState
     char       *p_name;         /* name of prepared statement, if created */
 
     /* extracted fdw_private data */
+    CmdType     operation;      /* INSERT, UPDATE or DELETE */
     char       *query;          /* text of INSERT/UPDATE/DELETE command */
     List       *target_attrs;   /* list of target attribute numbers */
     bool        has_returning;  /* is there a RETURNING clause? */
     List       *retrieved_attrs;    /* attr numbers retrieved by RETURNING */
 
     /* info about parameters for prepared statement */
-    AttrNumber  ctidAttno;      /* attnum of input resjunk ctid column */
+    List       *key_attrs;      /* key attribute numbers, NIL to use ctid */
+    int         num_row_ids;    /* number of resjunk row identity columns */
+    AttrNumber *rowIdAttnos;    /* their attnums: ctid or key columns */
     int         p_nums;         /* number of parameters to transmit */
+    Oid        *p_types;        /* local types of the parameters */
     FmgrInfo   *p_flinfo;       /* output conversion functions for them */
 
+    /* batching of inserts */
+    int         batch_size;     /* rows sent per round trip, 1 if not batched */
+    int         num_batched;    /* rows added to the batch and not yet sent */
+    char       *copy_query;     /* COPY command for inserts, or NULL */
+    StringInfoData copy_buf;    /* COPY data not yet sent */
+
     /* working memory context */
     MemoryContext temp_cxt;     /* context for per-tuple temporary data */
 } PgFdwModifyState;
@@ -300,9 +330,12 @@ static bool postgresAnalyzeForeignTable(Relation relation,
 /*
  * Helper functions
  */
+static int get_remote_row_limit(PlannerInfo *root, RelOptInfo *baserel,
+                     ForeignPath *best_path, List *local_exprs);
 static void estimate_path_cost_size(PlannerInfo *root,
                         RelOptInfo *baserel,
                         List *join_conds,
+                        List *pathkeys,
                         double *p_rows, int *p_width,
                         Cost *p_startup_cost, Cost *p_total_cost);
 static void get_remote_estimate(const char *sql,
@@ -314,12 +347,24 @@ static void get_remote_estimate(const char *sql,
 static bool ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
                           EquivalenceClass *ec, EquivalenceMember *em,
                           void *arg);
+static void convert_query_params(ForeignScanState *node);
 static void create_cursor(ForeignScanState *node);
+static void execute_direct_modify(ForeignScanState *node);
+static void start_rescan_spool(ForeignScanState *node);
 static void fetch_more_data(ForeignScanState *node);
-static void close_cursor(Jconn *conn, unsigned int cursor_number);
+static void close_cursor(Jconn *conn, jdbcFdwExecutionState *cursor);
+static bool plan_direct_modify(PlannerInfo *root, ModifyTable *plan,
+                   Index resultRelation, int subplan_index,
+                   Relation rel, List *targetAttrs);
 static void prepare_foreign_modify(PgFdwModifyState *fmstate);
+static void add_to_foreign_batch(PgFdwModifyState *fmstate,
+                     const char **p_values);
+static void execute_foreign_batch(PgFdwModifyState *fmstate);
+static void append_copy_row(StringInfo buf, int nParams,
+                const char *const *paramValues);
+static void execute_foreign_copy(PgFdwModifyState *fmstate);
 static const char **convert_prep_stmt_params(PgFdwModifyState *fmstate,
-                         ItemPointer tupleid,
+                         TupleTableSlot *planSlot,
                          TupleTableSlot *slot);
 static void store_returning_result(PgFdwModifyState *fmstate,
                        TupleTableSlot *slot, Jresult *res);
@@ -335,6 +380,14 @@ static HeapTuple make_tuple_from_result_row(Jresult *res,
                            AttInMetadata *attinmeta,
                            List *retrieved_attrs,
                            MemoryContext temp_context);
+static ItemPointer convert_result_row(Jresult *res,
+                   int row,
+                   Relation rel,
+                   AttInMetadata *attinmeta,
+                   List *retrieved_attrs,
+                   Datum *values,
+                   bool *nulls);
+static Oid *get_retrieved_types(Relation rel, List *retrieved_attrs);
 static void conversion_error_callback(void *arg);
 
 
@@ -403,6 +456,7 @@ jdbcGetForeignRelSize(PlannerInfo *root,
     /* Look up foreign-table catalog info. */
     fpinfo->table = GetForeignTable(foreigntableid);
     fpinfo->server = GetForeignServer(fpinfo->table->serverid);
+    fpinfo->dialect = GetServerDialect(fpinfo->server);
 
     /*
      * Extract user-settable option values.  Note that per-table setting of
@@ -411,6 +465,11 @@ jdbcGetForeignRelSize(PlannerInfo *root,
     fpinfo->use_remote_estimate = false;
     fpinfo->fdw_startup_cost = DEFAULT_FDW_STARTUP_COST;
     fpinfo->fdw_tuple_cost = DEFAULT_FDW_TUPLE_COST;
+    fpinfo->fetch_size = DEFAULT_FDW_FETCH_SIZE;
+    fpinfo->fetch_bytes = 0;
+    fpinfo->transfer_mode = JQ_TRANSFER_TEXT;
+    fpinfo->bind_literals = false;
+    fpinfo->collation_compatible = false;
 
     foreach(lc, fpinfo->server->options)
     {
@@ -422,18 +481,39 @@ jdbcGetForeignRelSize(PlannerInfo *root,
             fpinfo->fdw_startup_cost = strtod(defGetString(def), NULL);
         else if (strcmp(def->defname, "fdw_tuple_cost") == 0)
             fpinfo->fdw_tuple_cost = strtod(defGetString(def), NULL);
+        else if (strcmp(def->defname, "fetch_size") == 0)
+            fpinfo->fetch_size = strtol(defGetString(def), NULL, 10);
+        else if (strcmp(def->defname, "fetch_bytes") == 0)
+            fpinfo->fetch_bytes = strtol(defGetString(def), NULL, 10);
+        else if (strcmp(def->defname, "transfer_mode") == 0)
+            fpinfo->transfer_mode = get_transfer_mode(defGetString(def));
+        else if (strcmp(def->defname, "bind_literals") == 0)
+            fpinfo->bind_literals = defGetBoolean(def);
+        else if (strcmp(def->defname, "collation_compatible") == 0)
+            fpinfo->collation_compatible = defGetBoolean(def);
     }
     foreach(lc, fpinfo->table->options)
     {
         DefElem    *def = (DefElem *) lfirst(lc);
 
         if (strcmp(def->defname, "use_remote_estimate") == 0)
-        {
             fpinfo->use_remote_estimate = defGetBoolean(def);
-            break;              /* only need the one value */
-        }
+        else if (strcmp(def->defname, "fetch_size") == 0)
+            fpinfo->fetch_size = strtol(defGetString(def), NULL, 10);
+        else if (strcmp(def->defname, "fetch_bytes") == 0)
+            fpinfo->fetch_bytes = strtol(defGetString(def), NULL, 10);
+        else if (strcmp(def->defname, "transfer_mode") == 0)
+            fpinfo->transfer_mode = get_transfer_mode(defGetString(def));
+        else if (strcmp(def->defname, "bind_literals") == 0)
+            fpinfo->bind_literals = defGetBoolean(def);
+        else if (strcmp(def->defname, "collation_compatible") == 0)
+            fpinfo->collation_compatible = defGetBoolean(def);
     }
 
+    /* Remote estimates come from PostgreSQL's EXPLAIN */
+    if (!fpinfo->dialect->postgres)
+        fpinfo->use_remote_estimate = false;
+
     /*
      * If the table or the server is configured to use remote estimates,
      * identify which user to do remote access as during planning.  This
@@ -503,7 +583,7 @@ jdbcGetForeignRelSize(PlannerInfo *root,
          * values in fpinfo so we don't need to do it again to generate the
          * basic foreign path.
          */
-        estimate_path_cost_size(root, baserel, NIL,
+        estimate_path_cost_size(root, baserel, NIL, NIL,
                                 &fpinfo->rows, &fpinfo->width,
                                 &fpinfo->startup_cost, &fpinfo->total_cost);
 
@@ -533,7 +613,7 @@ jdbcGetForeignRelSize(PlannerInfo *root,
         set_baserel_size_estimates(root, baserel);
 
         /* Fill in basically-bogus cost estimates for use later. */
-        estimate_path_cost_size(root, baserel, NIL,
+        estimate_path_cost_size(root, baserel, NIL, NIL,
                                 &fpinfo->rows, &fpinfo->width,
                                 &fpinfo->startup_cost, &fpinfo->total_cost);
     }
@@ -552,6 +632,8 @@ jdbcGetForeignPaths(PlannerInfo *root,
 
 	PgFdwRelationInfo *fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
     ForeignPath *path;
+    List       *ppi_list;
+    ListCell   *lc;
 
     /*
      * Create simplest ForeignScan path node and add it to baserel.  This path
@@ -570,9 +652,211 @@ jdbcGetForeignPaths(PlannerInfo *root,
     add_path(baserel, (Path *) path);
 
     /*
-     * We're not using remote estimates, so we stop here.
+     * Pushing the query_pathkeys to the remote server is worth considering,
+     * because it might let us avoid a local sort; the remote server often
+     * has an index to deliver the rows in that order.  The planner can't
+     * make use of data sorted by a prefix of the query's pathkeys, it would
+     * sort the whole data set again, so all of them must be pushed down.
+     */
+    if (root->query_pathkeys)
+    {
+        bool        query_pathkeys_ok = true;
+
+        foreach(lc, root->query_pathkeys)
+        {
+            PathKey    *pathkey = (PathKey *) lfirst(lc);
+
+            if (!is_foreign_pathkey(root, baserel, pathkey))
+            {
+                query_pathkeys_ok = false;
+                break;
+            }
+        }
+
+        if (query_pathkeys_ok)
+        {
+            List       *pathkeys = list_copy(root->query_pathkeys);
+            double      rows;
+            int         width;
+            Cost        startup_cost;
+            Cost        total_cost;
+
+            estimate_path_cost_size(root, baserel, NIL, pathkeys,
+                                    &rows, &width,
+                                    &startup_cost, &total_cost);
+            path = create_foreignscan_path(root, baserel,
+                                           rows,
+                                           startup_cost,
+                                           total_cost,
+                                           pathkeys,
+                                           NULL,    /* no outer rel */
+                                           NIL);    /* no fdw_private list */
+            add_path(baserel, (Path *) path);
+        }
+    }
+
+    /*
+     * Thumb through all join clauses for the rel to identify which outer
+     * relations could supply one or more safe-to-send-to-remote join clauses.
+     * We'll build a parameterized path for each such outer relation.  In a
+     * nested loop, such a path sends one execution of the prepared remote
+     * query per outer row, which beats a full remote scan when the outer
+     * side is small and the foreign table is large.
+     *
+     * It's convenient to manage this by representing each candidate outer
+     * relation by the ParamPathInfo node for it.  We can then use the
+     * ppi_clauses list in the ParamPathInfo node directly as a list of the
+     * interesting join clauses for that rel.  This takes care of the
+     * possibility that there are multiple safe join clauses for such a rel,
+     * and also ensures that we account for unsafe join clauses that we'll
+     * still have to enforce locally (since the parameterized-path machinery
+     * insists that we handle all movable clauses).
+     */
+    ppi_list = NIL;
+    foreach(lc, baserel->joininfo)
+    {
+        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+        Relids      required_outer;
+        ParamPathInfo *param_info;
+
+        /* Check if clause can be moved to this rel */
+        if (!join_clause_is_movable_to(rinfo, baserel))
+            continue;
+
+        /* See if it is safe to send to remote */
+        if (!is_foreign_expr(root, baserel, rinfo->clause))
+            continue;
+
+        /* Calculate required outer rels for the resulting path */
+        required_outer = bms_union(rinfo->clause_relids,
+                                   baserel->lateral_relids);
+        /* We do not want the foreign rel itself listed in required_outer */
+        required_outer = bms_del_member(required_outer, baserel->relid);
+
+        /*
+         * required_outer probably can't be empty here, but if it were, we
+         * couldn't make a parameterized path.
+         */
+        if (bms_is_empty(required_outer))
+            continue;
+
+        /* Get the ParamPathInfo */
+        param_info = get_baserel_parampathinfo(root, baserel,
+                                               required_outer);
+        Assert(param_info != NULL);
+
+        /*
+         * Add it to list unless we already have it.  Testing pointer equality
+         * is OK since get_baserel_parampathinfo won't make duplicates.
+         */
+        ppi_list = list_append_unique_ptr(ppi_list, param_info);
+    }
+
+    /*
+     * The above scan examined only "generic" join clauses, not those that
+     * were absorbed into EquivalenceClauses.  See if we can make anything out
+     * of EquivalenceClauses.
+     */
+    if (baserel->has_eclass_joins)
+    {
+        /*
+         * We repeatedly scan the eclass list looking for column references
+         * (or expressions) belonging to the foreign rel.  Each time we find
+         * one, we generate a list of equivalence joinclauses for it, and then
+         * see if any are safe to send to the remote.  Repeat till there are
+         * no more candidate EC members.
+         */
+        ec_member_foreign_arg arg;
+
+        arg.already_used = NIL;
+        for (;;)
+        {
+            List       *clauses;
+
+            /* Make clauses, skipping any that join to lateral_referencers */
+            arg.current = NULL;
+            clauses = generate_implied_equalities_for_column(root,
+                                                             baserel,
+                                                   ec_member_matches_foreign,
+                                                             (void *) &arg,
+                                               baserel->lateral_referencers);
+
+            /* Done if there are no more expressions in the foreign rel */
+            if (arg.current == NULL)
+            {
+                Assert(clauses == NIL);
+                break;
+            }
+
+            /* Scan the extracted join clauses */
+            foreach(lc, clauses)
+            {
+                RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+                Relids      required_outer;
+                ParamPathInfo *param_info;
+
+                /* Check if clause can be moved to this rel */
+                if (!join_clause_is_movable_to(rinfo, baserel))
+                    continue;
+
+                /* See if it is safe to send to remote */
+                if (!is_foreign_expr(root, baserel, rinfo->clause))
+                    continue;
+
+                /* Calculate required outer rels for the resulting path */
+                required_outer = bms_union(rinfo->clause_relids,
+                                           baserel->lateral_relids);
+                required_outer = bms_del_member(required_outer, baserel->relid);
+                if (bms_is_empty(required_outer))
+                    continue;
+
+                /* Get the ParamPathInfo */
+                param_info = get_baserel_parampathinfo(root, baserel,
+                                                       required_outer);
+                Assert(param_info != NULL);
+
+                /* Add it to list unless we already have it */
+                ppi_list = list_append_unique_ptr(ppi_list, param_info);
+            }
+
+            /* Try again, now ignoring the expression we found this time */
+            arg.already_used = lappend(arg.already_used, arg.current);
+        }
+    }
+
+    /*
+     * Now build a path for each useful outer relation.
      */
-    return;
+    foreach(lc, ppi_list)
+    {
+        ParamPathInfo *param_info = (ParamPathInfo *) lfirst(lc);
+        double      rows;
+        int         width;
+        Cost        startup_cost;
+        Cost        total_cost;
+
+        /* Get a cost estimate, from the remote server if so configured */
+        estimate_path_cost_size(root, baserel,
+                                param_info->ppi_clauses, NIL,
+                                &rows, &width,
+                                &startup_cost, &total_cost);
+
+        /*
+         * ppi_rows currently won't get looked at by anything, but still we
+         * may as well ensure that it matches our idea of the rowcount.
+         */
+        param_info->ppi_rows = rows;
+
+        /* Make the path */
+        path = create_foreignscan_path(root, baserel,
+                                       rows,
+                                       startup_cost,
+                                       total_cost,
+                                       NIL,     /* no pathkeys */
+                                       param_info->ppi_req_outer,
+                                       NIL);    /* no fdw_private list */
+        add_path(baserel, (Path *) path);
+    }
 }
 
 /*
@@ -595,6 +879,7 @@ jdbcGetForeignPlan(PlannerInfo *root,
     List       *local_exprs = NIL;
     List       *params_list = NIL;
     List       *retrieved_attrs;
+    int         max_rows;
     StringInfoData sql;
     ListCell   *lc;
 
@@ -649,6 +934,17 @@ jdbcGetForeignPlan(PlannerInfo *root,
 		appendWhereClause(&sql, root, baserel, remote_conds,
 		true, &params_list);
 	}
+
+    /* Add ORDER BY clause if we found any useful pathkeys */
+    if (best_path->path.pathkeys)
+        appendOrderByClause(&sql, root, baserel, best_path->path.pathkeys);
+
+    /*
+     * Let the remote server know how many rows we'll want, so it can plan
+     * for fetching just those.  This is never combined with FOR UPDATE.
+     */
+    max_rows = get_remote_row_limit(root, baserel, best_path, local_exprs);
+    appendLimitClause(&sql, baserel, max_rows);
     ereport(DEBUG3, (errmsg("SQL: %s",sql.data)));
     /*
      * Add FOR UPDATE/SHARE if appropriate.  We apply locking during the
@@ -700,8 +996,13 @@ jdbcGetForeignPlan(PlannerInfo *root,
      * Build the fdw_private list that will be available to the executor.
      * Items in the list must match enum FdwScanPrivateIndex, above.
      */
-    fdw_private = list_make2(makeString(sql.data),
-                             retrieved_attrs);
+    fdw_private = list_make4(makeString(sql.data),
+                             retrieved_attrs,
+                             makeInteger(fpinfo->fetch_size),
+                             makeInteger(fpinfo->transfer_mode));
+    fdw_private = lappend(fdw_private, makeInteger(fpinfo->fetch_bytes));
+    fdw_private = lappend(fdw_private, makeInteger(max_rows));
+    fdw_private = lappend(fdw_private, makeInteger(false));
 
 //ereport(ERROR, (errmsg("\"fdw_private = %s\"\n",nodeToString(fdw_private))));
     /*
@@ -783,6 +1084,18 @@ jdbcBeginForeignScan(ForeignScanState *node, int eflags)
                                      FdwScanPrivateSelectSql));
     fsstate->retrieved_attrs = (List *) list_nth(fsplan->fdw_private,
                                                FdwScanPrivateRetrievedAttrs);
+    fsstate->retrieves_ctid = list_member_int(fsstate->retrieved_attrs,
+                                              SelfItemPointerAttributeNumber);
+    fsstate->fetch_size = intVal(list_nth(fsplan->fdw_private,
+                                          FdwScanPrivateFetchSize));
+    fsstate->transfer_mode = intVal(list_nth(fsplan->fdw_private,
+                                             FdwScanPrivateTransferMode));
+    fsstate->fetch_bytes = intVal(list_nth(fsplan->fdw_private,
+                                           FdwScanPrivateFetchBytes));
+    fsstate->max_rows = intVal(list_nth(fsplan->fdw_private,
+                                        FdwScanPrivateMaxRows));
+    fsstate->direct_modify = intVal(list_nth(fsplan->fdw_private,
+                                             FdwScanPrivateDirectModify));
 
     /* Create contexts for batches of tuples and per-tuple temp workspace. */
     fsstate->batch_cxt = AllocSetContextCreate(estate->es_query_cxt,
@@ -798,11 +1111,15 @@ jdbcBeginForeignScan(ForeignScanState *node, int eflags)
 
     /* Get info we'll need for input data conversion. */
     fsstate->attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(fsstate->rel));
+    if (fsstate->transfer_mode != JQ_TRANSFER_TEXT)
+        fsstate->retrieved_types = get_retrieved_types(fsstate->rel,
+                                                     fsstate->retrieved_attrs);
 
     /* Prepare for output conversion of parameters used in remote query. */
     numParams = list_length(fsplan->fdw_exprs);
     fsstate->numParams = numParams;
     fsstate->param_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * numParams);
+    fsstate->param_types = (Oid *) palloc0(sizeof(Oid) * numParams);
 
     i = 0;
     foreach(lc, fsplan->fdw_exprs)
@@ -811,7 +1128,8 @@ jdbcBeginForeignScan(ForeignScanState *node, int eflags)
         Oid         typefnoid;
         bool        isvarlena;
 
-        getTypeOutputInfo(exprType(param_expr), &typefnoid, &isvarlena);
+        fsstate->param_types[i] = exprType(param_expr);
+        getTypeOutputInfo(fsstate->param_types[i], &typefnoid, &isvarlena);
         fmgr_info(typefnoid, &fsstate->param_flinfo[i]);
         i++;
     }
@@ -835,7 +1153,13 @@ jdbcBeginForeignScan(ForeignScanState *node, int eflags)
         fsstate->param_values = (const char **) palloc0(numParams * sizeof(char *));
     else
         fsstate->param_values = NULL;
-    (void)JQexec(fsstate->conn, fsstate->query);
+
+    /*
+     * If the planner expects us to be rescanned, keep the rows of the first
+     * pass right away.  Otherwise spooling waits for the first rescan.
+     */
+    if (eflags & EXEC_FLAG_REWIND)
+        start_rescan_spool(node);
 }
 
 /*
@@ -847,10 +1171,97 @@ static TupleTableSlot *
 jdbcIterateForeignScan(ForeignScanState *node)
 {
     PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
-    TupleTableSlot *slot;
+    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+    /*
+     * An UPDATE or DELETE is run once, on the first call, and returns no
+     * rows for the ModifyTable node to process.
+     */
+    if (fsstate->direct_modify)
+    {
+        if (!fsstate->eof_reached)
+            execute_direct_modify(node);
+        return ExecClearTuple(slot);
+    }
+
+    /* Replay a spooled pass without going to the remote server. */
+    if (fsstate->replaying)
+    {
+        if (!tuplestore_gettupleslot(fsstate->rescan_store, true, false, slot))
+            return ExecClearTuple(slot);
+        return slot;
+    }
+
+    /*
+     * If this is the first call after Begin or ReScan, we need to create the
+     * cursor on the remote side.
+     */
+    if (!fsstate->cursor_exists)
+        create_cursor(node);
+
+    /*
+     * Get some more tuples, if we've run out.
+     */
+    if (fsstate->next_tuple >= fsstate->num_tuples)
+    {
+        /* No point in another fetch if we already detected EOF, though. */
+        if (!fsstate->eof_reached)
+            fetch_more_data(node);
+        /* If we didn't get any tuples, must be end of data. */
+        if (fsstate->next_tuple >= fsstate->num_tuples)
+        {
+            /* The whole pass is spooled now, rescans can replay it */
+            if (fsstate->rescan_spool)
+            {
+                fsstate->rescan_spool = false;
+                fsstate->rescan_ready = true;
+            }
+            return ExecClearTuple(slot);
+        }
+    }
+
+    /*
+     * Return the next tuple.  A ctid can only be returned in a heap tuple,
+     * otherwise the retrieved columns are converted straight into the
+     * slot's arrays and the heap tuple formation is skipped.
+     */
+    if (fsstate->retrieves_ctid)
+    {
+        MemoryContext oldcontext = MemoryContextSwitchTo(fsstate->batch_cxt);
+        HeapTuple   tuple;
+
+        tuple = make_tuple_from_result_row(fsstate->batch,
+                                           fsstate->next_tuple++,
+                                           fsstate->rel,
+                                           fsstate->attinmeta,
+                                           fsstate->retrieved_attrs,
+                                           fsstate->temp_cxt);
+        MemoryContextSwitchTo(oldcontext);
+        ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+    }
+    else
+    {
+        MemoryContext oldcontext;
+
+        ExecClearTuple(slot);
+        /* The previous row's values are no longer referenced by the slot */
+        MemoryContextReset(fsstate->temp_cxt);
+        oldcontext = MemoryContextSwitchTo(fsstate->temp_cxt);
+        (void) convert_result_row(fsstate->batch,
+                                  fsstate->next_tuple++,
+                                  fsstate->rel,
+                                  fsstate->attinmeta,
+                                  fsstate->retrieved_attrs,
+                                  slot->tts_values,
+                                  slot->tts_isnull);
+        MemoryContextSwitchTo(oldcontext);
+        ExecStoreVirtualTuple(slot);
+    }
+
+    if (fsstate->rescan_spool)
+        tuplestore_puttupleslot(fsstate->rescan_store, slot);
 
-    slot = JQiterate(fsstate->conn, node);
-    return node->ss.ss_ScanTupleSlot;
+    return slot;
 }
 
 /*
@@ -862,48 +1273,55 @@ postgresReScanForeignScan(ForeignScanState *node)
 {
     ereport(DEBUG3, (errmsg("In postgresReScanForeignScan")));
 	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
-    char        sql[64];
-    Jresult   *res;
+
+    /*
+     * If a complete pass was spooled and the remote query can't have
+     * changed, replay it rather than running the query again.  Parameters
+     * used only by local quals don't change the rows we'd get back.
+     */
+    if (fsstate->rescan_ready &&
+        (node->ss.ps.chgParam == NULL || fsstate->numParams == 0))
+    {
+        if (fsstate->cursor_exists)
+        {
+            close_cursor(fsstate->conn, &fsstate->cursor);
+            fsstate->cursor_exists = false;
+        }
+        tuplestore_rescan(fsstate->rescan_store);
+        fsstate->replaying = true;
+        return;
+    }
+
+    /*
+     * Otherwise the spooled rows are stale or incomplete.  Start over, and
+     * keep the rows of the coming pass for the next rescan.
+     */
+    fsstate->replaying = false;
+    start_rescan_spool(node);
 
     /* If we haven't created the cursor yet, nothing to do. */
     if (!fsstate->cursor_exists)
         return;
 
     /*
-     * If any internal parameters affecting this node have changed, we'd
-     * better destroy and recreate the cursor.  Otherwise, rewinding it should
-     * be good enough.  If we've only fetched zero or one batch, we needn't
-     * even rewind the cursor, just rescan what we have.
+     * If any internal parameters affecting this node have changed, or we
+     * have fetched more than one batch, we'd better close the statement and
+     * execute the query again: a JDBC result set can't be rewound.  If
+     * we've only fetched zero or one batch, we needn't even do that, just
+     * rescan what we have.
      */
-    if (node->ss.ps.chgParam != NULL)
-    {
-        fsstate->cursor_exists = false;
-        snprintf(sql, sizeof(sql), "CLOSE c%u",
-                 fsstate->cursor_number);
-    }
-    else if (fsstate->fetch_ct_2 > 1)
-    {
-        snprintf(sql, sizeof(sql), "MOVE BACKWARD ALL IN c%u",
-                 fsstate->cursor_number);
-    }
-    else
+    if (node->ss.ps.chgParam == NULL && fsstate->fetch_ct_2 <= 1)
     {
         /* Easy: just rescan what we already have in memory, if anything */
         fsstate->next_tuple = 0;
         return;
     }
 
-    /*
-     * We don't use a PG_TRY block here, so be careful not to throw error
-     * without releasing the Jresult.
-     */
-    res = JQexec(fsstate->conn, sql);
-    if (JQresultStatus(res) != PGRES_COMMAND_OK)
-        pgfdw_report_error(ERROR, res, fsstate->conn, true, sql);
-    JQclear(res);
+    close_cursor(fsstate->conn, &fsstate->cursor);
+    fsstate->cursor_exists = false;
 
     /* Now force a fresh FETCH. */
-    fsstate->tuples = NULL;
+    fsstate->batch = NULL;
     fsstate->num_tuples = 0;
     fsstate->next_tuple = 0;
     fsstate->fetch_ct_2 = 0;
@@ -926,7 +1344,21 @@ postgresEndForeignScan(ForeignScanState *node)
 
     /* Close the cursor if open, to prevent accumulation of cursors */
     if (fsstate->cursor_exists)
-        close_cursor(fsstate->conn, fsstate->cursor_number);
+        close_cursor(fsstate->conn, &fsstate->cursor);
+
+    /* Destroy the prepared query, if we created it */
+    if (fsstate->p_name)
+    {
+        JQdeallocate(fsstate->conn, fsstate->p_name);
+        fsstate->p_name = NULL;
+    }
+
+    /* Release the rescan cache, and any temporary file it spilled to */
+    if (fsstate->rescan_store)
+    {
+        tuplestore_end(fsstate->rescan_store);
+        fsstate->rescan_store = NULL;
+    }
 
     /* Release remote connection */
     ReleaseConnection(fsstate->conn);
@@ -947,41 +1379,68 @@ postgresAddForeignUpdateTargets(Query *parsetree,
     Var        *var;
     const char *attrname;
     TargetEntry *tle;
+    List       *key_attrs;
+    ListCell   *lc;
 
     /*
-     * In jdbc2_fdw, what we need is the ctid, same as for a regular table.
+     * In jdbc2_fdw, what we need is the ctid, same as for a regular table,
+     * unless the columns with the key option identify the remote row.
      */
+    key_attrs = GetKeyAttrs(target_relation);
+    if (key_attrs == NIL)
+    {
+        /* Make a Var representing the desired value */
+        var = makeVar(parsetree->resultRelation,
+                      SelfItemPointerAttributeNumber,
+                      TIDOID,
+                      -1,
+                      InvalidOid,
+                      0);
+
+        /* Wrap it in a resjunk TLE with the right name ... */
+        attrname = "ctid";
+
+        tle = makeTargetEntry((Expr *) var,
+                              list_length(parsetree->targetList) + 1,
+                              pstrdup(attrname),
+                              true);
+
+        /* ... and add it to the query's targetlist */
+        parsetree->targetList = lappend(parsetree->targetList, tle);
+        return;
+    }
 
-    /* Make a Var representing the desired value */
-    var = makeVar(parsetree->resultRelation,
-                  SelfItemPointerAttributeNumber,
-                  TIDOID,
-                  -1,
-                  InvalidOid,
-                  0);
-
-    /* Wrap it in a resjunk TLE with the right name ... */
-    attrname = "ctid";
-
-    tle = makeTargetEntry((Expr *) var,
-                          list_length(parsetree->targetList) + 1,
-                          pstrdup(attrname),
-                          true);
-
-    /* ... and add it to the query's targetlist */
-    parsetree->targetList = lappend(parsetree->targetList, tle);
+    /* The key columns keep their old values, even if the row changes them */
+    foreach(lc, key_attrs)
+    {
+        int         attnum = lfirst_int(lc);
+        Form_pg_attribute attr = RelationGetDescr(target_relation)->attrs[attnum - 1];
+
+        var = makeVar(parsetree->resultRelation,
+                      attnum,
+                      attr->atttypid,
+                      attr->atttypmod,
+                      attr->attcollation,
+                      0);
+
+        tle = makeTargetEntry((Expr *) var,
+                              list_length(parsetree->targetList) + 1,
+                              psprintf("key%d", attnum),
+                              true);
+
+        parsetree->targetList = lappend(parsetree->targetList, tle);
+    }
 }
 
 /*
  * postgresPlanForeignModify
  *      Plan an insert/update/delete operation on a foreign table
  *
- * Note: currently, the plan tree generated for UPDATE/DELETE will always
- * include a ForeignScan that retrieves ctids (using SELECT FOR UPDATE)
- * and then the ModifyTable node will have to execute individual remote
- * UPDATE/DELETE commands.  If there are no local conditions or joins
- * needed, it'd be better to let the scan node do UPDATE/DELETE RETURNING
- * and then do nothing at ModifyTable.  Room for future optimization ...
+ * Note: the plan tree generated for UPDATE/DELETE includes a ForeignScan
+ * that retrieves ctids or key columns (using SELECT FOR UPDATE), and the
+ * ModifyTable node then executes individual remote UPDATE/DELETE commands.
+ * If there are no local conditions, joins or RETURNING, plan_direct_modify
+ * has the scan node run the whole UPDATE/DELETE instead.
  */
 static List *
 postgresPlanForeignModify(PlannerInfo *root,
@@ -994,8 +1453,11 @@ postgresPlanForeignModify(PlannerInfo *root,
     Relation    rel;
     StringInfoData sql;
     List       *targetAttrs = NIL;
+    List       *keyAttrs = NIL;
     List       *returningList = NIL;
     List       *retrieved_attrs = NIL;
+    List       *fdw_private;
+    bool        direct_modify;
 
     initStringInfo(&sql);
 
@@ -1039,6 +1501,13 @@ postgresPlanForeignModify(PlannerInfo *root,
         }
     }
 
+    /*
+     * An UPDATE or DELETE finds the remote row by its key columns if there
+     * are any, otherwise by its ctid.
+     */
+    if (operation == CMD_UPDATE || operation == CMD_DELETE)
+        keyAttrs = GetKeyAttrs(rel);
+
     /*
      * Extract the relevant RETURNING list if any.
      */
@@ -1057,12 +1526,12 @@ postgresPlanForeignModify(PlannerInfo *root,
             break;
         case CMD_UPDATE:
             deparseUpdateSql(&sql, root, resultRelation, rel,
-                             targetAttrs, returningList,
+                             targetAttrs, keyAttrs, returningList,
                              &retrieved_attrs);
             break;
         case CMD_DELETE:
             deparseDeleteSql(&sql, root, resultRelation, rel,
-                             returningList,
+                             keyAttrs, returningList,
                              &retrieved_attrs);
             break;
         default:
@@ -1070,16 +1539,35 @@ postgresPlanForeignModify(PlannerInfo *root,
             break;
     }
 
+    /*
+     * See if the scan below can run the whole UPDATE or DELETE by itself,
+     * instead of having it done one row at a time.
+     */
+    direct_modify = plan_direct_modify(root, plan, resultRelation,
+                                       subplan_index, rel, targetAttrs);
+
+    /* Only PostgreSQL has a ctid to go by */
+    if ((operation == CMD_UPDATE || operation == CMD_DELETE) &&
+        !direct_modify && keyAttrs == NIL &&
+        !GetRelationDialect(rel)->postgres)
+        ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                 errmsg("cannot update or delete rows of foreign table \"%s\" one at a time",
+                        RelationGetRelationName(rel)),
+                 errhint("Set the key option of the columns that identify a row on the remote server.")));
+
     heap_close(rel, NoLock);
 
     /*
      * Build the fdw_private list that will be available to the executor.
      * Items in the list must match enum FdwModifyPrivateIndex, above.
      */
-    return list_make4(makeString(sql.data),
-                      targetAttrs,
-                      makeInteger((retrieved_attrs != NIL)),
-                      retrieved_attrs);
+    fdw_private = list_make4(makeString(sql.data),
+                             targetAttrs,
+                             makeInteger((retrieved_attrs != NIL)),
+                             retrieved_attrs);
+    fdw_private = lappend(fdw_private, makeInteger(direct_modify));
+    return lappend(fdw_private, keyAttrs);
 }
 
 /*
@@ -1114,6 +1602,10 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
     if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
         return;
 
+    /* Nor if the scan below does all the work. */
+    if (intVal(list_nth(fdw_private, FdwModifyPrivateDirectModify)))
+        return;
+
     /* Begin constructing PgFdwModifyState. */
     fmstate = (PgFdwModifyState *) palloc0(sizeof(PgFdwModifyState));
     fmstate->rel = rel;
@@ -1135,6 +1627,7 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
     fmstate->p_name = NULL;     /* prepared statement not made yet */
 
     /* Deconstruct fdw_private data. */
+    fmstate->operation = operation;
     fmstate->query = strVal(list_nth(fdw_private,
                                      FdwModifyPrivateUpdateSql));
     fmstate->target_attrs = (List *) list_nth(fdw_private,
@@ -1143,6 +1636,54 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
                                              FdwModifyPrivateHasReturning));
     fmstate->retrieved_attrs = (List *) list_nth(fdw_private,
                                              FdwModifyPrivateRetrievedAttrs);
+    fmstate->key_attrs = (List *) list_nth(fdw_private,
+                                           FdwModifyPrivateKeyAttnums);
+
+    /*
+     * Rows are sent batch_size at a time, inserted ones with use_copy as
+     * COPY data, the table's setting overriding the server's.  A RETURNING
+     * clause needs each row back from the remote server as it is modified,
+     * so it isn't batched.
+     */
+    fmstate->batch_size = 1;
+    fmstate->num_batched = 0;
+    fmstate->copy_query = NULL;
+    if (!fmstate->has_returning)
+    {
+        bool        use_copy = false;
+
+        foreach(lc, server->options)
+        {
+            DefElem    *def = (DefElem *) lfirst(lc);
+
+            if (strcmp(def->defname, "batch_size") == 0)
+                fmstate->batch_size = strtol(defGetString(def), NULL, 10);
+            else if (strcmp(def->defname, "use_copy") == 0)
+                use_copy = defGetBoolean(def);
+        }
+        foreach(lc, table->options)
+        {
+            DefElem    *def = (DefElem *) lfirst(lc);
+
+            if (strcmp(def->defname, "batch_size") == 0)
+                fmstate->batch_size = strtol(defGetString(def), NULL, 10);
+            else if (strcmp(def->defname, "use_copy") == 0)
+                use_copy = defGetBoolean(def);
+        }
+
+        /* COPY is PostgreSQL's own, and can't insert a row of defaults */
+        if (operation == CMD_INSERT &&
+            use_copy && fmstate->target_attrs != NIL &&
+            GetServerDialect(server)->postgres)
+        {
+            StringInfoData sql;
+
+            initStringInfo(&sql);
+            deparseCopySql(&sql, rel, fmstate->target_attrs);
+            fmstate->copy_query = sql.data;
+            initStringInfo(&fmstate->copy_buf);
+        }
+    }
 
     /* Create context for per-tuple temp workspace. */
     fmstate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
@@ -1156,36 +1697,68 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
         fmstate->attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(rel));
 
     /* Prepare for output conversion of parameters used in prepared stmt. */
-    n_params = list_length(fmstate->target_attrs) + 1;
+    n_params = list_length(fmstate->target_attrs) +
+        Max(list_length(fmstate->key_attrs), 1);
     fmstate->p_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * n_params);
+    fmstate->p_types = (Oid *) palloc0(sizeof(Oid) * n_params);
     fmstate->p_nums = 0;
 
-    if (operation == CMD_UPDATE || operation == CMD_DELETE)
+    if (operation == CMD_INSERT || operation == CMD_UPDATE)
     {
-        /* Find the ctid resjunk column in the subplan's result */
-        Plan       *subplan = mtstate->mt_plans[subplan_index]->plan;
+        /* Set up for the target column parameters */
+        foreach(lc, fmstate->target_attrs)
+        {
+            int         attnum = lfirst_int(lc);
+            Form_pg_attribute attr = RelationGetDescr(rel)->attrs[attnum - 1];
 
-        fmstate->ctidAttno = ExecFindJunkAttributeInTlist(subplan->targetlist,
-                                                          "ctid");
-        if (!AttributeNumberIsValid(fmstate->ctidAttno))
-            elog(ERROR, "could not find junk ctid column");
+            Assert(!attr->attisdropped);
 
-        /* First transmittable parameter will be ctid */
-        getTypeOutputInfo(TIDOID, &typefnoid, &isvarlena);
-        fmgr_info(typefnoid, &fmstate->p_flinfo[fmstate->p_nums]);
-        fmstate->p_nums++;
+            fmstate->p_types[fmstate->p_nums] = attr->atttypid;
+            getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
+            fmgr_info(typefnoid, &fmstate->p_flinfo[fmstate->p_nums]);
+            fmstate->p_nums++;
+        }
     }
 
-    if (operation == CMD_INSERT || operation == CMD_UPDATE)
+    if (operation == CMD_UPDATE || operation == CMD_DELETE)
     {
-        /* Set up for remaining transmittable parameters */
-        foreach(lc, fmstate->target_attrs)
+        /* Find the row identity resjunk columns in the subplan's result */
+        Plan       *subplan = mtstate->mt_plans[subplan_index]->plan;
+
+        fmstate->rowIdAttnos = (AttrNumber *)
+            palloc(sizeof(AttrNumber) * Max(list_length(fmstate->key_attrs), 1));
+        fmstate->num_row_ids = 0;
+
+        if (fmstate->key_attrs == NIL)
+        {
+            fmstate->rowIdAttnos[0] =
+                ExecFindJunkAttributeInTlist(subplan->targetlist, "ctid");
+            if (!AttributeNumberIsValid(fmstate->rowIdAttnos[0]))
+                elog(ERROR, "could not find junk ctid column");
+            fmstate->num_row_ids = 1;
+
+            /* Last transmittable parameter will be ctid, see deparseUpdateSql */
+            fmstate->p_types[fmstate->p_nums] = TIDOID;
+            getTypeOutputInfo(TIDOID, &typefnoid, &isvarlena);
+            fmgr_info(typefnoid, &fmstate->p_flinfo[fmstate->p_nums]);
+            fmstate->p_nums++;
+        }
+
+        /* Or the key columns, see postgresAddForeignUpdateTargets */
+        foreach(lc, fmstate->key_attrs)
         {
             int         attnum = lfirst_int(lc);
             Form_pg_attribute attr = RelationGetDescr(rel)->attrs[attnum - 1];
+            char       *attrname = psprintf("key%d", attnum);
+            AttrNumber  junkAttno;
 
-            Assert(!attr->attisdropped);
+            junkAttno = ExecFindJunkAttributeInTlist(subplan->targetlist,
+                                                     attrname);
+            if (!AttributeNumberIsValid(junkAttno))
+                elog(ERROR, "could not find junk %s column", attrname);
+            fmstate->rowIdAttnos[fmstate->num_row_ids++] = junkAttno;
 
+            fmstate->p_types[fmstate->p_nums] = attr->atttypid;
             getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
             fmgr_info(typefnoid, &fmstate->p_flinfo[fmstate->p_nums]);
             fmstate->p_nums++;
@@ -1212,13 +1785,46 @@ postgresExecForeignInsert(EState *estate,
     Jresult   *res;
     int         n_rows;
 
-    /* Set up the prepared statement on the remote server, if we didn't yet */
-    if (!fmstate->p_name)
+    /*
+     * Set up the prepared statement on the remote server, if we didn't yet;
+     * COPY needs none.
+     */
+    if (!fmstate->p_name && !fmstate->copy_query)
         prepare_foreign_modify(fmstate);
 
     /* Convert parameters needed by prepared statement to text form */
     p_values = convert_prep_stmt_params(fmstate, NULL, slot);
 
+    /*
+     * With COPY, collect the row as COPY data, which is sent whenever there
+     * is enough of it.  Like in batch mode, any error is only reported with
+     * the data.
+     */
+    if (fmstate->copy_query)
+    {
+        append_copy_row(&fmstate->copy_buf, fmstate->p_nums, p_values);
+        if (fmstate->copy_buf.len >= COPY_BUFFER_SIZE)
+            execute_foreign_copy(fmstate);
+
+        MemoryContextReset(fmstate->temp_cxt);
+
+        return slot;
+    }
+
+    /*
+     * In batch mode, only add the row to the batch, and send the batch once
+     * it is full.  The row counts as inserted, any error only being reported
+     * with the batch.
+     */
+    if (fmstate->batch_size > 1)
+    {
+        add_to_foreign_batch(fmstate, p_values);
+
+        MemoryContextReset(fmstate->temp_cxt);
+
+        return slot;
+    }
+
     /*
      * Execute the prepared statement, and check for success.
      *
@@ -1266,8 +1872,6 @@ postgresExecForeignUpdate(EState *estate,
                           TupleTableSlot *planSlot)
 {
     PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
-    Datum       datum;
-    bool        isNull;
     const char **p_values;
     Jresult   *res;
     int         n_rows;
@@ -1276,18 +1880,21 @@ postgresExecForeignUpdate(EState *estate,
     if (!fmstate->p_name)
         prepare_foreign_modify(fmstate);
 
-    /* Get the ctid that was passed up as a resjunk column */
-    datum = ExecGetJunkAttribute(planSlot,
-                                 fmstate->ctidAttno,
-                                 &isNull);
-    /* shouldn't ever get a null result... */
-    if (isNull)
-        elog(ERROR, "ctid is NULL");
+    /*
+     * Convert parameters needed by prepared statement to text form, the row
+     * identity coming from the resjunk columns of planSlot
+     */
+    p_values = convert_prep_stmt_params(fmstate, planSlot, slot);
+
+    /* In batch mode, only add the row to the batch, as for inserts */
+    if (fmstate->batch_size > 1)
+    {
+        add_to_foreign_batch(fmstate, p_values);
 
-    /* Convert parameters needed by prepared statement to text form */
-    p_values = convert_prep_stmt_params(fmstate,
-                                        (ItemPointer) DatumGetPointer(datum),
-                                        slot);
+        MemoryContextReset(fmstate->temp_cxt);
+
+        return slot;
+    }
 
     /*
      * Execute the prepared statement, and check for success.
@@ -1336,8 +1943,6 @@ postgresExecForeignDelete(EState *estate,
                           TupleTableSlot *planSlot)
 {
     PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
-    Datum       datum;
-    bool        isNull;
     const char **p_values;
     Jresult   *res;
     int         n_rows;
@@ -1346,18 +1951,21 @@ postgresExecForeignDelete(EState *estate,
     if (!fmstate->p_name)
         prepare_foreign_modify(fmstate);
 
-    /* Get the ctid that was passed up as a resjunk column */
-    datum = ExecGetJunkAttribute(planSlot,
-                                 fmstate->ctidAttno,
-                                 &isNull);
-    /* shouldn't ever get a null result... */
-    if (isNull)
-        elog(ERROR, "ctid is NULL");
+    /*
+     * Convert parameters needed by prepared statement to text form, the row
+     * identity coming from the resjunk columns of planSlot
+     */
+    p_values = convert_prep_stmt_params(fmstate, planSlot, NULL);
+
+    /* In batch mode, only add the row to the batch, as for inserts */
+    if (fmstate->batch_size > 1)
+    {
+        add_to_foreign_batch(fmstate, p_values);
+
+        MemoryContextReset(fmstate->temp_cxt);
 
-    /* Convert parameters needed by prepared statement to text form */
-    p_values = convert_prep_stmt_params(fmstate,
-                                        (ItemPointer) DatumGetPointer(datum),
-                                        NULL);
+        return slot;
+    }
 
     /*
      * Execute the prepared statement, and check for success.
@@ -1405,26 +2013,20 @@ postgresEndForeignModify(EState *estate,
 {
     PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
 
-    /* If fmstate is NULL, we are in EXPLAIN; nothing to do */
+    /* If fmstate is NULL, we are in EXPLAIN or direct; nothing to do */
     if (fmstate == NULL)
         return;
 
+    /* Send the last, partial batch of rows */
+    if (fmstate->num_batched > 0)
+        execute_foreign_batch(fmstate);
+    if (fmstate->copy_query && fmstate->copy_buf.len > 0)
+        execute_foreign_copy(fmstate);
+
     /* If we created a prepared statement, destroy it */
     if (fmstate->p_name)
     {
-        char        sql[64];
-        Jresult   *res;
-
-        snprintf(sql, sizeof(sql), "DEALLOCATE %s", fmstate->p_name);
-
-        /*
-         * We don't use a PG_TRY block here, so be careful not to throw error
-         * without releasing the Jresult.
-         */
-        res = JQexec(fmstate->conn, sql);
-        if (JQresultStatus(res) != PGRES_COMMAND_OK)
-            pgfdw_report_error(ERROR, res, fmstate->conn, true, sql);
-        JQclear(res);
+        JQdeallocate(fmstate->conn, fmstate->p_name);
         fmstate->p_name = NULL;
     }
 
@@ -1469,6 +2071,8 @@ postgresIsForeignRelUpdatable(Relation rel)
 
         if (strcmp(def->defname, "updatable") == 0)
             updatable = defGetBoolean(def);
+        else if (strcmp(def->defname, "query") == 0)
+            return 0;           /* the rows of a remote query can't be modified */
     }
 
     /*
@@ -1507,7 +2111,9 @@ postgresExplainForeignModify(ModifyTableState *mtstate,
                              int subplan_index,
                              ExplainState *es)
 {
-    if (es->verbose)
+    /* The scan below shows the statement it runs in our place */
+    if (es->verbose &&
+        !intVal(list_nth(fdw_private, FdwModifyPrivateDirectModify)))
     {
         char       *sql = strVal(list_nth(fdw_private,
                                           FdwModifyPrivateUpdateSql));
@@ -1518,16 +2124,61 @@ postgresExplainForeignModify(ModifyTableState *mtstate,
 
 
 /*
- * estimate_path_cost_size
- *      Get cost and size estimates for a foreign scan
+ * get_remote_row_limit
+ *      Number of rows after which the scan can stop, or 0 if the query may
+ *      need all of them
  *
- * We assume that all the baserestrictinfo clauses will be applied, plus
- * any join clauses listed in join_conds.
+ * The LIMIT of the query only bounds the scan if nothing between the two
+ * can drop, add or reorder rows: the foreign table must be the only relation
+ * of the query, all quals must be evaluated remotely, and any ORDER BY must
+ * be done by the remote server too.  The planner already leaves limit_tuples
+ * unset for queries with grouping or aggregation.  The bound includes the
+ * OFFSET, since the Limit node skips those rows itself.
+ */
+static int
+get_remote_row_limit(PlannerInfo *root, RelOptInfo *baserel,
+                     ForeignPath *best_path, List *local_exprs)
+{
+    Query      *parse = root->parse;
+
+    /* limit_tuples is -1 if there's no LIMIT, or we can't rely on it */
+    if (root->limit_tuples <= 0 || root->limit_tuples > INT_MAX)
+        return 0;
+
+    if (baserel->reloptkind != RELOPT_BASEREL ||
+        !bms_equal(root->all_baserels, baserel->relids))
+        return 0;
+
+    if (local_exprs != NIL || best_path->path.param_info != NULL)
+        return 0;
+
+    if (!pathkeys_contained_in(root->sort_pathkeys, best_path->path.pathkeys))
+        return 0;
+
+    /* A set-returning function in the target list changes the row count */
+    if (expression_returns_set((Node *) parse->targetList))
+        return 0;
+
+    /* Leave row locking and UPDATE/DELETE alone */
+    if (parse->rowMarks != NIL || parse->resultRelation != 0)
+        return 0;
+
+    return (int) root->limit_tuples;
+}
+
+/*
+ * estimate_path_cost_size
+ *      Get cost and size estimates for a foreign scan
+ *
+ * We assume that all the baserestrictinfo clauses will be applied, plus
+ * any join clauses listed in join_conds, and that the rows come back sorted
+ * by pathkeys if that isn't NIL.
  */
 static void
 estimate_path_cost_size(PlannerInfo *root,
                         RelOptInfo *baserel,
                         List *join_conds,
+                        List *pathkeys,
                         double *p_rows, int *p_width,
                         Cost *p_startup_cost, Cost *p_total_cost)
 {
@@ -1579,6 +2230,8 @@ estimate_path_cost_size(PlannerInfo *root,
         if (remote_join_conds)
             appendWhereClause(&sql, root, baserel, remote_join_conds,
                               (fpinfo->remote_conds == NIL), NULL);
+        if (pathkeys)
+            appendOrderByClause(&sql, root, baserel, pathkeys);
 
         /* Get the remote estimate */
         conn = GetConnection(fpinfo->server, fpinfo->user, false);
@@ -1605,14 +2258,29 @@ estimate_path_cost_size(PlannerInfo *root,
         startup_cost += local_cost.startup;
         total_cost += local_cost.per_tuple * retrieved_rows;
     }
-    else
+    else if (join_conds != NIL)
     {
         /*
-         * We don't support join conditions in this mode (hence, no
-         * parameterized paths can be made).
+         * A parameterized scan.  At least one of the join clauses goes to
+         * the remote server, so assume it finds the matching rows through
+         * an index: a page per retrieved row at most, rather than the whole
+         * table as below.
          */
-        Assert(join_conds == NIL);
+        rows = get_parameterized_baserel_size(root, baserel, join_conds);
+        width = baserel->width;
+
+        retrieved_rows = clamp_row_est(rows / fpinfo->local_conds_sel);
+        retrieved_rows = Min(retrieved_rows, baserel->tuples);
+
+        startup_cost = baserel->baserestrictcost.startup;
+        cpu_per_tuple = cpu_tuple_cost + baserel->baserestrictcost.per_tuple;
+        run_cost = random_page_cost * Min(retrieved_rows, baserel->pages);
+        run_cost += cpu_per_tuple * retrieved_rows;
 
+        total_cost = startup_cost + run_cost;
+    }
+    else
+    {
         /* Use rows/width estimates made by set_baserel_size_estimates. */
         rows = baserel->rows;
         width = baserel->width;
@@ -1640,6 +2308,21 @@ estimate_path_cost_size(PlannerInfo *root,
         total_cost = startup_cost + run_cost;
     }
 
+    /*
+     * Without remote estimates, we have no real way to estimate the cost of
+     * generating sorted output.  It could be free if the remote plan
+     * produces properly-sorted output anyway, e.g. through an index, but in
+     * most cases it will cost something.  Estimate a value high enough that
+     * we won't pick the sorted path when the ordering isn't locally useful,
+     * but low enough that we'll err on the side of pushing down the ORDER BY
+     * clause when it's useful to do so.
+     */
+    if (!fpinfo->use_remote_estimate && pathkeys != NIL)
+    {
+        startup_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
+        total_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
+    }
+
     /*
      * Add some additional cost factors to account for connection overhead
      * (fdw_startup_cost), transferring data across the network
@@ -1741,95 +2424,162 @@ ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
 }
 
 /*
- * Create cursor for node's query with current parameter values.
+ * Construct the array of query parameter values in text format.  We do the
+ * conversions in the short-lived per-tuple context, so as not to cause a
+ * memory leak over repeated scans.
  */
 static void
-create_cursor(ForeignScanState *node)
+convert_query_params(ForeignScanState *node)
 {
     PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
     ExprContext *econtext = node->ss.ps.ps_ExprContext;
-    int         numParams = fsstate->numParams;
     const char **values = fsstate->param_values;
-    Jconn     *conn = fsstate->conn;
-    StringInfoData buf;
-    Jresult   *res;
+    int         nestlevel;
+    MemoryContext oldcontext;
+    int         i;
+    ListCell   *lc;
 
-    /*
-     * Construct array of query parameter values in text format.  We do the
-     * conversions in the short-lived per-tuple context, so as not to cause a
-     * memory leak over repeated scans.
-     */
-    if (numParams > 0)
-    {
-        int         nestlevel;
-        MemoryContext oldcontext;
-        int         i;
-        ListCell   *lc;
+    if (fsstate->numParams == 0)
+        return;
 
-        oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+    oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
 
-        nestlevel = set_transmission_modes();
+    nestlevel = set_transmission_modes();
 
-        i = 0;
-        foreach(lc, fsstate->param_exprs)
-        {
-            ExprState  *expr_state = (ExprState *) lfirst(lc);
-            Datum       expr_value;
-            bool        isNull;
+    i = 0;
+    foreach(lc, fsstate->param_exprs)
+    {
+        ExprState  *expr_state = (ExprState *) lfirst(lc);
+        Datum       expr_value;
+        bool        isNull;
 
-            /* Evaluate the parameter expression */
-            expr_value = ExecEvalExpr(expr_state, econtext, &isNull, NULL);
+        /* Evaluate the parameter expression */
+        expr_value = ExecEvalExpr(expr_state, econtext, &isNull, NULL);
 
-            /*
-             * Get string representation of each parameter value by invoking
-             * type-specific output function, unless the value is null.
-             */
-            if (isNull)
-                values[i] = NULL;
-            else
-                values[i] = OutputFunctionCall(&fsstate->param_flinfo[i],
-                                               expr_value);
-            i++;
-        }
+        /*
+         * Get string representation of each parameter value by invoking
+         * type-specific output function, unless the value is null.
+         */
+        if (isNull)
+            values[i] = NULL;
+        else
+            values[i] = OutputFunctionCall(&fsstate->param_flinfo[i],
+                                           expr_value);
+        i++;
+    }
 
-        reset_transmission_modes(nestlevel);
+    reset_transmission_modes(nestlevel);
 
-        MemoryContextSwitchTo(oldcontext);
-    }
+    MemoryContextSwitchTo(oldcontext);
+}
 
-    /* Construct the DECLARE CURSOR command */
-    initStringInfo(&buf);
-    appendStringInfo(&buf, "%s", fsstate->query);
+/*
+ * Create cursor for node's query with current parameter values.
+ */
+static void
+create_cursor(ForeignScanState *node)
+{
+    PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+    int         numParams = fsstate->numParams;
+    const char **values = fsstate->param_values;
+    Jconn     *conn = fsstate->conn;
+    Jresult   *res;
 
-    //appendStringInfo(&buf, "DECLARE c%u CURSOR FOR\n%s",
-    //                 fsstate->cursor_number, fsstate->query);
+    convert_query_params(node);
 
     /*
-     * Notice that we pass NULL for paramTypes, thus forcing the remote server
-     * to infer types for all parameters.  Since we explicitly cast every
-     * parameter (see deparse.c), the "inference" is trivial and will produce
-     * the desired result.  This allows us to avoid assuming that the remote
-     * server has the same OIDs we do for the parameters' types.
+     * Prepare the query the first time through.  A rescan then only binds
+     * the new parameter values to the same statement, sparing the remote
+     * server from parsing and planning the query again.  The local types of
+     * the parameters pick the JDBC setters used to bind them; they are never
+     * sent as OIDs, so the remote server needn't share our OIDs.
      *
      * We don't use a PG_TRY block here, so be careful not to throw error
      * without releasing the Jresult.
      */
-    res = JQexecParams(conn, buf.data, numParams, NULL, values,
-                       NULL, NULL, 0);
-    if (JQresultStatus(res) != PGRES_COMMAND_OK)
-        pgfdw_report_error(ERROR, res, conn, true, fsstate->query);
-    JQclear(res);
+    if (!fsstate->p_name)
+    {
+        char        prep_name[NAMEDATALEN];
+
+        snprintf(prep_name, sizeof(prep_name), "jdbc2_fdw_cursor_%u",
+                 fsstate->cursor_number);
+        res = JQprepare(conn, prep_name, fsstate->query, numParams,
+                        fsstate->param_types);
+        if (JQresultStatus(res) != PGRES_COMMAND_OK)
+            pgfdw_report_error(ERROR, res, conn, true, fsstate->query);
+        JQclear(res);
+        fsstate->p_name = MemoryContextStrdup(node->ss.ps.state->es_query_cxt,
+                                              prep_name);
+    }
+    JQsetFetchSize(conn, fsstate->max_rows > 0 ?
+                   Min(fsstate->fetch_size, fsstate->max_rows) :
+                   fsstate->fetch_size);
+    JQsetMaxRows(conn, fsstate->max_rows);
+    JQopenPrepared(conn, &fsstate->cursor, fsstate->cursor_number,
+                   fsstate->p_name, numParams, values);
 
     /* Mark the cursor as created, and show no tuples have been retrieved */
     fsstate->cursor_exists = true;
-    fsstate->tuples = NULL;
+    fsstate->rows_fetched = 0;
+    fsstate->batch = NULL;
     fsstate->num_tuples = 0;
     fsstate->next_tuple = 0;
     fsstate->fetch_ct_2 = 0;
     fsstate->eof_reached = false;
+}
 
-    /* Clean up */
-    pfree(buf.data);
+/*
+ * Run the UPDATE or DELETE that plan_direct_modify made node's query, and
+ * count the rows it affected remotely as processed by the statement.
+ */
+static void
+execute_direct_modify(ForeignScanState *node)
+{
+    PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+    Jresult   *res;
+
+    convert_query_params(node);
+
+    /*
+     * We don't use a PG_TRY block here, so be careful not to throw error
+     * without releasing the Jresult.
+     */
+    res = JQexecParams(fsstate->conn, fsstate->query, fsstate->numParams,
+                       fsstate->param_types, fsstate->param_values,
+                       NULL, NULL, 0);
+    if (JQresultStatus(res) != PGRES_COMMAND_OK)
+        pgfdw_report_error(ERROR, res, fsstate->conn, true, fsstate->query);
+    node->ss.ps.state->es_processed += atoi(JQcmdTuples(res));
+    JQclear(res);
+
+    fsstate->eof_reached = true;
+}
+
+/*
+ * Start spooling the rows of the pass about to begin into the rescan cache.
+ * The tuplestore spills to disk beyond work_mem.
+ */
+static void
+start_rescan_spool(ForeignScanState *node)
+{
+    PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+
+    /* A ctid only survives in heap tuples, so such scans aren't cached. */
+    if (fsstate->retrieves_ctid)
+        return;
+
+    if (fsstate->rescan_store == NULL)
+    {
+        MemoryContext oldcontext;
+
+        oldcontext = MemoryContextSwitchTo(node->ss.ps.state->es_query_cxt);
+        fsstate->rescan_store = tuplestore_begin_heap(false, false, work_mem);
+        MemoryContextSwitchTo(oldcontext);
+    }
+    else
+        tuplestore_clear(fsstate->rescan_store);
+    fsstate->rescan_spool = true;
+    fsstate->rescan_ready = false;
 }
 
 /*
@@ -1842,61 +2592,66 @@ fetch_more_data(ForeignScanState *node)
     Jresult   *volatile res = NULL;
     MemoryContext oldcontext;
 
-    //TODO: Figure out what this is used for
-    return;
-
     /*
-     * We'll store the tuples in the batch_cxt.  First, flush the previous
-     * batch.
+     * We'll keep the Jresult in the batch_cxt; the rows are converted one
+     * at a time as they are returned.  First, flush the previous batch.
      */
-    fsstate->tuples = NULL;
+    fsstate->batch = NULL;
+    fsstate->num_tuples = 0;
+    fsstate->next_tuple = 0;
     MemoryContextReset(fsstate->batch_cxt);
     oldcontext = MemoryContextSwitchTo(fsstate->batch_cxt);
 
-    /* Jresult must be released before leaving this function. */
+    /* Jresult must be released if we fail before keeping it. */
     PG_TRY();
     {
         Jconn     *conn = fsstate->conn;
-        char        sql[64];
         int         fetch_size;
         int         numrows;
-        int         i;
 
-        /* The fetch size is arbitrary, but shouldn't be enormous. */
-        fetch_size = 100;
-
-        snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
-                 fetch_size, fsstate->cursor_number);
-
-        res = JQexec(conn, sql);
-        /* On error, report the original query, not the FETCH. */
+        /*
+         * Get a whole batch of rows across the JNI boundary in one call, but
+         * no more than the rows still needed under a LIMIT.
+         */
+        fetch_size = fsstate->fetch_size;
+        if (fsstate->max_rows > 0)
+            fetch_size = Min(fetch_size,
+                             fsstate->max_rows - fsstate->rows_fetched);
+
+        res = JQfetch(conn, &fsstate->cursor, fetch_size,
+                      fsstate->transfer_mode, fsstate->retrieved_types);
+        /* On error, report the original query. */
         if (JQresultStatus(res) != PGRES_TUPLES_OK)
             pgfdw_report_error(ERROR, res, conn, false, fsstate->query);
 
-        /* Convert the data into HeapTuples */
         numrows = JQntuples(res);
-        fsstate->tuples = (HeapTuple *) palloc0(numrows * sizeof(HeapTuple));
-        fsstate->num_tuples = numrows;
-        fsstate->next_tuple = 0;
 
-        for (i = 0; i < numrows; i++)
+        /*
+         * In adaptive mode, size the next batch so that it fits the byte
+         * budget, going by the average width of the rows just fetched.
+         */
+        if (fsstate->fetch_bytes > 0 && numrows > 0)
         {
-            fsstate->tuples[i] =
-                make_tuple_from_result_row(res, i,
-                                           fsstate->rel,
-                                           fsstate->attinmeta,
-                                           fsstate->retrieved_attrs,
-                                           fsstate->temp_cxt);
+            Size        row_width = Max(JQbatchbytes(res) / numrows, 1);
+
+            fsstate->fetch_size = (int) Min(fsstate->fetch_bytes / row_width,
+                                            MAX_FETCH_SIZE);
+            fsstate->fetch_size = Max(fsstate->fetch_size, 1);
         }
 
         /* Update fetch_ct_2 */
         if (fsstate->fetch_ct_2 < 2)
             fsstate->fetch_ct_2++;
 
-        /* Must be EOF if we didn't get as many tuples as we asked for. */
-        fsstate->eof_reached = (numrows < fetch_size);
+        /* Once the LIMIT is reached, don't ask for another batch */
+        fsstate->rows_fetched += numrows;
+        fsstate->eof_reached = JQlastbatch(res) ||
+            (fsstate->max_rows > 0 &&
+             fsstate->rows_fetched >= fsstate->max_rows);
 
-        JQclear(res);
+        /* The batch now belongs to fsstate, and goes with the batch_cxt. */
+        fsstate->batch = res;
+        fsstate->num_tuples = numrows;
         res = NULL;
     }
     PG_CATCH();
@@ -1964,24 +2719,97 @@ reset_transmission_modes(int nestlevel)
  * Utility routine to close a cursor.
  */
 static void
-close_cursor(Jconn *conn, unsigned int cursor_number)
+close_cursor(Jconn *conn, jdbcFdwExecutionState *cursor)
 {
-    char        sql[64];
-    Jresult   *res;
+    /*
+     * Only this cursor's result set is released; other scans sharing the
+     * connection keep theirs open.
+     */
+    JQcloseCursor(conn, cursor);
+}
+
+/*
+ * plan_direct_modify
+ *      Have the ForeignScan below an UPDATE or DELETE run the whole statement
+ *      remotely, if it can
+ *
+ * That takes a scan of the target table alone, all of whose conditions are
+ * sent to the remote server, new values that are safe to send, too, and
+ * nothing that needs the rows back: no RETURNING, row triggers or WITH CHECK
+ * OPTION.  The scan then sends the statement once instead of its SELECT and
+ * returns no rows, so the ModifyTable node only fires statement triggers.
+ */
+static bool
+plan_direct_modify(PlannerInfo *root, ModifyTable *plan,
+                   Index resultRelation, int subplan_index,
+                   Relation rel, List *targetAttrs)
+{
+    CmdType     operation = plan->operation;
+    Plan       *subplan = (Plan *) list_nth(plan->plans, subplan_index);
+    ForeignScan *fscan;
+    RelOptInfo *baserel;
+    PgFdwRelationInfo *fpinfo;
+    List       *params_list;
+    StringInfoData sql;
+    ListCell   *lc;
+
+    if (operation != CMD_UPDATE && operation != CMD_DELETE)
+        return false;
 
-    //TODO: Make sure I don't need this at all
-    return;
+    /* The scan counts the rows, so the statement must set the tag */
+    if (!plan->canSetTag || plan->returningLists ||
+        plan->withCheckOptionLists)
+        return false;
+
+    if (rel->trigdesc &&
+        (operation == CMD_UPDATE ?
+         (rel->trigdesc->trig_update_before_row ||
+          rel->trigdesc->trig_update_after_row) :
+         (rel->trigdesc->trig_delete_before_row ||
+          rel->trigdesc->trig_delete_after_row)))
+        return false;
+
+    /* A join, or a condition checked locally, needs the rows here */
+    if (!IsA(subplan, ForeignScan))
+        return false;
+    fscan = (ForeignScan *) subplan;
+    if (fscan->scan.scanrelid != resultRelation ||
+        fscan->scan.plan.qual != NIL)
+        return false;
 
-    snprintf(sql, sizeof(sql), "CLOSE c%u", cursor_number);
+    baserel = find_base_rel(root, resultRelation);
+    fpinfo = (PgFdwRelationInfo *) baserel->fdw_private;
+
+    if (operation == CMD_UPDATE)
+    {
+        foreach(lc, targetAttrs)
+        {
+            TargetEntry *tle = get_tle_by_resno(subplan->targetlist,
+                                                lfirst_int(lc));
+
+            if (tle == NULL || !is_foreign_expr(root, baserel, tle->expr))
+                return false;
+        }
+    }
+
+    initStringInfo(&sql);
+    if (operation == CMD_UPDATE)
+        deparseDirectUpdateSql(&sql, root, resultRelation, rel, baserel,
+                               subplan->targetlist, targetAttrs,
+                               fpinfo->remote_conds, &params_list);
+    else
+        deparseDirectDeleteSql(&sql, root, rel, baserel,
+                               fpinfo->remote_conds, &params_list);
 
     /*
-     * We don't use a PG_TRY block here, so be careful not to throw error
-     * without releasing the Jresult.
+     * Have the scan send the statement instead of its SELECT.  These are
+     * the first and the last items of its fdw_private.
      */
-    res = JQexec(conn, sql);
-    if (JQresultStatus(res) != PGRES_COMMAND_OK)
-        pgfdw_report_error(ERROR, res, conn, true, sql);
-    JQclear(res);
+    fscan->fdw_exprs = params_list;
+    linitial(fscan->fdw_private) = makeString(sql.data);
+    llast(fscan->fdw_private) = makeInteger(true);
+
+    return true;
 }
 
 /*
@@ -2001,11 +2829,9 @@ prepare_foreign_modify(PgFdwModifyState *fmstate)
     p_name = pstrdup(prep_name);
 
     /*
-     * We intentionally do not specify parameter types here, but leave the
-     * remote server to derive them by default.  This avoids possible problems
-     * with the remote server using different type OIDs than we do.  All of
-     * the prepared statements we use in this module are simple enough that
-     * the remote server will make the right choices.
+     * The local parameter types only pick the JDBC setters used to bind the
+     * values; they are never sent as OIDs, so the remote server needn't use
+     * the same type OIDs we do.
      *
      * We don't use a PG_TRY block here, so be careful not to throw error
      * without releasing the Jresult.
@@ -2013,8 +2839,8 @@ prepare_foreign_modify(PgFdwModifyState *fmstate)
     res = JQprepare(fmstate->conn,
                     p_name,
                     fmstate->query,
-                    0,
-                    NULL);
+                    fmstate->p_nums,
+                    fmstate->p_types);
 
     if (JQresultStatus(res) != PGRES_COMMAND_OK)
         pgfdw_report_error(ERROR, res, fmstate->conn, true, fmstate->query);
@@ -2024,18 +2850,160 @@ prepare_foreign_modify(PgFdwModifyState *fmstate)
     fmstate->p_name = p_name;
 }
 
+/*
+ * add_to_foreign_batch
+ *      Add a row's parameters to the batch of the prepared statement, and
+ *      send the batch once it is full
+ */
+static void
+add_to_foreign_batch(PgFdwModifyState *fmstate, const char **p_values)
+{
+    JQaddBatch(fmstate->conn, fmstate->p_name, fmstate->p_nums, p_values);
+    fmstate->num_batched++;
+    if (fmstate->num_batched >= fmstate->batch_size)
+        execute_foreign_batch(fmstate);
+}
+
+/*
+ * execute_foreign_batch
+ *      Send the rows batched by postgresExecForeign{Insert,Update,Delete}
+ *
+ * The rows of a batched UPDATE or DELETE were already reported as modified,
+ * so the number of rows the remote server says it changed is checked here.
+ * More means the key columns don't identify a single row, which must not
+ * go on.  Fewer means some rows were gone by the time the batch was sent,
+ * which an unbatched statement would have silently skipped.
+ */
+static void
+execute_foreign_batch(PgFdwModifyState *fmstate)
+{
+    Jresult   *res;
+    int         num_batched = fmstate->num_batched;
+    int         n_rows;
+    int         elevel;
+
+    fmstate->num_batched = 0;
+
+    /*
+     * We don't use a PG_TRY block here, so be careful not to throw error
+     * without releasing the Jresult.
+     */
+    res = JQexecBatch(fmstate->conn, fmstate->p_name);
+    if (JQresultStatus(res) != PGRES_COMMAND_OK)
+        pgfdw_report_error(ERROR, res, fmstate->conn, true, fmstate->query);
+    /*
+     * A driver may not tell how many rows each command of a batch affected,
+     * and then there is nothing to check the number of batched rows against.
+     */
+    if (JQcmdTuples(res)[0] == '\0')
+    {
+        JQclear(res);
+        return;
+    }
+    n_rows = atoi(JQcmdTuples(res));
+    JQclear(res);
+
+    if (fmstate->operation == CMD_INSERT || n_rows == num_batched)
+        return;
+    elevel = (n_rows > num_batched) ? ERROR : WARNING;
+    if (fmstate->operation == CMD_UPDATE)
+        ereport(elevel,
+                (errcode(ERRCODE_FDW_ERROR),
+                 errmsg("batch of %d rows updated %d rows of foreign table \"%s\"",
+                        num_batched, n_rows,
+                        RelationGetRelationName(fmstate->rel)),
+                 errcontext("Remote SQL command: %s", fmstate->query)));
+    else
+        ereport(elevel,
+                (errcode(ERRCODE_FDW_ERROR),
+                 errmsg("batch of %d rows deleted %d rows of foreign table \"%s\"",
+                        num_batched, n_rows,
+                        RelationGetRelationName(fmstate->rel)),
+                 errcontext("Remote SQL command: %s", fmstate->query)));
+}
+
+/*
+ * append_copy_row
+ *      Append a row of text parameter values, NULL for SQL NULL, to buf as
+ *      a line of COPY data in text format
+ */
+static void
+append_copy_row(StringInfo buf, int nParams, const char *const *paramValues)
+{
+    int         i;
+    const char *ptr;
+
+    for (i = 0; i < nParams; i++)
+    {
+        if (i > 0)
+            appendStringInfoChar(buf, '\t');
+
+        if (paramValues[i] == NULL)
+        {
+            appendStringInfoString(buf, "\\N");
+            continue;
+        }
+
+        for (ptr = paramValues[i]; *ptr; ptr++)
+        {
+            switch (*ptr)
+            {
+                case '\\':
+                    appendStringInfoString(buf, "\\\\");
+                    break;
+                case '\n':
+                    appendStringInfoString(buf, "\\n");
+                    break;
+                case '\r':
+                    appendStringInfoString(buf, "\\r");
+                    break;
+                case '\t':
+                    appendStringInfoString(buf, "\\t");
+                    break;
+                default:
+                    appendStringInfoChar(buf, *ptr);
+                    break;
+            }
+        }
+    }
+    appendStringInfoChar(buf, '\n');
+}
+
+/*
+ * execute_foreign_copy
+ *      Send the COPY data collected by postgresExecForeignInsert
+ */
+static void
+execute_foreign_copy(PgFdwModifyState *fmstate)
+{
+    Jresult   *res;
+
+    /*
+     * We don't use a PG_TRY block here, so be careful not to throw error
+     * without releasing the Jresult.
+     */
+    res = JQcopyIn(fmstate->conn, fmstate->copy_query,
+                   fmstate->copy_buf.data, fmstate->copy_buf.len);
+    if (JQresultStatus(res) != PGRES_COMMAND_OK)
+        pgfdw_report_error(ERROR, res, fmstate->conn, true,
+                           fmstate->copy_query);
+    JQclear(res);
+
+    resetStringInfo(&fmstate->copy_buf);
+}
+
 /*
  * convert_prep_stmt_params
  *      Create array of text strings representing parameter values
  *
- * tupleid is ctid to send, or NULL if none
+ * planSlot is slot to get the ctid or key columns from, or NULL if none
  * slot is slot to get remaining parameters from, or NULL if none
  *
  * Data is constructed in temp_cxt; caller should reset that after use.
  */
 static const char **
 convert_prep_stmt_params(PgFdwModifyState *fmstate,
-                         ItemPointer tupleid,
+                         TupleTableSlot *planSlot,
                          TupleTableSlot *slot)
 {
     const char **p_values;
@@ -2046,16 +3014,7 @@ convert_prep_stmt_params(PgFdwModifyState *fmstate,
 
     p_values = (const char **) palloc(sizeof(char *) * fmstate->p_nums);
 
-    /* 1st parameter should be ctid, if it's in use */
-    if (tupleid != NULL)
-    {
-        /* don't need set_transmission_modes for TID output */
-        p_values[pindex] = OutputFunctionCall(&fmstate->p_flinfo[pindex],
-                                              PointerGetDatum(tupleid));
-        pindex++;
-    }
-
-    /* get following parameters from slot */
+    /* get target column parameters from slot */
     if (slot != NULL && fmstate->target_attrs != NIL)
     {
         int         nestlevel;
@@ -2081,6 +3040,41 @@ convert_prep_stmt_params(PgFdwModifyState *fmstate,
         reset_transmission_modes(nestlevel);
     }
 
+    /* Last parameters should be the ctid or key columns, if in use */
+    if (planSlot != NULL)
+    {
+        int         nestlevel;
+        int         i;
+
+        nestlevel = set_transmission_modes();
+
+        for (i = 0; i < fmstate->num_row_ids; i++)
+        {
+            Datum       value;
+            bool        isnull;
+
+            value = ExecGetJunkAttribute(planSlot, fmstate->rowIdAttnos[i],
+                                         &isnull);
+            /* a key column might be null, a ctid shouldn't ever be */
+            if (isnull)
+            {
+                if (fmstate->key_attrs == NIL)
+                    elog(ERROR, "ctid is NULL");
+                ereport(ERROR,
+                        (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                         errmsg("key column \"%s\" of foreign table \"%s\" is null",
+                                get_attname(RelationGetRelid(fmstate->rel),
+                                            list_nth_int(fmstate->key_attrs, i)),
+                                RelationGetRelationName(fmstate->rel))));
+            }
+            p_values[pindex] = OutputFunctionCall(&fmstate->p_flinfo[pindex],
+                                                  value);
+            pindex++;
+        }
+
+        reset_transmission_modes(nestlevel);
+    }
+
     Assert(pindex == fmstate->p_nums);
 
     MemoryContextSwitchTo(oldcontext);
@@ -2136,6 +3130,7 @@ postgresAnalyzeForeignTable(Relation relation,
     Jconn     *conn;
     StringInfoData sql;
     Jresult   *volatile res = NULL;
+    ListCell   *lc;
 
     /* Return the row-analysis function pointer */
     *func = postgresAcquireSampleRowsFunc;
@@ -2152,7 +3147,28 @@ postgresAnalyzeForeignTable(Relation relation,
      * owner, even if the ANALYZE was started by some other user.
      */
     table = GetForeignTable(RelationGetRelid(relation));
+
+    /*
+     * A remote query has no relation size to ask for, and only PostgreSQL
+     * can tell the size of a table.
+     */
     server = GetForeignServer(table->serverid);
+    if (!GetServerDialect(server)->postgres)
+    {
+        *totalpages = 1;
+        return true;
+    }
+    foreach(lc, table->options)
+    {
+        DefElem    *def = (DefElem *) lfirst(lc);
+
+        if (strcmp(def->defname, "query") == 0)
+        {
+            *totalpages = 1;
+            return true;
+        }
+    }
+
     user = GetUserMapping(relation->rd_rel->relowner, server->serverid);
     conn = GetConnection(server, user, false);
 
@@ -2217,6 +3233,9 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
     UserMapping *user;
     Jconn     *conn;
     unsigned int cursor_number;
+    jdbcFdwExecutionState cursor;
+    int         fetch_size;
+    ListCell   *lc;
     StringInfoData sql;
     Jresult   *volatile res = NULL;
 
@@ -2248,28 +3267,43 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
     user = GetUserMapping(relation->rd_rel->relowner, server->serverid);
     conn = GetConnection(server, user, false);
 
+    /*
+     * Use the fetch_size of the table or server for the sample scan too;
+     * the table's setting overrides the server's.
+     */
+    fetch_size = DEFAULT_FDW_FETCH_SIZE;
+    foreach(lc, server->options)
+    {
+        DefElem    *def = (DefElem *) lfirst(lc);
+
+        if (strcmp(def->defname, "fetch_size") == 0)
+            fetch_size = strtol(defGetString(def), NULL, 10);
+    }
+    foreach(lc, table->options)
+    {
+        DefElem    *def = (DefElem *) lfirst(lc);
+
+        if (strcmp(def->defname, "fetch_size") == 0)
+            fetch_size = strtol(defGetString(def), NULL, 10);
+    }
+
     /*
      * Construct cursor that retrieves whole rows from remote.
      */
     cursor_number = GetCursorNumber(conn);
     initStringInfo(&sql);
-    appendStringInfo(&sql, "DECLARE c%u CURSOR FOR ", cursor_number);
     deparseAnalyzeSql(&sql, relation, &astate.retrieved_attrs);
 
     /* In what follows, do not risk leaking any Jresults. */
     PG_TRY();
     {
-        res = JQexec(conn, sql.data);
-        if (JQresultStatus(res) != PGRES_COMMAND_OK)
-            pgfdw_report_error(ERROR, res, conn, false, sql.data);
-        JQclear(res);
-        res = NULL;
+        JQsetFetchSize(conn, fetch_size);
+        JQdeclareCursor(conn, &cursor, cursor_number, sql.data);
 
         /* Retrieve and process rows a batch at a time. */
         for (;;)
         {
-            char        fetch_sql[64];
-            int         fetch_size;
+            bool        last_batch;
             int         numrows;
             int         i;
 
@@ -2282,15 +3316,9 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
              * then just adjust rowstoskip and samplerows appropriately.
              */
 
-            /* The fetch size is arbitrary, but shouldn't be enormous. */
-            fetch_size = 100;
-
             /* Fetch some rows */
-            snprintf(fetch_sql, sizeof(fetch_sql), "FETCH %d FROM c%u",
-                     fetch_size, cursor_number);
-
-            res = JQexec(conn, fetch_sql);
-            /* On error, report the original query, not the FETCH. */
+            res = JQfetch(conn, &cursor, fetch_size, JQ_TRANSFER_TEXT, NULL);
+            /* On error, report the original query. */
             if (JQresultStatus(res) != PGRES_TUPLES_OK)
                 pgfdw_report_error(ERROR, res, conn, false, sql.data);
 
@@ -2299,16 +3327,16 @@ postgresAcquireSampleRowsFunc(Relation relation, int elevel,
             for (i = 0; i < numrows; i++)
                 analyze_row_processor(res, i, &astate);
 
+            last_batch = JQlastbatch(res);
             JQclear(res);
             res = NULL;
 
-            /* Must be EOF if we didn't get all the rows requested. */
-            if (numrows < fetch_size)
+            if (last_batch)
                 break;
         }
 
         /* Close the cursor, just to be tidy. */
-        close_cursor(conn, cursor_number);
+        close_cursor(conn, &cursor);
     }
     PG_CATCH();
     {
@@ -2426,14 +3454,8 @@ make_tuple_from_result_row(Jresult *res,
     TupleDesc   tupdesc = RelationGetDescr(rel);
     Datum      *values;
     bool       *nulls;
-    ItemPointer ctid = NULL;
-    ConversionLocation errpos;
-    ErrorContextCallback errcallback;
+    ItemPointer ctid;
     MemoryContext oldcontext;
-    ListCell   *lc;
-    int         j;
-
-    Assert(row < JQntuples(res));
 
     /*
      * Do the following work in a temp context that we reset after each tuple.
@@ -2442,9 +3464,53 @@ make_tuple_from_result_row(Jresult *res,
      */
     oldcontext = MemoryContextSwitchTo(temp_context);
 
-    values = (Datum *) palloc0(tupdesc->natts * sizeof(Datum));
+    values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
     nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+    ctid = convert_result_row(res, row, rel, attinmeta, retrieved_attrs,
+                              values, nulls);
+
+    /*
+     * Build the result tuple in caller's memory context.
+     */
+    MemoryContextSwitchTo(oldcontext);
+
+    tuple = heap_form_tuple(tupdesc, values, nulls);
+
+    if (ctid)
+        tuple->t_self = *ctid;
+
+    /* Clean up */
+    MemoryContextReset(temp_context);
+
+    return tuple;
+}
+
+/*
+ * Convert the specified row of the Jresult into the values and nulls
+ * arrays of the rel's tupdesc.  Columns not present in the result are set
+ * to null.  Conversions are done in the current memory context.  Returns
+ * the ctid if the result has one, else NULL.
+ */
+static ItemPointer
+convert_result_row(Jresult *res,
+                   int row,
+                   Relation rel,
+                   AttInMetadata *attinmeta,
+                   List *retrieved_attrs,
+                   Datum *values,
+                   bool *nulls)
+{
+    TupleDesc   tupdesc = RelationGetDescr(rel);
+    ItemPointer ctid = NULL;
+    ConversionLocation errpos;
+    ErrorContextCallback errcallback;
+    ListCell   *lc;
+    int         j;
+
+    Assert(row < JQntuples(res));
+
     /* Initialize to nulls for any columns not present in result */
+    memset(values, 0, tupdesc->natts * sizeof(Datum));
     memset(nulls, true, tupdesc->natts * sizeof(bool));
 
     /*
@@ -2466,6 +3532,17 @@ make_tuple_from_result_row(Jresult *res,
         int         i = lfirst_int(lc);
         char       *valstr;
 
+        /* columns fetched in binary form need no input conversion */
+        if (i > 0 && JQhasdatum(res, j))
+        {
+            Assert(i <= tupdesc->natts);
+            nulls[i - 1] = JQgetisnull(res, row, j);
+            if (!nulls[i - 1])
+                values[i - 1] = JQgetdatum(res, row, j);
+            j++;
+            continue;
+        }
+
         /* fetch next column's textual value */
         if (JQgetisnull(res, row, j))
             valstr = NULL;
@@ -2511,20 +3588,37 @@ make_tuple_from_result_row(Jresult *res,
     if (j > 0 && j != JQnfields(res))
         elog(ERROR, "remote query result does not match the foreign table");
 
-    /*
-     * Build the result tuple in caller's memory context.
-     */
-    MemoryContextSwitchTo(oldcontext);
-
-    tuple = heap_form_tuple(tupdesc, values, nulls);
+    return ctid;
+}
 
-    if (ctid)
-        tuple->t_self = *ctid;
+/*
+ * Build the array of local types of the columns in a remote result, as
+ * expected by JQfetch in JQ_TRANSFER_TYPED and JQ_TRANSFER_BUFFER mode.  System columns, and
+ * columns whose typmod has to be applied by the input function, are given
+ * InvalidOid so that they are transferred as text.
+ */
+static Oid *
+get_retrieved_types(Relation rel, List *retrieved_attrs)
+{
+    TupleDesc   tupdesc = RelationGetDescr(rel);
+    Oid        *types;
+    ListCell   *lc;
+    int         j;
 
-    /* Clean up */
-    MemoryContextReset(temp_context);
+    /* deparse emits a NULL if no columns, so there is at least one */
+    types = (Oid *) palloc0(Max(list_length(retrieved_attrs), 1) * sizeof(Oid));
+    j = 0;
+    foreach(lc, retrieved_attrs)
+    {
+        int         i = lfirst_int(lc);
 
-    return tuple;
+        if (i > 0 && tupdesc->attrs[i - 1]->atttypmod < 0)
+            types[j] = tupdesc->attrs[i - 1]->atttypid;
+        else
+            types[j] = InvalidOid;
+        j++;
+    }
+    return types;
 }
 
 /*
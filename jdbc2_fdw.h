@@ -21,6 +21,92 @@
 #include "libpq-fe.h"
 #include "jq.h"
 
+/*
+ * Largest number of rows transferred from JDBCUtils in one batch, be it set
+ * by fetch_size or chosen from the fetch_bytes budget.
+ */
+#define MAX_FETCH_SIZE      100000
+
+/*
+ * How the remote server's LIMIT is spelled, if it has one.
+ */
+typedef enum JdbcLimitStyle
+{
+    JDBC_LIMIT_NONE,            /* rely on Statement.setMaxRows alone */
+    JDBC_LIMIT_LIMIT,           /* LIMIT n */
+    JDBC_LIMIT_FETCH_FIRST      /* FETCH FIRST n ROWS ONLY */
+} JdbcLimitStyle;
+
+/*
+ * Where the remote server puts NULLs in an ORDER BY.
+ */
+typedef enum JdbcNullsOrder
+{
+    JDBC_NULLS_CLAUSE,          /* understands NULLS FIRST/LAST */
+    JDBC_NULLS_LOW,             /* NULLs sort before all other values */
+    JDBC_NULLS_HIGH,            /* NULLs sort after all other values */
+    JDBC_NULLS_UNKNOWN          /* don't push ORDER BY down at all */
+} JdbcNullsOrder;
+
+/*
+ * SQL dialect of a remote server, see dialect.c.  Everything deparse.c
+ * writes for a non-PostgreSQL server has to be plain enough for all of
+ * them; these fields cover the rest.
+ */
+typedef struct JdbcDialect
+{
+    const char *name;           /* value of the dialect server option */
+    bool        postgres;       /* PostgreSQL: ship anything built-in */
+    char        quote_open;     /* identifier quotes */
+    char        quote_close;
+    bool        has_boolean;    /* boolean columns and literals exist */
+    bool        has_distinct_from;  /* IS DISTINCT FROM exists */
+    bool        backslash_escapes;  /* backslash is special in '...' */
+    bool        datetime_literals;  /* DATE '...', not CAST('...' AS date) */
+    JdbcLimitStyle limit_style;
+    JdbcNullsOrder nulls_order;
+} JdbcDialect;
+
+/*
+ * FDW-specific planner information kept in RelOptInfo.fdw_private for a
+ * foreign table.  This information is collected by jdbcGetForeignRelSize.
+ */
+typedef struct PgFdwRelationInfo
+{
+    /* baserestrictinfo clauses, broken down into safe and unsafe subsets. */
+    List       *remote_conds;
+    List       *local_conds;
+
+    /* Bitmap of attr numbers we need to fetch from the remote server. */
+    Bitmapset  *attrs_used;
+
+    /* Cost and selectivity of local_conds. */
+    QualCost    local_conds_cost;
+    Selectivity local_conds_sel;
+
+    /* Estimated size and cost for a scan with baserestrictinfo quals. */
+    double      rows;
+    int         width;
+    Cost        startup_cost;
+    Cost        total_cost;
+
+    /* Options extracted from catalogs. */
+    bool        use_remote_estimate;
+    Cost        fdw_startup_cost;
+    Cost        fdw_tuple_cost;
+    int         fetch_size;     /* rows per batch fetched from JDBCUtils */
+    int         fetch_bytes;    /* byte budget per batch, 0 for fixed size */
+    JtransferMode transfer_mode;    /* how batches cross the JNI boundary */
+    bool        bind_literals;  /* send constants as bind parameters */
+    bool        collation_compatible;   /* remote strings compare like ours */
+
+    /* Cached catalog information. */
+    ForeignTable *table;
+    ForeignServer *server;
+    UserMapping *user;          /* only set in use_remote_estimate mode */
+    const JdbcDialect *dialect; /* SQL dialect of the server */
+} PgFdwRelationInfo;
+
 /* in jdbc2_fdw.c */
 extern int  set_transmission_modes(void);
 extern void reset_transmission_modes(int nestlevel);
@@ -38,6 +124,20 @@ extern void pgfdw_report_error(int elevel, Jresult *res, Jconn *conn,
 extern int ExtractConnectionOptions(List *defelems,
                          const char **keywords,
                          const char **values);
+extern JtransferMode get_transfer_mode(const char *value);
+extern List *GetKeyAttrs(Relation rel);
+
+/* in dialect.c */
+extern const JdbcDialect *get_dialect(const char *value);
+extern const JdbcDialect *GetServerDialect(ForeignServer *server);
+extern const JdbcDialect *GetRelationDialect(Relation rel);
+extern const char *dialect_quote_identifier(const JdbcDialect *dialect,
+                         const char *ident);
+
+/* in mapping.c */
+extern char *GetRemoteTemplate(Oid classid, Oid objid,
+                  ForeignServer *server,
+                  const JdbcDialect *dialect);
 
 /* in deparse.c */
 extern void classifyConditions(PlannerInfo *root,
@@ -59,18 +159,38 @@ extern void appendWhereClause(StringInfo buf,
                   List *exprs,
                   bool is_first,
                   List **params);
+extern bool is_foreign_pathkey(PlannerInfo *root,
+                   RelOptInfo *baserel,
+                   PathKey *pathkey);
+extern void appendOrderByClause(StringInfo buf,
+                    PlannerInfo *root,
+                    RelOptInfo *baserel,
+                    List *pathkeys);
+extern void appendLimitClause(StringInfo buf,
+                  RelOptInfo *baserel,
+                  int max_rows);
 extern void deparseInsertSql(StringInfo buf, PlannerInfo *root,
                  Index rtindex, Relation rel,
                  List *targetAttrs, List *returningList,
                  List **retrieved_attrs);
 extern void deparseUpdateSql(StringInfo buf, PlannerInfo *root,
                  Index rtindex, Relation rel,
-                 List *targetAttrs, List *returningList,
+                 List *targetAttrs, List *keyAttrs,
+                 List *returningList,
                  List **retrieved_attrs);
 extern void deparseDeleteSql(StringInfo buf, PlannerInfo *root,
                  Index rtindex, Relation rel,
-                 List *returningList,
+                 List *keyAttrs, List *returningList,
                  List **retrieved_attrs);
+extern void deparseDirectUpdateSql(StringInfo buf, PlannerInfo *root,
+                       Index rtindex, Relation rel,
+                       RelOptInfo *baserel,
+                       List *targetlist, List *targetAttrs,
+                       List *remote_conds, List **params_list);
+extern void deparseDirectDeleteSql(StringInfo buf, PlannerInfo *root,
+                       Relation rel, RelOptInfo *baserel,
+                       List *remote_conds, List **params_list);
+extern void deparseCopySql(StringInfo buf, Relation rel, List *targetAttrs);
 extern void deparseAnalyzeSizeSql(StringInfo buf, Relation rel);
 extern void deparseAnalyzeSql(StringInfo buf, Relation rel,
                   List **retrieved_attrs);
@@ -11,15 +11,19 @@
 #include "catalog/pg_foreign_server.h"
 #include "catalog/pg_foreign_table.h"
 #include "catalog/pg_user_mapping.h"
+#include "catalog/pg_type.h"
 #include "storage/ipc.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 #include "foreign/fdwapi.h"
 #include "funcapi.h"
 #include "miscadmin.h"
 #include "commands/defrem.h"
+#include "mb/pg_wchar.h"
 #include "libpq-fe.h"
 
 #include "jni.h"
@@ -28,6 +32,29 @@
 #define StrValue(arg) Str(arg)
 #define STR_PKGLIBDIR StrValue(PKG_LIB_DIR)
 
+/* Default limit on the size of the batches read ahead by JDBCPrefetcher */
+#define DEFAULT_PREFETCH_BYTES  (64 * 1024 * 1024)
+
+/* Default number of idle prepared statements kept per connection */
+#define DEFAULT_STATEMENT_CACHE_SIZE    100
+
+/*
+ * Type codes passed to JDBCUtils.returnResultSetTyped, these must match
+ * the TYPE_* constants in JDBCUtils.java
+ */
+#define JAVA_TYPE_STRING    0
+#define JAVA_TYPE_SHORT     1
+#define JAVA_TYPE_INT       2
+#define JAVA_TYPE_LONG      3
+#define JAVA_TYPE_FLOAT     4
+#define JAVA_TYPE_DOUBLE    5
+#define JAVA_TYPE_BOOLEAN   6
+#define JAVA_TYPE_DATE      7
+#define JAVA_TYPE_TIMESTAMP 8
+/* Only used for the parameters of prepared statements */
+#define JAVA_TYPE_NUMERIC   9
+#define JAVA_TYPE_OTHER     10
+
 /*
  * Local housekeeping functions and Java objects
  */
@@ -55,15 +82,77 @@ typedef struct JserverOptions{
     int querytimeout;
     char *jarfile;
     int maxheapsize;
+    int prefetch_batches;
+    int prefetch_bytes;
+    int statement_cache_size;
 } JserverOptions;
 
 static JserverOptions opts;
 
+/*
+ * JNI handles for the Java classes, methods and fields used by this file.
+ * They never change once the JVM is created, so they are looked up a single
+ * time in JVMInit() and the classes are kept as global references.
+ */
+typedef struct JDBCUtilsHandles{
+    jclass JDBCUtilsClass;
+    jclass JavaStringClass;
+    jmethodID idCreateConnection;
+    jmethodID idCreateStatement;
+    jmethodID idReturnResultSetBatch;
+    jmethodID idReturnResultSetTyped;
+    jmethodID idReturnResultSetBuffer;
+    jmethodID idCloseStatement;
+    jmethodID idCloseConnection;
+    jmethodID idCancel;
+    jmethodID idPrepareStatement;
+    jmethodID idExecutePrepared;
+    jmethodID idDeallocate;
+    jmethodID idAddBatch;
+    jmethodID idExecuteBatch;
+    jmethodID idCopyIn;
+    jmethodID idCursorColumns;
+    jmethodID idBeginTransaction;
+    jmethodID idEndTransaction;
+    jmethodID idSetSavepoint;
+    jmethodID idEndSavepoint;
+    jfieldID idNumberOfBatchRows;
+    jfieldID idLastBatch;
+    jfieldID idBatchError;
+    jfieldID idReturnedRows;
+    jfieldID idReturnedColumns;
+    jfieldID idUpdateCount;
+} JDBCUtilsHandles;
+
+static JDBCUtilsHandles handles;
+
 /* Local function prototypes */
 static int connectDBComplete(Jconn *conn);
 static void JVMInit(const ForeignServer *server, const UserMapping *user);
 static void jdbcGetServerOptions(JserverOptions *opts, const ForeignServer *f_server, const UserMapping *f_mapping);
 static Jconn * createJDBCConnection(const ForeignServer *server, const UserMapping *user);
+static void JDBCUtilsHandlesInit(void);
+static jclass FindGlobalClass(const char *name);
+static void JQfetchText(Jconn *conn, jdbcFdwExecutionState *festate, Jresult *res, int fetch_size);
+static void JQfetchTyped(Jconn *conn, jdbcFdwExecutionState *festate, Jresult *res, int fetch_size,
+    const Oid *coltypes);
+static void JQfetchBuffer(Jconn *conn, jdbcFdwExecutionState *festate, Jresult *res, int fetch_size,
+    const Oid *coltypes);
+static Datum BufferSlotToDatum(int typeCode, const char *slot);
+#ifdef HAVE_INT64_TIMESTAMP
+static DateADT UnixToDate(int32 days);
+static Timestamp UnixToTimestamp(int64 micros);
+#endif
+static jintArray NewTypeCodeArray(const Oid *coltypes, int nfields, jint *typeCodes);
+static void StoreTypedColumn(Jresult *res, int col, int typeCode, const void *values);
+static int JavaTypeCode(Oid typid);
+static int CopyJavaString(StringInfo buf, jstring cell);
+static void StoreTextCells(Jresult *res, jobjectArray cells);
+static int JavaParamTypeCode(Oid typid);
+static jobjectArray NewStringArray(int nvalues, const char *const *values);
+static void ExecutePrepared(Jconn *conn, const char *stmtName, int nParams,
+    const char *const *paramValues, int cursor_number);
+static void InitCursor(Jconn *conn, jdbcFdwExecutionState *festate, unsigned int cursor_number);
 /*
  * Uses a String object's content to create an instance of C String
  */
@@ -86,21 +175,10 @@ SIGINTInterruptCheckProcess()
 {
 
 	if (InterruptFlag == true) {
-		jclass JDBCUtilsClass;
-		jmethodID id_cancel;
 		jstring cancel_result = NULL;
 		char *cancel_result_cstring = NULL;
 
-		JDBCUtilsClass = (*Jenv)->FindClass(Jenv, "JDBCUtils");
-		if (JDBCUtilsClass == NULL) {
-			elog(ERROR, "JDBCUtilsClass is NULL");
-		}
-		id_cancel = (*Jenv)->GetMethodID(Jenv, JDBCUtilsClass, "cancel",
-				"()Ljava/lang/String;");
-		if (id_cancel == NULL) {
-			elog(ERROR, "id_cancel is NULL");
-		}
-		cancel_result = (*Jenv)->CallObjectMethod(Jenv, java_call, id_cancel);
+		cancel_result = (*Jenv)->CallObjectMethod(Jenv, java_call, handles.idCancel);
 		if (cancel_result != NULL) {
 			cancel_result_cstring = ConvertStringToCString(
 					(jobject) cancel_result);
@@ -121,13 +199,11 @@ SIGINTInterruptCheckProcess()
  */
 static char*
 ConvertStringToCString(jobject java_cstring) {
-	jclass JavaString;
 	char *StringPointer;
 
 	SIGINTInterruptCheckProcess();
 
-	JavaString = (*Jenv)->FindClass(Jenv, "java/lang/String");
-	if (!((*Jenv)->IsInstanceOf(Jenv, java_cstring, JavaString))) {
+	if (!((*Jenv)->IsInstanceOf(Jenv, java_cstring, handles.JavaStringClass))) {
 		elog(ERROR, "Object not an instance of String class");
 	}
 
@@ -169,6 +245,9 @@ JVMInit(const ForeignServer *server, const UserMapping *user)
     char *classpath;
     char *maxheapsizeoption = NULL;
     opts.maxheapsize = 0;
+    opts.prefetch_batches = 0;
+    opts.prefetch_bytes = DEFAULT_PREFETCH_BYTES;
+    opts.statement_cache_size = DEFAULT_STATEMENT_CACHE_SIZE;
 
     jdbcGetServerOptions(&opts, server, user); // Get the maxheapsize value (if set)
 
@@ -203,6 +282,7 @@ JVMInit(const ForeignServer *server, const UserMapping *user)
                  ));
         }
         ereport(DEBUG3, (errmsg("Successfully created a JVM with %d MB heapsize", opts.maxheapsize)));
+        JDBCUtilsHandlesInit();
         InterruptFlag = false;
         /* Register an on_proc_exit handler that shuts down the JVM.*/
         on_proc_exit(DestroyJVM, 0);
@@ -210,6 +290,160 @@ JVMInit(const ForeignServer *server, const UserMapping *user)
     }
 }
 
+/*
+ * FindGlobalClass
+ *      Look up a Java class and return a global reference to it, so it
+ *      stays valid across JNI calls.
+ */
+static jclass
+FindGlobalClass(const char *name)
+{
+    jclass localClass;
+    jclass globalClass;
+
+    localClass = (*Jenv)->FindClass(Jenv, name);
+    if (localClass == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the %s class!", name)));
+    }
+    globalClass = (jclass) (*Jenv)->NewGlobalRef(Jenv, localClass);
+    (*Jenv)->DeleteLocalRef(Jenv, localClass);
+    if (globalClass == NULL) {
+        ereport(ERROR, (errmsg("Failed to create a global reference to the %s class", name)));
+    }
+    return globalClass;
+}
+
+/*
+ * JDBCUtilsHandlesInit
+ *      Populate the registry of JNI handles used by the JQ functions.
+ *      Called once, right after the JVM has been created.
+ */
+static void
+JDBCUtilsHandlesInit(void)
+{
+    handles.JDBCUtilsClass = FindGlobalClass("JDBCUtils");
+    handles.JavaStringClass = FindGlobalClass("java/lang/String");
+
+    handles.idCreateConnection = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "createConnection",
+                                                "([Ljava/lang/String;)Ljava/lang/String;");
+    if (handles.idCreateConnection == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.createConnection method!")));
+    }
+    handles.idCreateStatement = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "createStatement",
+                                                "(ILjava/lang/String;I)Ljava/lang/String;");
+    if (handles.idCreateStatement == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.createStatement method!")));
+    }
+    handles.idReturnResultSetBatch = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "returnResultSetBatch",
+                                                "(II)[Ljava/lang/String;");
+    if (handles.idReturnResultSetBatch == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.returnResultSetBatch method!")));
+    }
+    handles.idReturnResultSetTyped = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "returnResultSetTyped",
+                                                "(II[I)[Ljava/lang/Object;");
+    if (handles.idReturnResultSetTyped == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.returnResultSetTyped method!")));
+    }
+    handles.idReturnResultSetBuffer = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "returnResultSetBuffer",
+                                                "(II[I)Ljava/nio/ByteBuffer;");
+    if (handles.idReturnResultSetBuffer == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.returnResultSetBuffer method!")));
+    }
+    handles.idCloseStatement = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "closeStatement",
+                                                "(I)Ljava/lang/String;");
+    if (handles.idCloseStatement == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.closeStatement method!")));
+    }
+    handles.idCloseConnection = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "closeConnection",
+                                                "()Ljava/lang/String;");
+    if (handles.idCloseConnection == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.closeConnection method!")));
+    }
+    handles.idCancel = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "cancel",
+                                                "()Ljava/lang/String;");
+    if (handles.idCancel == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.cancel method!")));
+    }
+    handles.idPrepareStatement = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "prepareStatement",
+                                                "(Ljava/lang/String;Ljava/lang/String;[I)Ljava/lang/String;");
+    if (handles.idPrepareStatement == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.prepareStatement method!")));
+    }
+    handles.idExecutePrepared = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "executePrepared",
+                                                "(Ljava/lang/String;[Ljava/lang/String;III)Ljava/lang/String;");
+    if (handles.idExecutePrepared == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.executePrepared method!")));
+    }
+    handles.idDeallocate = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "deallocate",
+                                                "(Ljava/lang/String;)Ljava/lang/String;");
+    if (handles.idDeallocate == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.deallocate method!")));
+    }
+    handles.idAddBatch = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "addBatch",
+                                                "(Ljava/lang/String;[Ljava/lang/String;)Ljava/lang/String;");
+    if (handles.idAddBatch == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.addBatch method!")));
+    }
+    handles.idExecuteBatch = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "executeBatch",
+                                                "(Ljava/lang/String;)Ljava/lang/String;");
+    if (handles.idExecuteBatch == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.executeBatch method!")));
+    }
+    handles.idCopyIn = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "copyIn",
+                                                "(Ljava/lang/String;[B)Ljava/lang/String;");
+    if (handles.idCopyIn == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.copyIn method!")));
+    }
+    handles.idCursorColumns = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "cursorColumns", "(I)I");
+    if (handles.idCursorColumns == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.cursorColumns method!")));
+    }
+    handles.idBeginTransaction = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "beginTransaction",
+                                                "(Z)Ljava/lang/String;");
+    if (handles.idBeginTransaction == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.beginTransaction method!")));
+    }
+    handles.idEndTransaction = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "endTransaction",
+                                                "(Z)Ljava/lang/String;");
+    if (handles.idEndTransaction == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.endTransaction method!")));
+    }
+    handles.idSetSavepoint = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "setSavepoint",
+                                                "(I)Ljava/lang/String;");
+    if (handles.idSetSavepoint == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.setSavepoint method!")));
+    }
+    handles.idEndSavepoint = (*Jenv)->GetMethodID(Jenv, handles.JDBCUtilsClass, "endSavepoint",
+                                                "(IZ)Ljava/lang/String;");
+    if (handles.idEndSavepoint == NULL) {
+        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.endSavepoint method!")));
+    }
+    handles.idNumberOfBatchRows = (*Jenv)->GetFieldID(Jenv, handles.JDBCUtilsClass, "numberOfBatchRows", "I");
+    if (handles.idNumberOfBatchRows == NULL) {
+        ereport(ERROR, (errmsg("Cannot read the number of rows in a batch")));
+    }
+    handles.idLastBatch = (*Jenv)->GetFieldID(Jenv, handles.JDBCUtilsClass, "lastBatch", "Z");
+    if (handles.idLastBatch == NULL) {
+        ereport(ERROR, (errmsg("Cannot read the last batch flag")));
+    }
+    handles.idBatchError = (*Jenv)->GetFieldID(Jenv, handles.JDBCUtilsClass, "batchError", "Ljava/lang/String;");
+    if (handles.idBatchError == NULL) {
+        ereport(ERROR, (errmsg("Cannot read the error of a batch")));
+    }
+    handles.idReturnedRows = (*Jenv)->GetFieldID(Jenv, handles.JDBCUtilsClass, "returnedRows", "[Ljava/lang/String;");
+    if (handles.idReturnedRows == NULL) {
+        ereport(ERROR, (errmsg("Cannot read the rows returned by a prepared statement")));
+    }
+    handles.idReturnedColumns = (*Jenv)->GetFieldID(Jenv, handles.JDBCUtilsClass, "returnedColumns", "I");
+    if (handles.idReturnedColumns == NULL) {
+        ereport(ERROR, (errmsg("Cannot read the number of columns returned by a prepared statement")));
+    }
+    handles.idUpdateCount = (*Jenv)->GetFieldID(Jenv, handles.JDBCUtilsClass, "updateCount", "I");
+    if (handles.idUpdateCount == NULL) {
+        ereport(ERROR, (errmsg("Cannot read the update count of a prepared statement")));
+    }
+}
+
 /*
  * Create an actual JDBC connection to the foreign server.
  * Precondition: JVMInit() has been successfully called.
@@ -221,34 +455,29 @@ JVMInit(const ForeignServer *server, const UserMapping *user)
 static Jconn *
 createJDBCConnection(const ForeignServer *server, const UserMapping *user)
 {
-    jmethodID idCreate;
-    jstring stringArray[6];
-    jclass javaString;
+    jstring stringArray[9];
     jobjectArray argArray;
     jstring connResult;
-    jclass JDBCUtilsClass;
+    jobject utilsObject;
     char *querytimeout_string;
+    char *prefetch_batches_string;
+    char *prefetch_bytes_string;
+    char *statement_cache_size_string;
     char *cString = NULL;
     int i;
     int numParams = sizeof(stringArray)/sizeof(jstring); //Number of parameters to Java
     int intSize = 10; // The string size to allocate for an integer value
 
-    // pfree() when connection is discarded in JQfinish()
-    Jconn *conn = (Jconn *)palloc(sizeof(Jconn));
+    // pfree() when connection is discarded in JQfinish(). The connection
+    // is cached across transactions, like a PGconn it must outlive them.
+    Jconn *conn = (Jconn *)MemoryContextAlloc(TopMemoryContext, sizeof(Jconn));
     conn->status = CONNECTION_BAD; // Be pessimistic
-    conn->festate = (jdbcFdwExecutionState *) palloc(sizeof(jdbcFdwExecutionState));
-    conn->festate->query = NULL;
-    conn->festate->NumberOfRows = 0;
-    conn->festate->NumberOfColumns = 0;
-    JDBCUtilsClass = (*Jenv)->FindClass(Jenv, "JDBCUtils");
-    if(JDBCUtilsClass == NULL){
-        ereport(ERROR, (errmsg("Failed to find the JDBCUtils class!")));
-    }
-    idCreate = (*Jenv)->GetMethodID(Jenv, JDBCUtilsClass, "createConnection",
-                                                "([Ljava/lang/String;)Ljava/lang/String;");
-    if(idCreate == NULL){
-        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.createConnection method!")));
-    }
+    conn->fetchSize = 0;
+    conn->maxRows = 0;
+    conn->ncursors = 0;
+    conn->nprepared = 0;
+    conn->inTransaction = false;
+    conn->utilsObject = NULL;
     // Construct the array to pass our parameters
     // Query timeout is an int, we need a string
     querytimeout_string = (char *)palloc(intSize);
@@ -259,21 +488,31 @@ createJDBCConnection(const ForeignServer *server, const UserMapping *user)
     stringArray[3] = (*Jenv)->NewStringUTF(Jenv, opts.password);
     stringArray[4] = (*Jenv)->NewStringUTF(Jenv, querytimeout_string);
     stringArray[5] = (*Jenv)->NewStringUTF(Jenv, opts.jarfile);
+    prefetch_batches_string = (char *)palloc(intSize + 1);
+    snprintf(prefetch_batches_string, intSize + 1, "%d", opts.prefetch_batches);
+    stringArray[6] = (*Jenv)->NewStringUTF(Jenv, prefetch_batches_string);
+    prefetch_bytes_string = (char *)palloc(intSize + 1);
+    snprintf(prefetch_bytes_string, intSize + 1, "%d", opts.prefetch_bytes);
+    stringArray[7] = (*Jenv)->NewStringUTF(Jenv, prefetch_bytes_string);
+    statement_cache_size_string = (char *)palloc(intSize + 1);
+    snprintf(statement_cache_size_string, intSize + 1, "%d", opts.statement_cache_size);
+    stringArray[8] = (*Jenv)->NewStringUTF(Jenv, statement_cache_size_string);
     // Set up the return value
-    javaString = (*Jenv)->FindClass(Jenv, "java/lang/String");
-    argArray = (*Jenv)->NewObjectArray(Jenv, numParams, javaString, stringArray[0]);
+    argArray = (*Jenv)->NewObjectArray(Jenv, numParams, handles.JavaStringClass, stringArray[0]);
     if(argArray == NULL){
         ereport(ERROR, (errmsg("Failed to create argument array")));
     }
     for(i = 1; i < numParams; i++){
         (*Jenv)->SetObjectArrayElement(Jenv, argArray, i, stringArray[i]);
     }
-    conn->utilsObject = (*Jenv)->AllocObject(Jenv, JDBCUtilsClass);
-    if(conn->utilsObject == NULL){
+    utilsObject = (*Jenv)->AllocObject(Jenv, handles.JDBCUtilsClass);
+    if(utilsObject == NULL){
         ereport(ERROR, (errmsg("Failed to create java call")));
     }
+    conn->utilsObject = (*Jenv)->NewGlobalRef(Jenv, utilsObject);
+    (*Jenv)->DeleteLocalRef(Jenv, utilsObject);
     connResult = NULL;
-    connResult = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, idCreate, argArray);
+    connResult = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idCreateConnection, argArray);
     if(connResult != NULL){  // Happy result is null
         cString = ConvertStringToCString((jobject)connResult);
         ereport(ERROR, (errmsg("%s", cString)));
@@ -326,6 +565,15 @@ jdbcGetServerOptions(JserverOptions *opts, const ForeignServer *f_server, const
         if (strcmp(def->defname, "maxheapsize") == 0){
             opts->maxheapsize = atoi(defGetString(def));
         }
+        if (strcmp(def->defname, "prefetch_batches") == 0){
+            opts->prefetch_batches = atoi(defGetString(def));
+        }
+        if (strcmp(def->defname, "prefetch_bytes") == 0){
+            opts->prefetch_bytes = atoi(defGetString(def));
+        }
+        if (strcmp(def->defname, "statement_cache_size") == 0){
+            opts->statement_cache_size = atoi(defGetString(def));
+        }
         if (strcmp(def->defname, "password") == 0){
             opts->password = defGetString(def);
         }
@@ -335,127 +583,796 @@ jdbcGetServerOptions(JserverOptions *opts, const ForeignServer *f_server, const
     }
 }
 
+/*
+ * JQexec:
+ * 		Execute a command and wait for its result, like PQexec. Rows are
+ * 		read right away, use JQdeclareCursor to read them in batches.
+ */
 Jresult *
 JQexec(Jconn *conn, const char *query)
 {
-	jmethodID idCreateStatement;
+	ereport(DEBUG3, (errmsg("JQexec(%p): %s", conn, query)));
+	return JQexecParams(conn, query, 0, NULL, NULL, NULL, NULL, 0);
+}
+
+/*
+ * InitCursor:
+ * 		Set up the execution state of a result set just opened as
+ * 		cursor_number
+ */
+static void
+InitCursor(Jconn *conn, jdbcFdwExecutionState *festate, unsigned int cursor_number)
+{
+	festate->cursor = cursor_number;
+	festate->NumberOfColumns = (*Jenv)->CallIntMethod(Jenv, conn->utilsObject, handles.idCursorColumns,
+	                                                  (jint) cursor_number);
+	festate->NumberOfRows = 0;
+	festate->batchBuffer = NULL;
+	festate->batchAddress = NULL;
+	conn->ncursors++;
+}
+
+/*
+ * JQdeclareCursor:
+ * 		Run query and keep its result set open as cursor cursor_number, to
+ * 		be read with JQfetch. Other cursors of the connection stay open,
+ * 		so several scans can be interleaved. festate is filled in with the
+ * 		execution state of the cursor.
+ */
+void
+JQdeclareCursor(Jconn *conn, jdbcFdwExecutionState *festate, unsigned int cursor_number,
+    const char *query)
+{
 	jstring statement;
 	jstring returnValue;
-	jclass JDBCUtilsClass;
-	jfieldID idNumberOfColumns;
 	char *cString = NULL;
-	Jresult *res;
 
-	ereport(DEBUG3, (errmsg("JQexec(%p): %s", conn, query)));
+	ereport(DEBUG3, (errmsg("JQdeclareCursor(%p, %u): %s", conn, cursor_number, query)));
     // Our object of the JDBCUtils class is on the connection
     if(conn->utilsObject == NULL){
         ereport(ERROR, (errmsg("utilsObject is not on connection! Has the connection not been created?")));
-    }
-	//TODO: Need to reclaim this memory
-	res = (Jresult *)palloc(sizeof(Jresult));
-	res->resultStatus = PGRES_FATAL_ERROR; // Be pessimistic
-
-    JDBCUtilsClass = (*Jenv)->FindClass(Jenv, "JDBCUtils");
-	if(JDBCUtilsClass == NULL){
-        ereport(ERROR, (errmsg("JDBCUtils class could not be created")));
-    }
-    idCreateStatement = (*Jenv)->GetMethodID(Jenv, JDBCUtilsClass, "createStatement",
-                                                "(Ljava/lang/String;)Ljava/lang/String;");
-    if(idCreateStatement == NULL){
-        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.createStatement method!")));
     }
     // The query argument
     statement = (*Jenv)->NewStringUTF(Jenv, query);
     if(statement == NULL){
         ereport(ERROR, (errmsg("Failed to create query argument")));
     }
-    returnValue = NULL;
-    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, idCreateStatement, statement);
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idCreateStatement,
+                                            (jint) cursor_number, statement, (jint) conn->fetchSize);
     if(returnValue != NULL){  // Happy return Value is null
         cString = ConvertStringToCString((jobject)returnValue);
         ereport(ERROR, (errmsg("%s", cString)));
     }
     // Set up the execution state
-    idNumberOfColumns = (*Jenv)->GetFieldID(Jenv, JDBCUtilsClass, "numberOfColumns" , "I");
-    if (idNumberOfColumns == NULL){
-            ereport(ERROR, (errmsg("Cannot read the number of columns")));
-    }
-    conn->festate->NumberOfColumns = (*Jenv)->GetIntField(Jenv, conn->utilsObject, idNumberOfColumns);
+    festate->query = (char *) query;
+    InitCursor(conn, festate, cursor_number);
     // Return Java memory
     (*Jenv)->DeleteLocalRef(Jenv, statement);
-    (*Jenv)->ReleaseStringUTFChars(Jenv, returnValue, cString);
-    (*Jenv)->DeleteLocalRef(Jenv, returnValue);
-    res->resultStatus = PGRES_COMMAND_OK;
-    return res;
 }
 
 /*
- * JQiterate:
- * 		Read the next row from the remote server
+ * JQfetch:
+ * 		Read the next batch of up to fetch_size rows from the remote server.
+ * 		In JQ_TRANSFER_TYPED and JQ_TRANSFER_BUFFER mode coltypes holds the
+ * 		local type of each result column, columns of a type with a native
+ * 		JDBC getter are returned as Datums and the rest as text. The values
+ * 		are allocated in the current memory context. The batch may hold a
+ * 		different number of rows than asked for when batches are prefetched,
+ * 		JQlastbatch tells whether the end of data was reached. If reading
+ * 		the batch failed the result has PGRES_FATAL_ERROR status, with the
+ * 		Java stack trace as its message.
  */
-TupleTableSlot *
-JQiterate(Jconn *conn, ForeignScanState *node){
-	jobject utilsObject;
-	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
-	jclass JDBCUtilsClass;
-	jmethodID idResultSet;
-	jobjectArray rowArray;
-	char **values;
-	int numberOfColumns;
-	int i;
-	HeapTuple tuple;
-	jstring tempString;
+Jresult *
+JQfetch(Jconn *conn, jdbcFdwExecutionState *festate, int fetch_size, JtransferMode mode,
+    const Oid *coltypes)
+{
+	Jresult *res;
+	jstring batchError;
 
-	numberOfColumns = conn->festate->NumberOfColumns;
-	utilsObject = conn->utilsObject;
-	if(utilsObject == NULL){
+	if(conn->utilsObject == NULL){
 		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
 	}
-	// Cleanup
-	ExecClearTuple(slot);
+	res = (Jresult *)palloc0(sizeof(Jresult));
+	res->resultStatus = PGRES_TUPLES_OK;
+	res->nfields = festate->NumberOfColumns;
+	res->lastbatch = true;
 	SIGINTInterruptCheckProcess();
-	if((*Jenv)->PushLocalFrame(Jenv, (numberOfColumns + 10)) < 0){
-		ereport(ERROR, (errmsg("Error pushing local java frame")));
-	}
-    JDBCUtilsClass = (*Jenv)->FindClass(Jenv, "JDBCUtils");
-	if(JDBCUtilsClass == NULL){
-        ereport(ERROR, (errmsg("JDBCUtils class could not be created")));
-    }
-    idResultSet = (*Jenv)->GetMethodID(Jenv, JDBCUtilsClass, "returnResultSet", "()[Ljava/lang/String;");
-    if(idResultSet == NULL){
-        ereport(ERROR, (errmsg("Failed to find the JDBCUtils.returnResultSet method!")));
-    }
-	// Allocate pointers to the row data
-    values=(char **)palloc(numberOfColumns * sizeof(char *));
-    rowArray = (*Jenv)->CallObjectMethod(Jenv, utilsObject, idResultSet);
-    if(rowArray != NULL){
-    	for(i=0; i < numberOfColumns; i++){
-    		values[i] = ConvertStringToCString((jobject)(*Jenv)->GetObjectArrayElement(Jenv, rowArray, i));
+	if(res->nfields <= 0){
+		return res;
+	}
+	if(mode == JQ_TRANSFER_BUFFER){
+		JQfetchBuffer(conn, festate, res, fetch_size, coltypes);
+	} else if(mode == JQ_TRANSFER_TYPED && coltypes != NULL){
+		JQfetchTyped(conn, festate, res, fetch_size, coltypes);
+	} else {
+		JQfetchText(conn, festate, res, fetch_size);
+	}
+	batchError = (jstring)(*Jenv)->GetObjectField(Jenv, conn->utilsObject, handles.idBatchError);
+	if(batchError != NULL){
+		char *cString = ConvertStringToCString((jobject)batchError);
+
+		res->resultStatus = PGRES_FATAL_ERROR;
+		res->errorMessage = pstrdup(cString);
+		(*Jenv)->ReleaseStringUTFChars(Jenv, batchError, cString);
+		(*Jenv)->DeleteLocalRef(Jenv, batchError);
+		return res;
+	}
+	res->lastbatch = (*Jenv)->GetBooleanField(Jenv, conn->utilsObject, handles.idLastBatch);
+	festate->NumberOfRows += res->ntuples;
+	return res;
+}
+
+/*
+ * JQfetchText:
+ * 		Fetch a batch with every value converted to a Java String. The
+ * 		values are copied into a single buffer.
+ */
+static void
+JQfetchText(Jconn *conn, jdbcFdwExecutionState *festate, Jresult *res, int fetch_size)
+{
+	jobjectArray batchArray;
+
+    batchArray = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idReturnResultSetBatch,
+                                           (jint) festate->cursor, (jint) fetch_size);
+    if(batchArray == NULL){
+    	return;
+    }
+    StoreTextCells(res, batchArray);
+    (*Jenv)->DeleteLocalRef(Jenv, batchArray);
+}
+
+/*
+ * StoreTextCells:
+ * 		Copy a row-major array of Java Strings, res->nfields to a row, into
+ * 		res->values
+ */
+static void
+StoreTextCells(Jresult *res, jobjectArray cells)
+{
+	jstring cell;
+	StringInfoData data;
+	int *offsets;
+	int numberOfCells;
+	int i;
+
+    numberOfCells = (*Jenv)->GetArrayLength(Jenv, cells);
+    res->ntuples = numberOfCells / res->nfields;
+    // Copy all the cells into one buffer, remembering where each one starts
+    offsets = (int *)palloc(numberOfCells * sizeof(int));
+    initStringInfo(&data);
+    for(i=0; i < numberOfCells; i++){
+    	cell = (jstring)(*Jenv)->GetObjectArrayElement(Jenv, cells, i);
+    	offsets[i] = CopyJavaString(&data, cell);
+    	(*Jenv)->DeleteLocalRef(Jenv, cell);
+    }
+    // The buffer is final now, so the offsets can be turned into pointers
+    res->data = data.data;
+    res->nbytes += data.len;
+    res->values = (char **)palloc(numberOfCells * sizeof(char *));
+    for(i=0; i < numberOfCells; i++){
+    	res->values[i] = (offsets[i] < 0) ? NULL : res->data + offsets[i];
+    }
+    pfree(offsets);
+}
+
+/*
+ * JQfetchTyped:
+ * 		Fetch a batch in columnar form. Each column arrives as a primitive
+ * 		Java array which is turned into Datums directly, skipping the text
+ * 		output and input functions. Columns without a native getter arrive
+ * 		as String arrays and are copied like in JQfetchText.
+ */
+static void
+JQfetchTyped(Jconn *conn, jdbcFdwExecutionState *festate, Jresult *res, int fetch_size,
+    const Oid *coltypes)
+{
+	jint *typeCodes;
+	jintArray typeCodeArray;
+	jobjectArray batchArray;
+	StringInfoData data;
+	int *offsets;
+	int nfields = res->nfields;
+	int ntuples;
+	int numberOfCells;
+	int col;
+	int row;
+	int i;
+
+	typeCodes = (jint *)palloc(nfields * sizeof(jint));
+	typeCodeArray = NewTypeCodeArray(coltypes, nfields, typeCodes);
+    batchArray = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idReturnResultSetTyped,
+                                           (jint) festate->cursor, (jint) fetch_size, typeCodeArray);
+    (*Jenv)->DeleteLocalRef(Jenv, typeCodeArray);
+    if(batchArray == NULL){
+    	pfree(typeCodes);
+    	return;
+    }
+    ntuples = (*Jenv)->GetIntField(Jenv, conn->utilsObject, handles.idNumberOfBatchRows);
+    numberOfCells = ntuples * nfields;
+    res->ntuples = ntuples;
+    res->typed = (bool *)palloc0(nfields * sizeof(bool));
+    res->datums = (Datum *)palloc0(numberOfCells * sizeof(Datum));
+    res->nulls = (bool *)palloc0(numberOfCells * sizeof(bool));
+    offsets = (int *)palloc(numberOfCells * sizeof(int));
+    for(i=0; i < numberOfCells; i++){
+    	offsets[i] = -1;
+    }
+    initStringInfo(&data);
+    for(col=0; col < nfields; col++){
+    	jarray column = (jarray)(*Jenv)->GetObjectArrayElement(Jenv, batchArray, 2 * col);
+    	jbooleanArray nullArray = (jbooleanArray)(*Jenv)->GetObjectArrayElement(Jenv, batchArray, 2 * col + 1);
+
+    	if(typeCodes[col] == JAVA_TYPE_STRING){
+    		for(row=0; row < ntuples; row++){
+    			jstring cell = (jstring)(*Jenv)->GetObjectArrayElement(Jenv, (jobjectArray)column, row);
+
+    			offsets[row * nfields + col] = CopyJavaString(&data, cell);
+    			(*Jenv)->DeleteLocalRef(Jenv, cell);
+    		}
+    	} else {
+    		jboolean *isnull;
+    		void *values;
+
+    		res->typed[col] = true;
+    		res->nbytes += ntuples * sizeof(Datum);
+    		// No JNI calls are allowed until both arrays are released
+    		isnull = (jboolean *)(*Jenv)->GetPrimitiveArrayCritical(Jenv, nullArray, NULL);
+    		values = (*Jenv)->GetPrimitiveArrayCritical(Jenv, column, NULL);
+    		if(isnull == NULL || values == NULL){
+    			if(values != NULL){
+    				(*Jenv)->ReleasePrimitiveArrayCritical(Jenv, column, values, JNI_ABORT);
+    			}
+    			if(isnull != NULL){
+    				(*Jenv)->ReleasePrimitiveArrayCritical(Jenv, nullArray, isnull, JNI_ABORT);
+    			}
+    			ereport(ERROR, (errmsg("Failed to access the values of column %d", col + 1)));
+    		}
+    		for(row=0; row < ntuples; row++){
+    			res->nulls[row * nfields + col] = (isnull[row] != JNI_FALSE);
+    		}
+    		StoreTypedColumn(res, col, typeCodes[col], values);
+    		(*Jenv)->ReleasePrimitiveArrayCritical(Jenv, column, values, JNI_ABORT);
+    		(*Jenv)->ReleasePrimitiveArrayCritical(Jenv, nullArray, isnull, JNI_ABORT);
+    	}
+    	(*Jenv)->DeleteLocalRef(Jenv, column);
+    	(*Jenv)->DeleteLocalRef(Jenv, nullArray);
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, batchArray);
+    res->data = data.data;
+    res->nbytes += data.len;
+    res->values = (char **)palloc(numberOfCells * sizeof(char *));
+    for(i=0; i < numberOfCells; i++){
+    	res->values[i] = (offsets[i] < 0) ? NULL : res->data + offsets[i];
+    }
+    pfree(offsets);
+    pfree(typeCodes);
+}
+
+/*
+ * JQfetchBuffer:
+ * 		Fetch a batch serialized by JDBCUtils.returnResultSetBuffer into a
+ * 		direct ByteBuffer and decode it in place. The buffer is reused by
+ * 		Java from batch to batch, so its address is only looked up again
+ * 		when Java had to replace it with a bigger one.
+ */
+static void
+JQfetchBuffer(Jconn *conn, jdbcFdwExecutionState *festate, Jresult *res, int fetch_size,
+    const Oid *coltypes)
+{
+	jint *typeCodes;
+	jintArray typeCodeArray;
+	jobject buffer;
+	StringInfoData data;
+	const char *base;
+	int32 header[2];
+	int *offsets;
+	int nfields = res->nfields;
+	int ntuples;
+	int numberOfCells;
+	int col;
+	int row;
+	int i;
+
+	typeCodes = (jint *)palloc(nfields * sizeof(jint));
+	typeCodeArray = NewTypeCodeArray(coltypes, nfields, typeCodes);
+    buffer = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idReturnResultSetBuffer,
+                                       (jint) festate->cursor, (jint) fetch_size, typeCodeArray);
+    (*Jenv)->DeleteLocalRef(Jenv, typeCodeArray);
+    if(buffer == NULL){
+    	pfree(typeCodes);
+    	return;
+    }
+    if(festate->batchBuffer == NULL || !(*Jenv)->IsSameObject(Jenv, buffer, festate->batchBuffer)){
+    	if(festate->batchBuffer != NULL){
+    		(*Jenv)->DeleteGlobalRef(Jenv, festate->batchBuffer);
+    	}
+    	festate->batchBuffer = (*Jenv)->NewGlobalRef(Jenv, buffer);
+    	festate->batchAddress = (char *)(*Jenv)->GetDirectBufferAddress(Jenv, buffer);
+    	if(festate->batchBuffer == NULL || festate->batchAddress == NULL){
+    		ereport(ERROR, (errmsg("Failed to access the batch buffer")));
     	}
-    	tuple = BuildTupleFromCStrings(TupleDescGetAttInMetadata(node->ss.ss_currentRelation->rd_att), values);
-    	ExecStoreTuple(tuple, slot, InvalidBuffer, false);
-    	++(conn->festate->NumberOfRows);
-    	// Take out the garbage
-    	for(i=0; i < numberOfColumns; i++){
-    		tempString = (jstring)(*Jenv)->GetObjectArrayElement(Jenv, rowArray,i);
-    		(*Jenv)->ReleaseStringUTFChars(Jenv, tempString, values[i]);
-    		(*Jenv)->DeleteLocalRef(Jenv, tempString);
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, buffer);
+
+    base = festate->batchAddress;
+    memcpy(header, base, sizeof(header));
+    ntuples = header[0];
+    if(header[1] != nfields){
+    	ereport(ERROR, (errmsg("Batch buffer has %d columns, expected %d", header[1], nfields)));
+    }
+    numberOfCells = ntuples * nfields;
+    res->ntuples = ntuples;
+    res->typed = (bool *)palloc0(nfields * sizeof(bool));
+    res->datums = (Datum *)palloc0(numberOfCells * sizeof(Datum));
+    res->nulls = (bool *)palloc0(numberOfCells * sizeof(bool));
+    offsets = (int *)palloc(numberOfCells * sizeof(int));
+    for(i=0; i < numberOfCells; i++){
+    	offsets[i] = -1;
+    }
+    initStringInfo(&data);
+    for(col=0; col < nfields; col++){
+    	int32 sectionOffset;
+    	const uint8 *validity;
+    	const char *values;
+
+    	memcpy(&sectionOffset, base + sizeof(header) + col * sizeof(int32), sizeof(int32));
+    	validity = (const uint8 *)(base + sectionOffset);
+    	values = base + sectionOffset + TYPEALIGN(8, (ntuples + 7) / 8);
+    	if(typeCodes[col] == JAVA_TYPE_STRING){
+    		const char *strings = values + (ntuples + 1) * sizeof(int32);
+
+    		for(row=0; row < ntuples; row++){
+    			int32 bounds[2];
+    			char *converted;
+
+    			if((validity[row / 8] & (1 << (row % 8))) == 0){
+    				continue;
+    			}
+    			memcpy(bounds, values + row * sizeof(int32), sizeof(bounds));
+    			offsets[row * nfields + col] = data.len;
+    			converted = pg_any_to_server(strings + bounds[0], bounds[1] - bounds[0], PG_UTF8);
+    			if(converted == strings + bounds[0]){
+    				appendBinaryStringInfo(&data, converted, bounds[1] - bounds[0]);
+    			} else {
+    				appendStringInfoString(&data, converted);
+    				pfree(converted);
+    			}
+    			appendStringInfoChar(&data, '\0');
+    		}
+    	} else {
+    		res->typed[col] = true;
+    		res->nbytes += ntuples * sizeof(Datum);
+    		for(row=0; row < ntuples; row++){
+    			i = row * nfields + col;
+    			res->nulls[i] = ((validity[row / 8] & (1 << (row % 8))) == 0);
+    			if(!res->nulls[i]){
+    				res->datums[i] = BufferSlotToDatum(typeCodes[col], values + row * 8);
+    			}
+    		}
     	}
-    	(*Jenv)->DeleteLocalRef(Jenv, rowArray);
     }
-    (*Jenv)->PopLocalFrame(Jenv, NULL);
-    return(slot);
+    res->data = data.data;
+    res->nbytes += data.len;
+    res->values = (char **)palloc(numberOfCells * sizeof(char *));
+    for(i=0; i < numberOfCells; i++){
+    	res->values[i] = (offsets[i] < 0) ? NULL : res->data + offsets[i];
+    }
+    pfree(offsets);
+    pfree(typeCodes);
+}
+
+/*
+ * UnixToDate:
+ * 		Shift a date from days since the Unix epoch to the PostgreSQL epoch,
+ * 		keeping the infinities, which JDBCUtils.epochDays sends as
+ * 		DATEVAL_NOBEGIN and DATEVAL_NOEND.
+ */
+static DateADT
+UnixToDate(int32 days)
+{
+	if(days == DATEVAL_NOBEGIN || days == DATEVAL_NOEND){
+		return (DateADT) days;
+	}
+	return (DateADT) (days - (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE));
+}
+
+#ifdef HAVE_INT64_TIMESTAMP
+/*
+ * UnixToTimestamp:
+ * 		Shift a timestamp from microseconds since the Unix epoch to the
+ * 		PostgreSQL epoch. The infinities, which JDBCUtils.epochMicros sends
+ * 		as DT_NOBEGIN and DT_NOEND already, are kept as they are.
+ */
+static Timestamp
+UnixToTimestamp(int64 micros)
+{
+	if(micros == DT_NOBEGIN || micros == DT_NOEND){
+		return (Timestamp) micros;
+	}
+	return (Timestamp) (micros - (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY);
+}
+#endif
+
+/*
+ * BufferSlotToDatum:
+ * 		Convert one 8-byte value slot of a batch buffer into a Datum. The
+ * 		slot holds a float64 for JAVA_TYPE_FLOAT and JAVA_TYPE_DOUBLE and
+ * 		an int64 for everything else.
+ */
+static Datum
+BufferSlotToDatum(int typeCode, const char *slot)
+{
+	int64 intValue;
+	double floatValue;
+
+	if(typeCode == JAVA_TYPE_FLOAT || typeCode == JAVA_TYPE_DOUBLE){
+		memcpy(&floatValue, slot, sizeof(double));
+		return (typeCode == JAVA_TYPE_FLOAT) ? Float4GetDatum((float4) floatValue)
+		                                     : Float8GetDatum(floatValue);
+	}
+	memcpy(&intValue, slot, sizeof(int64));
+	switch(typeCode){
+		case JAVA_TYPE_SHORT:
+			return Int16GetDatum((int16) intValue);
+		case JAVA_TYPE_INT:
+			return Int32GetDatum((int32) intValue);
+		case JAVA_TYPE_LONG:
+			return Int64GetDatum(intValue);
+		case JAVA_TYPE_BOOLEAN:
+			return BoolGetDatum(intValue != 0);
+		case JAVA_TYPE_DATE:
+			return DateADTGetDatum(UnixToDate((int32) intValue));
+#ifdef HAVE_INT64_TIMESTAMP
+		case JAVA_TYPE_TIMESTAMP:
+			return TimestampGetDatum(UnixToTimestamp(intValue));
+#endif
+		default:
+			elog(ERROR, "unexpected Java type code %d", typeCode);
+	}
+	return (Datum) 0;   /* keep compiler quiet */
+}
+
+/*
+ * NewTypeCodeArray:
+ * 		Fill typeCodes with the Java type code of each column and return
+ * 		them as a Java int array. Without coltypes every column is text.
+ */
+static jintArray
+NewTypeCodeArray(const Oid *coltypes, int nfields, jint *typeCodes)
+{
+	jintArray typeCodeArray;
+	int col;
+
+	for(col=0; col < nfields; col++){
+		typeCodes[col] = (coltypes != NULL) ? JavaTypeCode(coltypes[col]) : JAVA_TYPE_STRING;
+	}
+	typeCodeArray = (*Jenv)->NewIntArray(Jenv, nfields);
+	if(typeCodeArray == NULL){
+		ereport(ERROR, (errmsg("Failed to create the type code array")));
+	}
+	(*Jenv)->SetIntArrayRegion(Jenv, typeCodeArray, 0, nfields, typeCodes);
+	return typeCodeArray;
+}
+
+/*
+ * StoreTypedColumn:
+ * 		Convert one column of a typed batch into Datums. Dates and
+ * 		timestamps arrive relative to the Unix epoch and are shifted to the
+ * 		PostgreSQL epoch.
+ */
+static void
+StoreTypedColumn(Jresult *res, int col, int typeCode, const void *values)
+{
+	Datum *datum = res->datums + col;
+	int nfields = res->nfields;
+	int row;
+
+	switch(typeCode){
+		case JAVA_TYPE_SHORT:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = Int16GetDatum(((const jshort *)values)[row]);
+			break;
+		case JAVA_TYPE_INT:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = Int32GetDatum(((const jint *)values)[row]);
+			break;
+		case JAVA_TYPE_LONG:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = Int64GetDatum(((const jlong *)values)[row]);
+			break;
+		case JAVA_TYPE_FLOAT:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = Float4GetDatum(((const jfloat *)values)[row]);
+			break;
+		case JAVA_TYPE_DOUBLE:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = Float8GetDatum(((const jdouble *)values)[row]);
+			break;
+		case JAVA_TYPE_BOOLEAN:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = BoolGetDatum(((const jboolean *)values)[row] != JNI_FALSE);
+			break;
+		case JAVA_TYPE_DATE:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = DateADTGetDatum(UnixToDate(((const jint *)values)[row]));
+			break;
+#ifdef HAVE_INT64_TIMESTAMP
+		case JAVA_TYPE_TIMESTAMP:
+			for(row=0; row < res->ntuples; row++, datum += nfields)
+				*datum = TimestampGetDatum(UnixToTimestamp(((const jlong *)values)[row]));
+			break;
+#endif
+		default:
+			elog(ERROR, "unexpected Java type code %d", typeCode);
+	}
+}
+
+/*
+ * JavaTypeCode:
+ * 		Map a local column type to the getter used for it in
+ * 		JDBCUtils.returnResultSetTyped. Types without a native getter,
+ * 		including domains, are transferred as text.
+ */
+static int
+JavaTypeCode(Oid typid)
+{
+	switch(typid){
+		case INT2OID:
+			return JAVA_TYPE_SHORT;
+		case INT4OID:
+			return JAVA_TYPE_INT;
+		case INT8OID:
+			return JAVA_TYPE_LONG;
+		case FLOAT4OID:
+			return JAVA_TYPE_FLOAT;
+		case FLOAT8OID:
+			return JAVA_TYPE_DOUBLE;
+		case BOOLOID:
+			return JAVA_TYPE_BOOLEAN;
+		case DATEOID:
+			return JAVA_TYPE_DATE;
+#ifdef HAVE_INT64_TIMESTAMP
+		case TIMESTAMPOID:
+			return JAVA_TYPE_TIMESTAMP;
+#endif
+		default:
+			return JAVA_TYPE_STRING;
+	}
+}
+
+/*
+ * JavaParamTypeCode:
+ * 		Map the local type of a query parameter to the setter used to bind
+ * 		it in JDBCUtils.executePrepared. Character types are bound as
+ * 		strings, anything else without a setter of its own is sent untyped
+ * 		so the remote server can infer its type.
+ */
+static int
+JavaParamTypeCode(Oid typid)
+{
+	switch(typid){
+		case TIMESTAMPOID:
+			return JAVA_TYPE_TIMESTAMP;
+		case NUMERICOID:
+			return JAVA_TYPE_NUMERIC;
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+		case NAMEOID:
+			return JAVA_TYPE_STRING;
+		default:
+			break;
+	}
+	if(JavaTypeCode(typid) != JAVA_TYPE_STRING){
+		return JavaTypeCode(typid);
+	}
+	return JAVA_TYPE_OTHER;
+}
+
+/*
+ * NewStringArray:
+ * 		Create a Java String array from C strings, NULL becoming null
+ */
+static jobjectArray
+NewStringArray(int nvalues, const char *const *values)
+{
+	jobjectArray array;
+	jstring value;
+	int i;
+
+	array = (*Jenv)->NewObjectArray(Jenv, nvalues, handles.JavaStringClass, NULL);
+	if(array == NULL){
+		ereport(ERROR, (errmsg("Failed to create a Java String array")));
+	}
+	for(i=0; i < nvalues; i++){
+		if(values[i] == NULL){
+			continue;
+		}
+		value = (*Jenv)->NewStringUTF(Jenv, values[i]);
+		if(value == NULL){
+			ereport(ERROR, (errmsg("Failed to create a Java String")));
+		}
+		(*Jenv)->SetObjectArrayElement(Jenv, array, i, value);
+		(*Jenv)->DeleteLocalRef(Jenv, value);
+	}
+	return array;
+}
+
+/*
+ * CopyJavaString:
+ * 		Append the UTF-8 form of a Java String and a terminating zero to
+ * 		buf. Returns the offset of the copy, or -1 for a null String.
+ */
+static int
+CopyJavaString(StringInfo buf, jstring cell)
+{
+	jsize nchars;
+	jsize nbytes;
+	int offset;
+
+	if(cell == NULL){
+		return -1;
+	}
+	offset = buf->len;
+	nchars = (*Jenv)->GetStringLength(Jenv, cell);
+	nbytes = (*Jenv)->GetStringUTFLength(Jenv, cell);
+	enlargeStringInfo(buf, nbytes + 1);
+	(*Jenv)->GetStringUTFRegion(Jenv, cell, 0, nchars, buf->data + buf->len);
+	buf->len += nbytes;
+	buf->data[buf->len++] = '\0';
+	return offset;
+}
+
+/*
+ * JQsetFetchSize:
+ * 		Set the number of rows the driver should get from the remote server
+ * 		per round trip, for the statements created by the following JQexec
+ * 		calls. Zero means the driver default.
+ */
+void
+JQsetFetchSize(Jconn *conn, int fetch_size)
+{
+	conn->fetchSize = fetch_size;
+}
+
+/*
+ * JQsetMaxRows:
+ * 		Cap the number of rows of the cursors opened by the following
+ * 		JQopenPrepared calls, through Statement.setMaxRows. Zero means no
+ * 		limit.
+ */
+void
+JQsetMaxRows(Jconn *conn, int max_rows)
+{
+	conn->maxRows = max_rows;
+}
+
+/*
+ * JQbatchbytes:
+ * 		Approximate amount of row data held by a result of JQfetch
+ */
+Size
+JQbatchbytes(const Jresult *res)
+{
+	return res->nbytes;
+}
+
+/*
+ * JQlastbatch:
+ * 		True if the result set was exhausted by the JQfetch that returned
+ * 		res, even if res itself holds rows
+ */
+bool
+JQlastbatch(const Jresult *res)
+{
+	return res->lastbatch;
+}
+
+/*
+ * JQcloseCursor:
+ * 		Release the result set of a cursor opened by JQdeclareCursor or
+ * 		JQopenPrepared. The other cursors of the connection are left open.
+ */
+void
+JQcloseCursor(Jconn *conn, jdbcFdwExecutionState *festate)
+{
+	jstring returnValue;
+	char *cString = NULL;
+
+	ereport(DEBUG3, (errmsg("In JQcloseCursor: %u", festate->cursor)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+	if(festate->batchBuffer != NULL){
+		(*Jenv)->DeleteGlobalRef(Jenv, festate->batchBuffer);
+		festate->batchBuffer = NULL;
+		festate->batchAddress = NULL;
+	}
+    festate->NumberOfColumns = 0;
+    festate->NumberOfRows = 0;
+    conn->ncursors--;
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idCloseStatement,
+                                            (jint) festate->cursor);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+}
+
+/*
+ * ExecutePrepared:
+ * 		Bind the text form of the parameters, NULL for SQL NULL, to the
+ * 		statement prepared as stmtName and execute it. With a cursor_number
+ * 		of 0 or more the result set is left open as that cursor for JQfetch.
+ */
+static void
+ExecutePrepared(Jconn *conn, const char *stmtName, int nParams,
+    const char *const *paramValues, int cursor_number)
+{
+	jstring name;
+	jobjectArray values;
+	jstring returnValue;
+	char *cString = NULL;
+
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+    name = (*Jenv)->NewStringUTF(Jenv, stmtName);
+    if(name == NULL){
+        ereport(ERROR, (errmsg("Failed to create statement name argument")));
+    }
+    values = NewStringArray(nParams, paramValues);
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idExecutePrepared,
+                                            name, values, (jint) cursor_number, (jint) conn->fetchSize,
+                                            (jint) conn->maxRows);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, values);
+    (*Jenv)->DeleteLocalRef(Jenv, name);
 }
 
+/*
+ * JQexecPrepared:
+ * 		Execute a statement prepared by JQprepare. Only text parameters
+ * 		and results are supported. Rows returned, e.g. by RETURNING, are
+ * 		read right away; for other commands JQcmdTuples gives the number
+ * 		of rows affected.
+ */
 Jresult *
 JQexecPrepared(Jconn *conn, const char *stmtName, int nParams,
     const char *const *paramValues, const int *paramLengths,
     const int *paramFormats, int resultFormat)
 {
-	ereport(DEBUG3, (errmsg("In JQexecPrepared")));
-    return 0;
+	Jresult *res;
+	jobjectArray rows;
+
+	ereport(DEBUG3, (errmsg("In JQexecPrepared: %s, %d", stmtName, nParams)));
+	ExecutePrepared(conn, stmtName, nParams, paramValues, -1);
+	res = (Jresult *)palloc0(sizeof(Jresult));
+	rows = (*Jenv)->GetObjectField(Jenv, conn->utilsObject, handles.idReturnedRows);
+	if(rows != NULL){
+		res->resultStatus = PGRES_TUPLES_OK;
+		res->nfields = (*Jenv)->GetIntField(Jenv, conn->utilsObject, handles.idReturnedColumns);
+		if(res->nfields > 0){
+			StoreTextCells(res, rows);
+		}
+		(*Jenv)->DeleteLocalRef(Jenv, rows);
+	} else {
+		res->resultStatus = PGRES_COMMAND_OK;
+		snprintf(res->cmdtuples, sizeof(res->cmdtuples), "%d",
+		         (int) (*Jenv)->GetIntField(Jenv, conn->utilsObject, handles.idUpdateCount));
+	}
+	res->lastbatch = true;
+    return res;
 }
 
+/*
+ * JQexecParams:
+ * 		Execute a command with parameters once, through the unnamed
+ * 		prepared statement
+ */
 Jresult *
 JQexecParams(Jconn *conn, const char *command,
     int nParams, const Oid *paramTypes, const char *const *paramValues,
@@ -464,14 +1381,288 @@ JQexecParams(Jconn *conn, const char *command,
 	Jresult *res;
 
 	ereport(DEBUG3, (errmsg("In JQexecParams: %s, %d", command, nParams)));
-	res = JQexec(conn, command);
-	if(res->resultStatus != PGRES_COMMAND_OK){
-		ereport(ERROR, (errmsg("JQexec returns %d", res->resultStatus)));
-		return res;
+	res = JQprepare(conn, "", command, nParams, paramTypes);
+	JQclear(res);
+	res = JQexecPrepared(conn, "", nParams, paramValues, paramLengths,
+	                     paramFormats, resultFormat);
+	JQdeallocate(conn, "");
+    return res;
+}
+
+/*
+ * JQopenPrepared:
+ * 		Execute a query prepared by JQprepare and keep its result set open
+ * 		as cursor cursor_number, so the rows can be read with JQfetch like
+ * 		after JQdeclareCursor. Executing it again with new parameters only
+ * 		binds them, the query is not parsed again.
+ */
+void
+JQopenPrepared(Jconn *conn, jdbcFdwExecutionState *festate, unsigned int cursor_number,
+    const char *stmtName, int nParams, const char *const *paramValues)
+{
+	ereport(DEBUG3, (errmsg("In JQopenPrepared: %s, %u, %d", stmtName, cursor_number, nParams)));
+	ExecutePrepared(conn, stmtName, nParams, paramValues, (int) cursor_number);
+	festate->query = NULL;
+	InitCursor(conn, festate, cursor_number);
+}
+
+/*
+ * JQdeallocate:
+ * 		Release a statement prepared by JQprepare, same as DEALLOCATE
+ */
+void
+JQdeallocate(Jconn *conn, const char *stmtName)
+{
+	jstring name;
+	jstring returnValue;
+	char *cString = NULL;
+
+	ereport(DEBUG3, (errmsg("In JQdeallocate: %s", stmtName)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+    name = (*Jenv)->NewStringUTF(Jenv, stmtName);
+    if(name == NULL){
+        ereport(ERROR, (errmsg("Failed to create statement name argument")));
+    }
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idDeallocate, name);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, name);
+    if(stmtName[0] != '\0'){
+    	conn->nprepared--;
+    }
+}
+
+/*
+ * JQaddBatch:
+ * 		Bind the text form of the parameters, NULL for SQL NULL, to the
+ * 		statement prepared as stmtName and add them to its batch. Nothing
+ * 		is sent to the remote server before JQexecBatch.
+ */
+void
+JQaddBatch(Jconn *conn, const char *stmtName, int nParams,
+    const char *const *paramValues)
+{
+	jstring name;
+	jobjectArray values;
+	jstring returnValue;
+	char *cString = NULL;
+
+	ereport(DEBUG3, (errmsg("In JQaddBatch: %s, %d", stmtName, nParams)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+    name = (*Jenv)->NewStringUTF(Jenv, stmtName);
+    if(name == NULL){
+        ereport(ERROR, (errmsg("Failed to create statement name argument")));
+    }
+    values = NewStringArray(nParams, paramValues);
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idAddBatch,
+                                            name, values);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, values);
+    (*Jenv)->DeleteLocalRef(Jenv, name);
+}
+
+/*
+ * JQexecBatch:
+ * 		Send the batch of the statement prepared as stmtName, built by
+ * 		JQaddBatch, in one round trip. JQcmdTuples gives the total number
+ * 		of rows affected, or an empty string, like PQcmdTuples, when the
+ * 		driver could not tell it.
+ */
+Jresult *
+JQexecBatch(Jconn *conn, const char *stmtName)
+{
+	Jresult *res;
+	jstring name;
+	jstring returnValue;
+	char *cString = NULL;
+	jint updateCount;
+
+	ereport(DEBUG3, (errmsg("In JQexecBatch: %s", stmtName)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+    name = (*Jenv)->NewStringUTF(Jenv, stmtName);
+    if(name == NULL){
+        ereport(ERROR, (errmsg("Failed to create statement name argument")));
+    }
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idExecuteBatch, name);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, name);
+
+	res = (Jresult *)palloc0(sizeof(Jresult));
+	res->resultStatus = PGRES_COMMAND_OK;
+	updateCount = (*Jenv)->GetIntField(Jenv, conn->utilsObject, handles.idUpdateCount);
+	if(updateCount >= 0){
+		snprintf(res->cmdtuples, sizeof(res->cmdtuples), "%d", (int) updateCount);
+	}
+	res->lastbatch = true;
+    return res;
+}
+
+/*
+ * JQcopyIn:
+ * 		Run the COPY ... FROM STDIN command in query with nbytes of data, in
+ * 		COPY text format, in one round trip. Only the PostgreSQL JDBC driver
+ * 		can do this. JQcmdTuples gives the number of rows copied.
+ */
+Jresult *
+JQcopyIn(Jconn *conn, const char *query, const char *data, int nbytes)
+{
+	Jresult *res;
+	jstring statement;
+	jbyteArray bytes;
+	jstring returnValue;
+	char *cString = NULL;
+
+	ereport(DEBUG3, (errmsg("In JQcopyIn: %s, %d", query, nbytes)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
 	}
+    statement = (*Jenv)->NewStringUTF(Jenv, query);
+    if(statement == NULL){
+        ereport(ERROR, (errmsg("Failed to create query argument")));
+    }
+    bytes = (*Jenv)->NewByteArray(Jenv, nbytes);
+    if(bytes == NULL){
+        ereport(ERROR, (errmsg("Failed to create COPY data argument")));
+    }
+    (*Jenv)->SetByteArrayRegion(Jenv, bytes, 0, nbytes, (const jbyte *) data);
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idCopyIn,
+                                            statement, bytes);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, bytes);
+    (*Jenv)->DeleteLocalRef(Jenv, statement);
+
+	res = (Jresult *)palloc0(sizeof(Jresult));
+	res->resultStatus = PGRES_COMMAND_OK;
+	snprintf(res->cmdtuples, sizeof(res->cmdtuples), "%d",
+	         (int) (*Jenv)->GetIntField(Jenv, conn->utilsObject, handles.idUpdateCount));
+	res->lastbatch = true;
     return res;
 }
 
+/*
+ * TransactionResult:
+ * 		Make the result of a transaction control call, with PGRES_FATAL_ERROR
+ * 		status and the Java stack trace as its message if it failed, so
+ * 		that the caller can report it at the level it needs, as for JQexec.
+ */
+static Jresult *
+TransactionResult(jstring returnValue)
+{
+	Jresult *res;
+
+	res = (Jresult *)palloc0(sizeof(Jresult));
+	res->resultStatus = PGRES_COMMAND_OK;
+	res->lastbatch = true;
+	if(returnValue != NULL){
+		char *cString = ConvertStringToCString((jobject)returnValue);
+
+		res->resultStatus = PGRES_FATAL_ERROR;
+		res->errorMessage = pstrdup(cString);
+		(*Jenv)->ReleaseStringUTFChars(Jenv, returnValue, cString);
+		(*Jenv)->DeleteLocalRef(Jenv, returnValue);
+	}
+	return res;
+}
+
+/*
+ * JQbeginTransaction:
+ * 		Start a remote transaction by turning auto-commit off, at the
+ * 		SERIALIZABLE isolation level if serializable is true and REPEATABLE
+ * 		READ otherwise. Drivers like the PostgreSQL one only read a result
+ * 		set fetch_size rows at a time within a transaction.
+ */
+Jresult *
+JQbeginTransaction(Jconn *conn, bool serializable)
+{
+	Jresult *res;
+
+	ereport(DEBUG3, (errmsg("In JQbeginTransaction: %d", serializable)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+	res = TransactionResult((jstring)(*Jenv)->CallObjectMethod(Jenv, conn->utilsObject,
+	                                                           handles.idBeginTransaction,
+	                                                           (jboolean) serializable));
+	if(res->resultStatus == PGRES_COMMAND_OK){
+		conn->inTransaction = true;
+	}
+	return res;
+}
+
+/*
+ * JQendTransaction:
+ * 		Commit the remote transaction if commit is true and roll it back
+ * 		otherwise, and turn auto-commit back on. If that fails the
+ * 		connection is left in the transaction, and so is not idle.
+ */
+Jresult *
+JQendTransaction(Jconn *conn, bool commit)
+{
+	Jresult *res;
+
+	ereport(DEBUG3, (errmsg("In JQendTransaction: %d", commit)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+	res = TransactionResult((jstring)(*Jenv)->CallObjectMethod(Jenv, conn->utilsObject,
+	                                                           handles.idEndTransaction,
+	                                                           (jboolean) commit));
+	if(res->resultStatus == PGRES_COMMAND_OK){
+		conn->inTransaction = false;
+	}
+	return res;
+}
+
+/*
+ * JQsavepoint:
+ * 		Set the savepoint of subtransaction level in the remote transaction
+ */
+Jresult *
+JQsavepoint(Jconn *conn, int level)
+{
+	ereport(DEBUG3, (errmsg("In JQsavepoint: %d", level)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+	return TransactionResult((jstring)(*Jenv)->CallObjectMethod(Jenv, conn->utilsObject,
+	                                                            handles.idSetSavepoint,
+	                                                            (jint) level));
+}
+
+/*
+ * JQendSavepoint:
+ * 		Release the savepoint of subtransaction level, after rolling back to
+ * 		it unless commit is true
+ */
+Jresult *
+JQendSavepoint(Jconn *conn, int level, bool commit)
+{
+	ereport(DEBUG3, (errmsg("In JQendSavepoint: %d, %d", level, commit)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+	return TransactionResult((jstring)(*Jenv)->CallObjectMethod(Jenv, conn->utilsObject,
+	                                                            handles.idEndSavepoint,
+	                                                            (jint) level, (jboolean) commit));
+}
+
 ExecStatusType 
 JQresultStatus(const Jresult *res)
 {
@@ -482,51 +1673,135 @@ JQresultStatus(const Jresult *res)
 void
 JQclear(Jresult *res)
 {
-	ereport(DEBUG3, (errmsg("In JQclear")));
-    return;
+	if(res == NULL){
+		return;
+	}
+	if(res->values != NULL){
+		pfree(res->values);
+	}
+	if(res->data != NULL){
+		pfree(res->data);
+	}
+	if(res->typed != NULL){
+		pfree(res->typed);
+	}
+	if(res->datums != NULL){
+		pfree(res->datums);
+	}
+	if(res->nulls != NULL){
+		pfree(res->nulls);
+	}
+	if(res->errorMessage != NULL){
+		pfree(res->errorMessage);
+	}
+	pfree(res);
 }
 
 int
 JQntuples(const Jresult *res)
 {
-	ereport(DEBUG3, (errmsg("In JQntuples")));
-    return 0;
+    return res->ntuples;
 }
 
 char *
 JQcmdTuples(Jresult *res)
 {
 	ereport(DEBUG3, (errmsg("In JQcmdTuples")));
-    return 0;
+    return res->cmdtuples;
 }
 
 char *
 JQgetvalue(const Jresult *res, int tup_num, int field_num)
 {
-	ereport(DEBUG3, (errmsg("In JQgetvalue")));
-    return 0;
+    return res->values[tup_num * res->nfields + field_num];
 }
 
+/*
+ * JQprepare:
+ * 		Prepare query, with JDBC "?" parameter markers, as stmtName. The
+ * 		local paramTypes decide how the text values given to JQexecPrepared
+ * 		are bound; if it is NULL all parameters are sent untyped. An
+ * 		unnamed ("") statement replaces the previous one.
+ */
 Jresult *
 JQprepare(Jconn *conn, const char *stmtName, const char *query,
     int nParams, const Oid *paramTypes)
 {
-	ereport(DEBUG3, (errmsg("In JQprepare")));
-    return 0;
+	Jresult *res;
+	jstring name;
+	jstring statement;
+	jintArray typeCodeArray;
+	jint *typeCodes;
+	jstring returnValue;
+	char *cString = NULL;
+	int i;
+
+	ereport(DEBUG3, (errmsg("In JQprepare: %s, %s", stmtName, query)));
+	if(conn->utilsObject == NULL){
+		ereport(ERROR, (errmsg("Cannot get the utilsObject from the connection")));
+	}
+    name = (*Jenv)->NewStringUTF(Jenv, stmtName);
+    statement = (*Jenv)->NewStringUTF(Jenv, query);
+    if(name == NULL || statement == NULL){
+        ereport(ERROR, (errmsg("Failed to create query argument")));
+    }
+    typeCodes = (jint *)palloc(Max(nParams, 1) * sizeof(jint));
+    for(i=0; i < nParams; i++){
+    	typeCodes[i] = (paramTypes == NULL) ? JAVA_TYPE_OTHER : JavaParamTypeCode(paramTypes[i]);
+    }
+    typeCodeArray = (*Jenv)->NewIntArray(Jenv, nParams);
+    if(typeCodeArray == NULL){
+        ereport(ERROR, (errmsg("Failed to create the parameter type array")));
+    }
+    (*Jenv)->SetIntArrayRegion(Jenv, typeCodeArray, 0, nParams, typeCodes);
+    pfree(typeCodes);
+    returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idPrepareStatement,
+                                            name, statement, typeCodeArray);
+    if(returnValue != NULL){  // Happy return Value is null
+        cString = ConvertStringToCString((jobject)returnValue);
+        ereport(ERROR, (errmsg("%s", cString)));
+    }
+    (*Jenv)->DeleteLocalRef(Jenv, typeCodeArray);
+    (*Jenv)->DeleteLocalRef(Jenv, statement);
+    (*Jenv)->DeleteLocalRef(Jenv, name);
+    if(stmtName[0] != '\0'){
+    	conn->nprepared++;
+    }
+	res = (Jresult *)palloc0(sizeof(Jresult));
+	res->resultStatus = PGRES_COMMAND_OK;
+    return res;
 }
 
 int 
 JQnfields(const Jresult *res)
 {
-	ereport(DEBUG3, (errmsg("In JQnfields")));
-    return 0;
+    return res->nfields;
 }
 
 int 
 JQgetisnull(const Jresult *res, int tup_num, int field_num)
 {
-	ereport(DEBUG3, (errmsg("In JQgetisnull")));
-    return 0;
+    if(JQhasdatum(res, field_num)){
+        return res->nulls[tup_num * res->nfields + field_num];
+    }
+    return (res->values[tup_num * res->nfields + field_num] == NULL);
+}
+
+/*
+ * JQhasdatum:
+ * 		True if the column was fetched in binary form, in which case its
+ * 		values are read with JQgetdatum rather than JQgetvalue
+ */
+bool
+JQhasdatum(const Jresult *res, int field_num)
+{
+    return (res->typed != NULL && res->typed[field_num]);
+}
+
+Datum
+JQgetdatum(const Jresult *res, int tup_num, int field_num)
+{
+    return res->datums[tup_num * res->nfields + field_num];
 }
 
 Jconn *
@@ -586,10 +1861,29 @@ JQconnectionUsedPassword(const Jconn *conn)
     return 0;
 }
 
+/*
+ * JQfinish:
+ * 		Close the JDBC connection, along with the statements it caches,
+ * 		and free conn. Failures are only reported as a warning, as this is
+ * 		also used to clean up after errors.
+ */
 void
 JQfinish(Jconn *conn)
 {
+	jstring returnValue;
+	char *cString = NULL;
+
 	ereport(DEBUG3, (errmsg("In JQfinish for conn=%p", conn)));
+	if(conn->utilsObject != NULL){
+		returnValue = (*Jenv)->CallObjectMethod(Jenv, conn->utilsObject, handles.idCloseConnection);
+		if(returnValue != NULL){
+			cString = ConvertStringToCString((jobject)returnValue);
+			ereport(WARNING, (errmsg("%s", cString)));
+			(*Jenv)->DeleteLocalRef(Jenv, returnValue);
+		}
+		(*Jenv)->DeleteGlobalRef(Jenv, conn->utilsObject);
+		conn->utilsObject = NULL;
+	}
 	pfree(conn);
 	conn = NULL;
     return;
@@ -606,12 +1900,32 @@ char *
 JQresultErrorField(const Jresult *res, int fieldcode)
 {
 	ereport(DEBUG3, (errmsg("In JQresultErrorField")));
+	if(res != NULL && fieldcode == PG_DIAG_MESSAGE_PRIMARY){
+		return res->errorMessage;
+	}
     return 0;
 }
 
+/*
+ * JQtransactionStatus:
+ * 		The connection is idle unless a result set is still open, a named
+ * 		prepared statement was not deallocated, as happens when a query is
+ * 		aborted, or the remote transaction could not be ended. Such a
+ * 		connection is discarded at the end of the transaction, idle ones
+ * 		are kept along with their statement cache.
+ */
 PGTransactionStatusType
 JQtransactionStatus(const Jconn *conn)
 {
 	ereport(DEBUG3, (errmsg("In JQtransactionStatus")));
-    return PQTRANS_UNKNOWN;
+	if(conn->status != CONNECTION_OK){
+		return PQTRANS_UNKNOWN;
+	}
+	if(conn->ncursors > 0 || conn->nprepared > 0){
+		return PQTRANS_ACTIVE;
+	}
+	if(conn->inTransaction){
+		return PQTRANS_INTRANS;
+	}
+    return PQTRANS_IDLE;
 }
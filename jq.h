@@ -17,20 +17,45 @@
 typedef struct jdbcFdwExecutionState
 {
         char            *query;
+        unsigned int    cursor;         /* Java side handle of the result set */
         int             NumberOfRows;
         int             NumberOfColumns;
+        jobject         batchBuffer;    /* global ref to the last JQ_TRANSFER_BUFFER batch */
+        char           *batchAddress;   /* its native address */
 } jdbcFdwExecutionState;
 
 /* JDBC connection, same role as PGconn */
 typedef struct Jconn {
     jobject utilsObject;
     ConnStatusType status;
-    jdbcFdwExecutionState *festate;
+    int fetchSize;          /* rows per round trip asked of the driver, 0 for its default */
+    int maxRows;            /* row limit of the cursors opened next, 0 for none */
+    int ncursors;           /* result sets open on the connection */
+    int nprepared;          /* named statements prepared and not deallocated */
+    bool inTransaction;     /* auto-commit is off for a remote transaction */
 } Jconn;
 
+/* How JQfetch moves a batch of rows across the JNI boundary */
+typedef enum JtransferMode {
+    JQ_TRANSFER_TEXT,   /* every value as a Java String */
+    JQ_TRANSFER_TYPED,  /* primitive arrays for types with a native getter */
+    JQ_TRANSFER_BUFFER  /* typed values serialized into a direct ByteBuffer */
+} JtransferMode;
+
 /* Same thing for Jresult replacing PGresult */
 typedef struct Jresult{
 	ExecStatusType resultStatus;
+	int ntuples;        /* number of rows fetched by JQfetch */
+	int nfields;        /* number of columns in each row */
+	char **values;      /* row-major cell values, NULL for SQL NULL */
+	char *data;         /* storage for the cell values */
+	bool *typed;        /* per column, true if it is held in datums */
+	Datum *datums;      /* row-major binary values of typed columns */
+	bool *nulls;        /* row-major null flags of typed columns */
+	bool lastbatch;     /* no rows are left after this batch */
+	Size nbytes;        /* approximate size of the row data */
+	char cmdtuples[12]; /* rows affected by a command, for JQcmdTuples */
+	char *errorMessage; /* why the result has PGRES_FATAL_ERROR status */
 } Jresult;
 /*
  * Replacement for libpq-fe.h functions
@@ -60,6 +85,28 @@ extern void JQfinish(Jconn *conn);
 extern int JQserverVersion(const Jconn *conn);
 extern char* JQresultErrorField(const Jresult *res, int fieldcode);
 extern PGTransactionStatusType JQtransactionStatus(const Jconn *conn);
-extern TupleTableSlot *JQiterate(Jconn *conn, ForeignScanState *node);
+extern void JQdeclareCursor(Jconn *conn, jdbcFdwExecutionState *festate, unsigned int cursor_number,
+    const char *query);
+extern Jresult *JQfetch(Jconn *conn, jdbcFdwExecutionState *festate, int fetch_size,
+    JtransferMode mode, const Oid *coltypes);
+extern bool JQhasdatum(const Jresult *res, int field_num);
+extern Datum JQgetdatum(const Jresult *res, int tup_num, int field_num);
+extern void JQcloseCursor(Jconn *conn, jdbcFdwExecutionState *festate);
+extern void JQsetFetchSize(Jconn *conn, int fetch_size);
+extern void JQsetMaxRows(Jconn *conn, int max_rows);
+extern bool JQlastbatch(const Jresult *res);
+extern Size JQbatchbytes(const Jresult *res);
+extern void JQopenPrepared(Jconn *conn, jdbcFdwExecutionState *festate, unsigned int cursor_number,
+    const char *stmtName, int nParams, const char *const *paramValues);
+extern void JQdeallocate(Jconn *conn, const char *stmtName);
+extern void JQaddBatch(Jconn *conn, const char *stmtName, int nParams,
+    const char *const *paramValues);
+extern Jresult *JQexecBatch(Jconn *conn, const char *stmtName);
+extern Jresult *JQcopyIn(Jconn *conn, const char *query, const char *data,
+    int nbytes);
+extern Jresult *JQbeginTransaction(Jconn *conn, bool serializable);
+extern Jresult *JQendTransaction(Jconn *conn, bool commit);
+extern Jresult *JQsavepoint(Jconn *conn, int level);
+extern Jresult *JQendSavepoint(Jconn *conn, int level, bool commit);
 
 #endif /* JQ_H */
@@ -0,0 +1,405 @@
+/*-------------------------------------------------------------------------
+ *
+ * mapping.c
+ *		  Remote mapping of local functions and operators for jdbc2_fdw
+ *
+ * The jdbc2_fdw_mapping table of the extension maps a local function or
+ * operator to an SQL template, which is sent to the remote server instead
+ * of the call, with $1, $2, ... replaced by its arguments.  A mapping is
+ * for one server, for all servers of one dialect, or for all servers, and
+ * the most specific one wins.  Mapped functions and operators are safe to
+ * send even if they aren't built-in, as long as they are immutable.
+ *
+ * The table keeps the signatures of functions and operators, which survive
+ * dump and pg_upgrade where their OIDs don't.  Each backend reads the whole
+ * table into a hash table, looked up by OID, the first time it needs a
+ * mapping; rows for functions or operators that don't exist are skipped.
+ * The table's trigger invalidates the relcache entry of the table, so all
+ * backends reread it once a change commits.  Changes to functions and
+ * operators do too, as a mapped one may have been dropped.
+ *
+ * Portions Copyright (c) 2012-2014, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/jdbc2_fdw/mapping.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "jdbc2_fdw.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/sysattr.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_extension.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_proc.h"
+#include "commands/extension.h"
+#include "commands/trigger.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+
+
+/* Columns of jdbc2_fdw_mapping */
+#define Anum_mapping_func		1
+#define Anum_mapping_op			2
+#define Anum_mapping_server		3
+#define Anum_mapping_dialect	4
+#define Anum_mapping_template	5
+
+/*
+ * Mapping cache hash table entry
+ *
+ * The lookup key is the catalog and OID of the function or operator.  All
+ * the mappings of that one, for any server or dialect, are in the list.
+ */
+typedef struct MappingCacheKey
+{
+	Oid			classid;		/* ProcedureRelationId or OperatorRelationId */
+	Oid			objid;			/* OID of function or operator */
+} MappingCacheKey;
+
+typedef struct RemoteMapping
+{
+	char	   *server;			/* server name, or NULL */
+	char	   *dialect;		/* dialect name, or NULL */
+	char	   *template;		/* remote SQL */
+} RemoteMapping;
+
+typedef struct MappingCacheEntry
+{
+	MappingCacheKey key;		/* hash key (must be first) */
+	List	   *mappings;		/* list of RemoteMapping */
+} MappingCacheEntry;
+
+/*
+ * Mapping cache (loaded on first use, and again after an invalidation)
+ */
+static HTAB *MappingHash = NULL;
+static MemoryContext MappingContext = NULL;
+static Oid	MappingRelid = InvalidOid;	/* jdbc2_fdw_mapping, if it exists */
+static uint32 MissingHashValue = 0;	/* RELNAMENSP hash of it, if it doesn't */
+
+PG_FUNCTION_INFO_V1(jdbc2_fdw_mapping_invalidate);
+
+static void load_mappings(void);
+static Oid	resolve_signature(PGFunction func, Datum signature);
+static Oid	get_mapping_relid(uint32 *hashvalue);
+static void flush_mappings(void);
+static void mapping_relcache_callback(Datum arg, Oid relid);
+static void mapping_syscache_callback(Datum arg, int cacheid,
+						  uint32 hashvalue);
+static void mapping_relname_callback(Datum arg, int cacheid,
+						 uint32 hashvalue);
+
+
+/*
+ * Return the template that the given function or operator is mapped to
+ * for the given server, or NULL if it isn't.  The result is a copy in the
+ * caller's memory context: an invalidation accepted while the caller is
+ * still using it, say while deparsing the arguments, frees the cache.
+ */
+char *
+GetRemoteTemplate(Oid classid, Oid objid, ForeignServer *server,
+				  const JdbcDialect *dialect)
+{
+	MappingCacheKey key;
+	MappingCacheEntry *entry;
+	const char *template = NULL;
+	int			best = 0;
+	ListCell   *lc;
+
+	if (MappingHash == NULL)
+		load_mappings();
+
+	key.classid = classid;
+	key.objid = objid;
+	entry = hash_search(MappingHash, &key, HASH_FIND, NULL);
+	if (entry == NULL)
+		return NULL;
+
+	/* Prefer a mapping for the server over one for its dialect or any */
+	foreach(lc, entry->mappings)
+	{
+		RemoteMapping *mapping = (RemoteMapping *) lfirst(lc);
+		int			rank;
+
+		if (mapping->server != NULL)
+		{
+			if (strcmp(mapping->server, server->servername) != 0)
+				continue;
+			rank = 3;
+		}
+		else if (mapping->dialect != NULL)
+		{
+			if (strcmp(mapping->dialect, dialect->name) != 0)
+				continue;
+			rank = 2;
+		}
+		else
+			rank = 1;
+
+		if (rank > best)
+		{
+			template = mapping->template;
+			best = rank;
+		}
+	}
+
+	return template ? pstrdup(template) : NULL;
+}
+
+/*
+ * Read jdbc2_fdw_mapping into the hash table.  If the table doesn't exist,
+ * as with an extension that wasn't updated, the hash table stays empty.
+ */
+static void
+load_mappings(void)
+{
+	HASHCTL		ctl;
+	HTAB	   *hash;
+	Relation	rel;
+	HeapScanDesc scan;
+	Snapshot	snapshot;
+	HeapTuple	tuple;
+
+	/* First time through, set up the memory context and callbacks */
+	if (MappingContext == NULL)
+	{
+		MappingContext = AllocSetContextCreate(CacheMemoryContext,
+											   "jdbc2_fdw mappings",
+											   ALLOCSET_SMALL_MINSIZE,
+											   ALLOCSET_SMALL_INITSIZE,
+											   ALLOCSET_SMALL_MAXSIZE);
+
+		CacheRegisterRelcacheCallback(mapping_relcache_callback, (Datum) 0);
+		CacheRegisterSyscacheCallback(PROCOID, mapping_syscache_callback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(OPEROID, mapping_syscache_callback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(RELNAMENSP, mapping_relname_callback,
+									  (Datum) 0);
+	}
+	else
+		MemoryContextReset(MappingContext);	/* after a failed load */
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(MappingCacheKey);
+	ctl.entrysize = sizeof(MappingCacheEntry);
+	ctl.hash = tag_hash;
+	ctl.hcxt = MappingContext;
+	hash = hash_create("jdbc2_fdw mappings", 16, &ctl,
+					   HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	/*
+	 * MappingHash is only set once the table is read, so that invalidations
+	 * accepted meanwhile don't free the hash table under us.
+	 */
+	MappingRelid = get_mapping_relid(&MissingHashValue);
+	if (!OidIsValid(MappingRelid))
+	{
+		MappingHash = hash;
+		return;
+	}
+
+	rel = heap_open(MappingRelid, AccessShareLock);
+	snapshot = RegisterSnapshot(GetLatestSnapshot());
+	scan = heap_beginscan(rel, snapshot, 0, NULL);
+
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		TupleDesc	tupdesc = RelationGetDescr(rel);
+		MappingCacheKey key;
+		MappingCacheEntry *entry;
+		RemoteMapping *mapping;
+		MemoryContext oldcontext;
+		Datum		value;
+		bool		isnull;
+		bool		found;
+
+		value = heap_getattr(tuple, Anum_mapping_func, tupdesc, &isnull);
+		if (!isnull)
+		{
+			key.classid = ProcedureRelationId;
+			key.objid = resolve_signature(to_regprocedure, value);
+		}
+		else
+		{
+			value = heap_getattr(tuple, Anum_mapping_op, tupdesc, &isnull);
+			if (isnull)
+				continue;
+			key.classid = OperatorRelationId;
+			key.objid = resolve_signature(to_regoperator, value);
+		}
+		if (!OidIsValid(key.objid))
+			continue;
+
+		oldcontext = MemoryContextSwitchTo(MappingContext);
+
+		entry = hash_search(hash, &key, HASH_ENTER, &found);
+		if (!found)
+			entry->mappings = NIL;
+
+		mapping = (RemoteMapping *) palloc0(sizeof(RemoteMapping));
+		value = heap_getattr(tuple, Anum_mapping_server, tupdesc, &isnull);
+		if (!isnull)
+			mapping->server = pstrdup(NameStr(*DatumGetName(value)));
+		value = heap_getattr(tuple, Anum_mapping_dialect, tupdesc, &isnull);
+		if (!isnull)
+			mapping->dialect = TextDatumGetCString(value);
+		value = heap_getattr(tuple, Anum_mapping_template, tupdesc, &isnull);
+		mapping->template = isnull ? pstrdup("") : TextDatumGetCString(value);
+		entry->mappings = lappend(entry->mappings, mapping);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	heap_endscan(scan);
+	UnregisterSnapshot(snapshot);
+	heap_close(rel, AccessShareLock);
+
+	MappingHash = hash;
+}
+
+/*
+ * Look up a function or operator signature with to_regprocedure or
+ * to_regoperator, which return NULL rather than fail if there's no match.
+ */
+static Oid
+resolve_signature(PGFunction func, Datum signature)
+{
+	FunctionCallInfoData fcinfo;
+	Datum		result;
+
+	InitFunctionCallInfoData(fcinfo, NULL, 1, InvalidOid, NULL, NULL);
+	fcinfo.arg[0] = CStringGetDatum(TextDatumGetCString(signature));
+	fcinfo.argnull[0] = false;
+
+	result = (*func) (&fcinfo);
+	if (fcinfo.isnull)
+		return InvalidOid;
+
+	return DatumGetObjectId(result);
+}
+
+/*
+ * Return the OID of jdbc2_fdw_mapping, which lives in the schema of the
+ * extension, or InvalidOid if there's no such table.  In that case
+ * *hashvalue is set to the RELNAMENSP hash value the table would have, to
+ * notice when it's created, or to 0 if even the schema is unknown.
+ */
+static Oid
+get_mapping_relid(uint32 *hashvalue)
+{
+	Oid			extoid;
+	Oid			nspid = InvalidOid;
+	Relation	rel;
+	SysScanDesc scan;
+	ScanKeyData key;
+	HeapTuple	tuple;
+
+	*hashvalue = 0;
+	extoid = get_extension_oid("jdbc2_fdw", true);
+	if (!OidIsValid(extoid))
+		return InvalidOid;
+
+	/* Like get_extension_schema, which isn't exported */
+	rel = heap_open(ExtensionRelationId, AccessShareLock);
+	ScanKeyInit(&key,
+				ObjectIdAttributeNumber,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(extoid));
+	scan = systable_beginscan(rel, ExtensionOidIndexId, true,
+							  NULL, 1, &key);
+	tuple = systable_getnext(scan);
+	if (HeapTupleIsValid(tuple))
+		nspid = ((Form_pg_extension) GETSTRUCT(tuple))->extnamespace;
+	systable_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	if (!OidIsValid(nspid))
+		return InvalidOid;
+
+	*hashvalue = GetSysCacheHashValue2(RELNAMENSP,
+									   CStringGetDatum("jdbc2_fdw_mapping"),
+									   ObjectIdGetDatum(nspid));
+	return get_relname_relid("jdbc2_fdw_mapping", nspid);
+}
+
+/*
+ * Forget all mappings, so they are read again when next needed.
+ */
+static void
+flush_mappings(void)
+{
+	if (MappingHash == NULL)
+		return;
+
+	MemoryContextReset(MappingContext);
+	MappingHash = NULL;
+	MappingRelid = InvalidOid;
+}
+
+/*
+ * Relcache invalidation callback: jdbc2_fdw_mapping may have changed.
+ */
+static void
+mapping_relcache_callback(Datum arg, Oid relid)
+{
+	if (!OidIsValid(relid) ||
+		(OidIsValid(MappingRelid) && relid == MappingRelid))
+		flush_mappings();
+}
+
+/*
+ * Syscache invalidation callback for pg_class by name: while there's no
+ * jdbc2_fdw_mapping, such as before ALTER EXTENSION UPDATE, it may have
+ * been created.  Only an entry of its name in the extension's schema
+ * counts, so that the lookup isn't repeated after every change of any
+ * other relation.
+ */
+static void
+mapping_relname_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	if (MappingHash == NULL || OidIsValid(MappingRelid))
+		return;
+
+	if (hashvalue == 0 || MissingHashValue == 0 ||
+		hashvalue == MissingHashValue)
+		flush_mappings();
+}
+
+/*
+ * Syscache invalidation callback: a function or operator has changed.
+ */
+static void
+mapping_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	flush_mappings();
+}
+
+/*
+ * Trigger on jdbc2_fdw_mapping that makes all backends reread it once the
+ * transaction commits.
+ */
+Datum
+jdbc2_fdw_mapping_invalidate(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "jdbc2_fdw_mapping_invalidate: not called by trigger manager");
+
+	CacheInvalidateRelcache(trigdata->tg_relation);
+
+	return PointerGetDatum(NULL);
+}
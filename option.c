@@ -12,6 +12,8 @@
  */
 #include "postgres.h"
 
+#include <limits.h>
+
 #include "jdbc2_fdw.h"
 
 #include "access/reloptions.h"
@@ -65,6 +67,8 @@ jdbc2_fdw_validator(PG_FUNCTION_ARGS)
     List       *options_list = untransformRelOptions(PG_GETARG_DATUM(0));
     Oid         catalog = PG_GETARG_OID(1);
     ListCell   *cell;
+    const char *query_option = NULL;
+    const char *name_option = NULL;
 
     /* Build our options lists if we didn't yet. */
     InitJdbcFdwOptions();
@@ -105,7 +109,11 @@ jdbc2_fdw_validator(PG_FUNCTION_ARGS)
          * Validate option value, when we can do so without any context.
          */
         if (strcmp(def->defname, "use_remote_estimate") == 0 ||
-            strcmp(def->defname, "updatable") == 0)
+            strcmp(def->defname, "updatable") == 0 ||
+            strcmp(def->defname, "bind_literals") == 0 ||
+            strcmp(def->defname, "collation_compatible") == 0 ||
+            strcmp(def->defname, "use_copy") == 0 ||
+            strcmp(def->defname, "key") == 0)
         {
             /* these accept only boolean values */
             (void) defGetBoolean(def);
@@ -124,8 +132,66 @@ jdbc2_fdw_validator(PG_FUNCTION_ARGS)
                          errmsg("%s requires a non-negative numeric value",
                                 def->defname)));
         }
+        else if (strcmp(def->defname, "fetch_size") == 0 ||
+                 strcmp(def->defname, "prefetch_bytes") == 0 ||
+                 strcmp(def->defname, "batch_size") == 0)
+        {
+            /* these must have a positive integer value */
+            long        val;
+            char       *endp;
+
+            val = strtol(defGetString(def), &endp, 10);
+            if (*endp || val <= 0 || val > INT_MAX)
+                ereport(ERROR,
+                        (errcode(ERRCODE_SYNTAX_ERROR),
+                         errmsg("%s requires a positive integer value",
+                                def->defname)));
+            /* JDBCUtils holds a whole batch of rows in memory */
+            if (strcmp(def->defname, "fetch_size") == 0 && val > MAX_FETCH_SIZE)
+                ereport(ERROR,
+                        (errcode(ERRCODE_SYNTAX_ERROR),
+                         errmsg("fetch_size must not exceed %d",
+                                MAX_FETCH_SIZE)));
+        }
+        else if (strcmp(def->defname, "prefetch_batches") == 0 ||
+                 strcmp(def->defname, "fetch_bytes") == 0 ||
+                 strcmp(def->defname, "statement_cache_size") == 0)
+        {
+            /* these must have a non-negative integer value, 0 is off */
+            long        val;
+            char       *endp;
+
+            val = strtol(defGetString(def), &endp, 10);
+            if (*endp || val < 0 || val > INT_MAX)
+                ereport(ERROR,
+                        (errcode(ERRCODE_SYNTAX_ERROR),
+                         errmsg("%s requires a non-negative integer value",
+                                def->defname)));
+        }
+        else if (strcmp(def->defname, "transfer_mode") == 0)
+        {
+            /* this errors out on an unknown mode */
+            (void) get_transfer_mode(defGetString(def));
+        }
+        else if (strcmp(def->defname, "dialect") == 0)
+        {
+            /* this errors out on an unknown dialect */
+            (void) get_dialect(defGetString(def));
+        }
+        else if (strcmp(def->defname, "query") == 0)
+            query_option = def->defname;
+        else if (strcmp(def->defname, "schema_name") == 0 ||
+                 strcmp(def->defname, "table_name") == 0)
+            name_option = def->defname;
     }
 
+    /* A foreign table reads either a remote table or a remote query */
+    if (query_option && name_option)
+        ereport(ERROR,
+                (errcode(ERRCODE_SYNTAX_ERROR),
+                 errmsg("option \"%s\" cannot be combined with \"%s\"",
+                        query_option, name_option)));
+
     PG_RETURN_VOID();
 }
 
@@ -147,6 +213,10 @@ InitJdbcFdwOptions(void)
         { "querytimeout",       ForeignServerRelationId, false },
         { "jarfile",            ForeignServerRelationId, false },
         { "maxheapsize",        ForeignServerRelationId, false },
+        { "prefetch_batches",   ForeignServerRelationId, false },
+        { "prefetch_bytes",     ForeignServerRelationId, false },
+        { "statement_cache_size", ForeignServerRelationId, false },
+        { "dialect",            ForeignServerRelationId, false },
         { "username",           UserMappingRelationId, false },
         { "password",           UserMappingRelationId, false },
         /* use_remote_estimate is available on both server and table */
@@ -155,12 +225,36 @@ InitJdbcFdwOptions(void)
         /* cost factors */
         {"fdw_startup_cost", ForeignServerRelationId, false},
         {"fdw_tuple_cost", ForeignServerRelationId, false},
+        /* fetch_size is available on both server and table */
+        {"fetch_size", ForeignServerRelationId, false},
+        {"fetch_size", ForeignTableRelationId, false},
+        /* fetch_bytes is available on both server and table */
+        {"fetch_bytes", ForeignServerRelationId, false},
+        {"fetch_bytes", ForeignTableRelationId, false},
+        /* transfer_mode is available on both server and table */
+        {"transfer_mode", ForeignServerRelationId, false},
+        {"transfer_mode", ForeignTableRelationId, false},
         /* updatable is available on both server and table */
         {"updatable", ForeignServerRelationId, false},
         {"updatable", ForeignTableRelationId, false},
+        /* batch_size is available on both server and table */
+        {"batch_size", ForeignServerRelationId, false},
+        {"batch_size", ForeignTableRelationId, false},
+        /* bind_literals is available on both server and table */
+        {"bind_literals", ForeignServerRelationId, false},
+        {"bind_literals", ForeignTableRelationId, false},
+        /* collation_compatible is available on both server and table */
+        {"collation_compatible", ForeignServerRelationId, false},
+        {"collation_compatible", ForeignTableRelationId, false},
+        /* use_copy is available on both server and table */
+        {"use_copy", ForeignServerRelationId, false},
+        {"use_copy", ForeignTableRelationId, false},
 		{"schema_name", ForeignTableRelationId, false},
 		{"table_name", ForeignTableRelationId, false},
+		{"query", ForeignTableRelationId, false},
 		{"column_name", AttributeRelationId, false},
+        /* key marks the columns that identify a row on the remote server */
+        {"key", AttributeRelationId, false},
 		{"use_remote_estimate", ForeignTableRelationId, false},
         {NULL, InvalidOid, false}
     };
@@ -302,3 +396,55 @@ ExtractConnectionOptions(List *defelems, const char **keywords,
     }
     return i;
 }
+
+/*
+ * Convert the value of the transfer_mode option into a JtransferMode.
+ */
+JtransferMode
+get_transfer_mode(const char *value)
+{
+    if (strcmp(value, "text") == 0)
+        return JQ_TRANSFER_TEXT;
+    if (strcmp(value, "typed") == 0)
+        return JQ_TRANSFER_TYPED;
+    if (strcmp(value, "buffer") == 0)
+        return JQ_TRANSFER_BUFFER;
+
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("invalid value for option \"transfer_mode\": \"%s\"",
+                    value),
+             errhint("Valid values are \"text\", \"typed\" and \"buffer\".")));
+    return JQ_TRANSFER_TEXT;    /* keep compiler quiet */
+}
+
+/*
+ * Return the attribute numbers of the columns of a foreign table that have
+ * the key option set, in column order.  They identify the remote row to
+ * update or delete in place of its ctid, which is PostgreSQL's own.
+ */
+List *
+GetKeyAttrs(Relation rel)
+{
+    TupleDesc   tupdesc = RelationGetDescr(rel);
+    List       *key_attrs = NIL;
+    int         attnum;
+
+    for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+    {
+        ListCell   *lc;
+
+        if (tupdesc->attrs[attnum - 1]->attisdropped)
+            continue;
+
+        foreach(lc, GetForeignColumnOptions(RelationGetRelid(rel), attnum))
+        {
+            DefElem    *def = (DefElem *) lfirst(lc);
+
+            if (strcmp(def->defname, "key") == 0 && defGetBoolean(def))
+                key_attrs = lappend_int(key_attrs, attnum);
+        }
+    }
+
+    return key_attrs;
+}
@@ -91,6 +91,16 @@ ALTER SERVER testserver1 OPTIONS (
 	updatable 'true',
 	fdw_startup_cost '123.456',
 	fdw_tuple_cost '0.123',
+	fetch_size '1000',
+	fetch_bytes '8388608',
+	transfer_mode 'typed',
+	prefetch_batches '4',
+	prefetch_bytes '67108864',
+	statement_cache_size '100',
+	dialect 'postgresql',
+	bind_literals 'true',
+	batch_size '100',
+	use_copy 'true',
 	service 'value',
 	connect_timeout 'value',
 	dbname 'value',
@@ -115,6 +125,12 @@ ALTER SERVER testserver1 OPTIONS (
 	-- gsslib 'value',
 	--replication 'value'
 );
+ALTER SERVER testserver1 OPTIONS (SET fetch_size '0');  -- ERROR
+ALTER SERVER testserver1 OPTIONS (SET fetch_size '100001');  -- ERROR
+ALTER SERVER testserver1 OPTIONS (SET transfer_mode 'binary');  -- ERROR
+ALTER SERVER testserver1 OPTIONS (SET prefetch_batches '-1');  -- ERROR
+ALTER SERVER testserver1 OPTIONS (SET batch_size '0');  -- ERROR
+ALTER SERVER testserver1 OPTIONS (SET dialect 'sybase');  -- ERROR
 ALTER USER MAPPING FOR public SERVER testserver1
 	OPTIONS (DROP user, DROP password);
 ALTER FOREIGN TABLE ft1 OPTIONS (schema_name 'S 1', table_name 'T 1');
@@ -177,6 +193,14 @@ CREATE OPERATOR === (
 );
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 = jdbc2_fdw_abs(t1.c2);
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 === t1.c2;
+-- mapped to remote SQL
+SELECT jdbc2_fdw_map_function('jdbc2_fdw_abs(int)', 'abs($1)');
+SELECT jdbc2_fdw_map_operator('===(int, int)', '$1 = $2', dialect => 'postgresql');
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 = jdbc2_fdw_abs(t1.c2);
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 === t1.c2;
+SELECT jdbc2_fdw_unmap_function('jdbc2_fdw_abs(int)');
+SELECT jdbc2_fdw_unmap_operator('===(int, int)', dialect => 'postgresql');
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 = jdbc2_fdw_abs(t1.c2);
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 = abs(t1.c2);
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE t1.c1 = t1.c2;
 
@@ -193,8 +217,22 @@ EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE 1 = c1!;           --
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE (c1 IS NOT NULL) IS DISTINCT FROM (c1 IS NOT NULL); -- DistinctExpr
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE c1 = ANY(ARRAY[c2, 1, c1 + 0]); -- ScalarArrayOpExpr
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE c1 = (ARRAY[c1,c2,3])[1]; -- ArrayRef
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE CASE c2 WHEN 1 THEN c1 ELSE 0 END = 1;  -- CaseExpr
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE CASE WHEN c2 > 5 THEN c2 END = 6;     -- CaseExpr without arg
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE COALESCE(c2, c1) = 1;                 -- CoalesceExpr
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE NULLIF(c2, 0) IS NULL;                -- NullIfExpr
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE GREATEST(c1, c2) = 1;                 -- MinMaxExpr
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE (c1, c2) < (100, 0);                  -- RowCompareExpr
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE (c1 = 1) IS TRUE;                     -- BooleanTest
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE c6 = E'foo''s\\bar';  -- check special chars
 EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft1 t1 WHERE c8 = 'foo';  -- can't be sent to remote
+-- constants sent as parameters
+ALTER FOREIGN TABLE ft1 OPTIONS (ADD bind_literals 'true');
+EXPLAIN (VERBOSE, COSTS false) SELECT c1, c3 FROM ft1 t1 WHERE c1 = 1 OR c3 = '00002';
+SELECT c1, c3 FROM ft1 t1 WHERE c1 = 1 OR c3 = '00002' ORDER BY c1;
+EXPLAIN (VERBOSE, COSTS false) SELECT c1, c3 FROM ft1 t1 WHERE c1 = ANY ('{1, 2, 3}');
+SELECT c1, c3 FROM ft1 t1 WHERE c1 = ANY ('{1, 2, 3}') ORDER BY c1;
+ALTER FOREIGN TABLE ft1 OPTIONS (DROP bind_literals);
 -- parameterized remote path
 EXPLAIN (VERBOSE, COSTS false)
   SELECT * FROM ft2 a, ft2 b WHERE a.c1 = 47 AND b.c1 = a.c2;
@@ -267,6 +305,81 @@ EXPLAIN (VERBOSE, COSTS false)
 SELECT ctid, * FROM ft1 t1 LIMIT 1;
 SELECT ctid, * FROM ft1 t1 LIMIT 1;
 
+-- ===================================================================
+-- transfer modes, prefetching and rescans
+-- ===================================================================
+-- the same rows come back in every transfer mode, over several batches
+ALTER FOREIGN TABLE ft1 OPTIONS (ADD fetch_size '7', ADD transfer_mode 'typed');
+SELECT * FROM ft1 t1 ORDER BY t1.c3, t1.c1 OFFSET 100 LIMIT 10;
+SELECT t1 FROM ft1 t1 ORDER BY t1.c3, t1.c1 OFFSET 100 LIMIT 10;
+SELECT * FROM ft1 t1 WHERE t1.c1 = 101 AND t1.c6 = '1' AND t1.c7 >= '1';
+ALTER FOREIGN TABLE ft1 OPTIONS (SET transfer_mode 'buffer');
+SELECT * FROM ft1 t1 ORDER BY t1.c3, t1.c1 OFFSET 100 LIMIT 10;
+SELECT t1 FROM ft1 t1 ORDER BY t1.c3, t1.c1 OFFSET 100 LIMIT 10;
+SELECT * FROM ft1 t1 WHERE t1.c1 = 101 AND t1.c6 = '1' AND t1.c7 >= '1';
+ALTER FOREIGN TABLE ft1 OPTIONS (DROP transfer_mode);
+-- rescans of the inner side of a nested loop; a parameter used only in a
+-- local filter replays the rows of an earlier pass, one sent to the remote
+-- server runs the query again
+SELECT v.x, s.c1 FROM (VALUES ('00001'), ('00002'), ('00003'), ('00004')) v(x),
+  LATERAL (SELECT c1 FROM ft1 t1
+           WHERE t1.c1 <= 10 AND t1.c3 COLLATE "C" <= v.x OFFSET 0) s
+  ORDER BY v.x, s.c1;
+SELECT v.n, s.c1 FROM (VALUES (1), (2), (3), (4)) v(n),
+  LATERAL (SELECT c1 FROM ft1 t1 WHERE t1.c1 <= v.n OFFSET 0) s
+  ORDER BY v.n, s.c1;
+ALTER FOREIGN TABLE ft1 OPTIONS (DROP fetch_size);
+-- a scan reads fetch_size rows at a time rather than the whole result first:
+-- the remote query fails on its last row, which the cursor never reaches
+CREATE FOREIGN TABLE ft_stream (c1 int, c2 int) SERVER loopback
+  OPTIONS (query 'SELECT i AS c1, 1 / (1000 - i) AS c2 FROM generate_series(1, 1000) i',
+           fetch_size '10');
+BEGIN;
+DECLARE c CURSOR FOR SELECT * FROM ft_stream;
+FETCH 3 FROM c;
+CLOSE c;
+COMMIT;
+SELECT * FROM ft_stream;  -- ERROR
+DROP FOREIGN TABLE ft_stream;
+-- a connection that reads ahead, and caches only a couple of statements
+CREATE SERVER loopback2 FOREIGN DATA WRAPPER jdbc2_fdw
+  OPTIONS (dbname 'contrib_regression', prefetch_batches '2',
+           statement_cache_size '2');
+CREATE USER MAPPING FOR CURRENT_USER SERVER loopback2;
+CREATE FOREIGN TABLE ft4 (
+	c1 int OPTIONS (column_name 'C 1'),
+	c2 int,
+	c3 text
+) SERVER loopback2 OPTIONS (schema_name 'S 1', table_name 'T 1', fetch_size '7');
+SELECT count(*), sum(c1), max(c3) FROM ft4;
+SELECT c1, c2, c3 FROM ft4 WHERE c1 <= 3 ORDER BY c1;
+SELECT c3 FROM ft4 WHERE c1 = 500;
+SELECT count(*), sum(c1), max(c3) FROM ft4;
+SELECT c1, c2, c3 FROM ft4 WHERE c1 <= 3 ORDER BY c1;
+-- closing a scan stops its read-ahead
+BEGIN;
+DECLARE c CURSOR FOR SELECT c1 FROM ft4 ORDER BY c1;
+FETCH 3 FROM c;
+CLOSE c;
+COMMIT;
+DROP FOREIGN TABLE ft4;
+DROP USER MAPPING FOR CURRENT_USER SERVER loopback2;
+DROP SERVER loopback2;
+
+-- ===================================================================
+-- foreign table defined by a remote query
+-- ===================================================================
+CREATE FOREIGN TABLE ft_join (
+	c1 int,
+	c2 int,
+	c3 text
+) SERVER loopback OPTIONS (query 'SELECT t1."C 1" AS c1, t1.c2, t2.c2 AS c3 FROM "S 1"."T 1" t1 JOIN "S 1"."T 2" t2 ON (t2.c1 = t1."C 1")');
+EXPLAIN (VERBOSE, COSTS false) SELECT * FROM ft_join WHERE c1 < 4;
+SELECT * FROM ft_join WHERE c1 < 4 ORDER BY c1;
+ALTER FOREIGN TABLE ft_join OPTIONS (ADD table_name 'T 2');  -- ERROR
+INSERT INTO ft_join VALUES (1, 1, 'x');  -- ERROR
+DROP FOREIGN TABLE ft_join;
+
 -- ===================================================================
 -- used in pl/pgsql function
 -- ===================================================================
@@ -324,6 +437,82 @@ explain (verbose, costs off) select * from ft3 where f1 = 'foo' COLLATE "C";
 explain (verbose, costs off) select * from ft3 where f2 COLLATE "C" = 'foo';
 explain (verbose, costs off) select * from ft3 where f2 = 'foo' COLLATE "C";
 
+-- ===================================================================
+-- SQL written for other databases; EXPLAIN doesn't connect to them
+-- ===================================================================
+CREATE SERVER sqlserver_svr FOREIGN DATA WRAPPER jdbc2_fdw
+  OPTIONS (dialect 'sqlserver');
+CREATE SERVER oracle_svr FOREIGN DATA WRAPPER jdbc2_fdw
+  OPTIONS (dialect 'oracle');
+CREATE SERVER mysql_svr FOREIGN DATA WRAPPER jdbc2_fdw
+  OPTIONS (dialect 'mysql');
+CREATE FOREIGN TABLE ft_sqlserver (
+	c1 int OPTIONS (column_name 'C 1'),
+	c2 int,
+	c3 text,
+	c4 date,
+	c5 timestamp
+) SERVER sqlserver_svr OPTIONS (schema_name 'S 1', table_name 'T 1');
+CREATE FOREIGN TABLE ft_oracle (
+	c1 int OPTIONS (column_name 'C 1'),
+	c2 int,
+	c3 text,
+	c4 date,
+	c5 timestamp
+) SERVER oracle_svr OPTIONS (schema_name 'S 1', table_name 'T 1');
+CREATE FOREIGN TABLE ft_mysql (
+	c1 int OPTIONS (column_name 'C 1'),
+	c2 int,
+	c3 text,
+	c4 date,
+	c5 timestamp
+) SERVER mysql_svr OPTIONS (schema_name 'S 1', table_name 'T 1');
+
+-- quoting, row limits, and date and timestamp literals
+EXPLAIN (VERBOSE, COSTS false)
+SELECT c1, c2 FROM ft_sqlserver
+  WHERE c4 = DATE '2015-03-29' AND c5 < TIMESTAMP '2015-03-29 02:30:00' LIMIT 5;
+EXPLAIN (VERBOSE, COSTS false)
+SELECT c1, c2 FROM ft_oracle
+  WHERE c4 = DATE '2015-03-29' AND c5 < TIMESTAMP '2015-03-29 02:30:00' LIMIT 5;
+EXPLAIN (VERBOSE, COSTS false)
+SELECT c1, c2 FROM ft_mysql
+  WHERE c4 = DATE '2015-03-29' AND c5 < TIMESTAMP '2015-03-29 02:30:00' LIMIT 5;
+
+-- LIKE is sent only where strings are said to compare alike
+EXPLAIN (VERBOSE, COSTS false) SELECT c1, c3 FROM ft_mysql WHERE c3 LIKE 'A%';
+ALTER SERVER oracle_svr OPTIONS (ADD collation_compatible 'true');
+ALTER SERVER mysql_svr OPTIONS (ADD collation_compatible 'true');
+EXPLAIN (VERBOSE, COSTS false) SELECT c1, c3 FROM ft_oracle WHERE c3 LIKE 'A%';
+EXPLAIN (VERBOSE, COSTS false) SELECT c1, c3 FROM ft_mysql WHERE c3 LIKE 'A%';
+
+-- IN lists of more than 1000 elements are split; this shows only the last
+-- element of each part
+CREATE FUNCTION remote_sql(query text) RETURNS text AS $$
+DECLARE
+	line text;
+BEGIN
+	FOR line IN EXECUTE 'EXPLAIN (VERBOSE, COSTS false) ' || query LOOP
+		IF line LIKE '%Remote SQL:%' THEN
+			RETURN regexp_replace(btrim(line), '(\d+, )+', '..., ', 'g');
+		END IF;
+	END LOOP;
+	RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+SELECT remote_sql(format('SELECT c1 FROM ft_sqlserver WHERE c1 = ANY (%L::int[])',
+                         array_agg(i)))
+  FROM generate_series(1, 1001) i;
+SELECT remote_sql(format('SELECT c1 FROM ft_oracle WHERE c1 = ANY (%L::int[])',
+                         array_agg(i)))
+  FROM generate_series(1, 1001) i;
+SELECT remote_sql(format('SELECT c1 FROM ft_mysql WHERE c1 = ANY (%L::int[])',
+                         array_agg(i)))
+  FROM generate_series(1, 1001) i;
+DROP FUNCTION remote_sql(text);
+DROP FOREIGN TABLE ft_sqlserver, ft_oracle, ft_mysql;
+DROP SERVER sqlserver_svr, oracle_svr, mysql_svr;
+
 -- ===================================================================
 -- test writable foreign table stuff
 -- ===================================================================
@@ -333,6 +522,20 @@ INSERT INTO ft2 (c1,c2,c3) SELECT c1+1000,c2+100, c3 || c3 FROM ft2 LIMIT 20;
 INSERT INTO ft2 (c1,c2,c3)
   VALUES (1101,201,'aaa'), (1102,202,'bbb'), (1103,203,'ccc') RETURNING *;
 INSERT INTO ft2 (c1,c2,c3) VALUES (1104,204,'ddd'), (1105,205,'eee');
+EXPLAIN (verbose, costs off)
+UPDATE ft2 SET c2 = c2 + 300 WHERE c1 % 10 = 3;  -- can be sent as one statement
+EXPLAIN (verbose, costs off)
+DELETE FROM ft2 WHERE c1 % 10 = 5;  -- can be sent as one statement
+-- key columns identify the remote rows instead of ctid
+ALTER FOREIGN TABLE ft2 ALTER COLUMN c1 OPTIONS (ADD key 'true');
+EXPLAIN (verbose, costs off)
+UPDATE ft2 SET c2 = c2 + 1 WHERE c1 = 1104 RETURNING c1, c2;
+ALTER FOREIGN TABLE ft2 OPTIONS (ADD batch_size '10');
+UPDATE ft2 SET c2 = c2 + 1 WHERE c1 = 1104 AND random() >= 0;  -- batched
+ALTER FOREIGN TABLE ft2 OPTIONS (DROP batch_size);
+SELECT c1, c2 FROM ft2 WHERE c1 = 1104;
+UPDATE ft2 SET c2 = c2 - 1 WHERE c1 = 1104 RETURNING c1, c2;
+ALTER FOREIGN TABLE ft2 ALTER COLUMN c1 OPTIONS (DROP key);
 UPDATE ft2 SET c2 = c2 + 300, c3 = c3 || '_update3' WHERE c1 % 10 = 3;
 UPDATE ft2 SET c2 = c2 + 400, c3 = c3 || '_update7' WHERE c1 % 10 = 7 RETURNING *;
 EXPLAIN (verbose, costs off)
@@ -348,6 +551,18 @@ DELETE FROM ft2 USING ft1 WHERE ft1.c1 = ft2.c2 AND ft1.c1 % 10 = 2;
 DELETE FROM ft2 USING ft1 WHERE ft1.c1 = ft2.c2 AND ft1.c1 % 10 = 2;
 SELECT c1,c2,c3,c4 FROM ft2 ORDER BY c1;
 
+-- batched inserts
+ALTER FOREIGN TABLE ft3 OPTIONS (ADD batch_size '2');
+INSERT INTO ft3 SELECT 'row' || i, 'x' FROM generate_series(1, 5) i;
+SELECT * FROM ft3 ORDER BY f1;
+DELETE FROM ft3;
+ALTER FOREIGN TABLE ft3 OPTIONS (DROP batch_size);
+ALTER FOREIGN TABLE ft3 OPTIONS (ADD use_copy 'true');
+INSERT INTO ft3 VALUES ('copy1', 'back\slash'), ('copy2', NULL);
+SELECT * FROM ft3 ORDER BY f1;
+DELETE FROM ft3;
+ALTER FOREIGN TABLE ft3 OPTIONS (DROP use_copy);
+
 -- Test that trigger on remote table works as expected
 CREATE OR REPLACE FUNCTION "S 1".F_BRTRIG() RETURNS trigger AS $$
 BEGIN